@@ -0,0 +1,90 @@
+#include "pch.h"
+#include "Arena.h"
+
+Arena::Scope::Scope(Arena* arena) : arena(arena), mark(arena ? arena->mark() : Mark{ 0, 0 })
+{
+}
+
+Arena::Scope::~Scope()
+{
+    if (arena) arena->rewind(mark);
+}
+
+Arena::Arena(std::size_t block_size) : current(0), offset(0), block_size(std::max<std::size_t>(block_size, 64))
+{
+}
+
+Arena::~Arena()
+{
+    for (const Block& block : blocks) {
+        ::operator delete(block.data);
+    }
+}
+
+void* Arena::allocate(std::size_t size, std::size_t alignment)
+{
+    //blocks come from operator new, so they're aligned for anything a container would ask for
+    assert(alignment <= alignof(std::max_align_t) && (alignment & (alignment - 1)) == 0);
+    if (!blocks.empty()) {
+        std::size_t start = (offset + alignment - 1) & ~(alignment - 1);
+        if (start + size <= blocks[current].size) {
+            offset = start + size;
+            return blocks[current].data + start;
+        }
+    }
+    //move on to an empty block that's big enough, or make one
+    std::size_t next = blocks.empty() ? 0 : current + 1;
+    std::size_t found = next;
+    while (found < blocks.size() && blocks[found].size < size) found++;
+    if (found == blocks.size()) {
+        std::size_t new_size = std::max(block_size, size);
+        block_size *= 2;
+        blocks.push_back(Block{ static_cast<char*>(::operator new(new_size)), new_size });
+    }
+    std::swap(blocks[next], blocks[found]);
+    current = next;
+    offset = size;
+    return blocks[current].data;
+}
+
+Arena::Mark Arena::mark() const
+{
+    return Mark{ current, offset };
+}
+
+void Arena::rewind(const Mark& mark)
+{
+    assert(mark.block < current || (mark.block == current && mark.offset <= offset));
+    current = mark.block;
+    offset = mark.offset;
+}
+
+void Arena::reset()
+{
+    current = 0;
+    offset = 0;
+}
+
+std::size_t Arena::getCapacity() const
+{
+    std::size_t capacity = 0;
+    for (const Block& block : blocks) {
+        capacity += block.size;
+    }
+    return capacity;
+}
+
+std::size_t Arena::getUsed() const
+{
+    if (blocks.empty()) return 0;
+    std::size_t used = offset;
+    for (std::size_t i = 0; i < current; i++) {
+        used += blocks[i].size;
+    }
+    return used;
+}
+
+std::size_t Arena::getBlockCount() const
+{
+    return blocks.size();
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+//monotonic arena for short-lived allocations
+////////////////////////////////////////////////////////////////////////////////
+
+//hands out memory by bumping an offset through large blocks, and never frees a single allocation:
+//everything allocated since a mark is released at once by rewinding to it, which keeps the blocks for the next round
+//(so a whole transition's worth of temporaries costs a few pointer bumps to make and nothing to free)
+//not thread-safe: each arena should only be used by one thread at a time
+class Arena {
+	struct Block {
+		char* data;
+		std::size_t size;
+	};
+	std::vector<Block> blocks; //the ones after 'current' are empty, left over from before the last rewind
+	std::size_t current; //index of the block being allocated from
+	std::size_t offset; //bytes used in the current block
+	std::size_t block_size; //size of the next block to be made; doubles each time, so big transitions only take a few blocks
+public:
+	//a position in the arena, to rewind to
+	struct Mark {
+		std::size_t block;
+		std::size_t offset;
+	};
+	//rewinds the arena to where it was when the scope started
+	class Scope {
+		Arena* arena;
+		Mark mark;
+	public:
+		explicit Scope(Arena* arena); //does nothing without an arena
+		~Scope();
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+	};
+	//
+	explicit Arena(std::size_t block_size = 64 * 1024);
+	~Arena();
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+	//
+	void* allocate(std::size_t size, std::size_t alignment);
+	Mark mark() const;
+	void rewind(const Mark& mark); //release everything allocated since the mark (anything still using it must already be gone)
+	void reset(); //release everything
+	//
+	std::size_t getCapacity() const; //bytes in all blocks
+	std::size_t getUsed() const; //bytes taken up since the last reset (including alignment padding and the unused ends of full blocks)
+	std::size_t getBlockCount() const;
+};
+
+//standard allocator on top of an Arena, so containers can put their memory in one
+//with no arena (the default) it's just the heap, so the same container type works both ways
+//copying a container gives the copy the heap (like std::pmr, the arena doesn't propagate on copy or assignment),
+//so only containers that were explicitly made with an arena ever use it, and copies of them can outlive it
+template<typename T>
+class ArenaAllocator {
+	template<typename U> friend class ArenaAllocator;
+	Arena* arena;
+public:
+	typedef T value_type;
+	//
+	ArenaAllocator() noexcept : arena(nullptr) {}
+	explicit ArenaAllocator(Arena* arena) noexcept : arena(arena) {}
+	template<typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) noexcept : arena(other.arena) {}
+	//
+	Arena* getArena() const { return arena; }
+	//
+	T* allocate(std::size_t n)
+	{
+		if (arena) return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
+		return static_cast<T*>(::operator new(n * sizeof(T)));
+	}
+	void deallocate(T* p, std::size_t) noexcept
+	{
+		if (!arena) ::operator delete(p);
+	}
+	ArenaAllocator select_on_container_copy_construction() const { return ArenaAllocator(); }
+	//
+	template<typename U>
+	bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+	template<typename U>
+	bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+};
+
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+template<typename Key, typename Value, typename Compare = std::less<Key>>
+using ArenaMap = std::map<Key, Value, Compare, ArenaAllocator<std::pair<const Key, Value>>>;
@@ -0,0 +1,1315 @@
+#include "pch.h"
+#include "Benchmarks.h"
+
+#include "ColumnarState.h"
+#include "Domains.h"
+#include "FrequencyTable.h"
+#include "LearnerQORA.h"
+#include "LearnerQORAFrozen.h"
+#include "StatePool.h"
+#include "util.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//helpers
+////////////////////////////////////////////////////////////////////////////////
+
+//nanoseconds per iteration, for printing
+static double ns_per(INT64 qpc_delta, std::size_t iterations)
+{
+    return QPC_TO_MS(qpc_delta) * 1e6 / iterations;
+}
+
+//heap allocation counter for the allocation benchmarks
+//counting means replacing the global allocation functions for the whole program (and a relaxed load on every allocation),
+//so it's only compiled in when QORA_COUNT_ALLOCATIONS is defined; without it, every count comes out as 0
+#ifdef QORA_COUNT_ALLOCATIONS
+static std::atomic<bool> allocation_counting{ false };
+static std::atomic<std::size_t> allocation_count{ 0 };
+
+void* operator new(std::size_t size)
+{
+    if (allocation_counting.load(std::memory_order_relaxed)) allocation_count.fetch_add(1, std::memory_order_relaxed);
+    void* p = std::malloc(size ? size : 1);
+    if (p == nullptr) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](std::size_t size)
+{
+    return ::operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    if (allocation_counting.load(std::memory_order_relaxed)) allocation_count.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept
+{
+    return ::operator new(size, tag);
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+    std::free(p);
+}
+#endif
+
+//number of allocations made while running f (0 without QORA_COUNT_ALLOCATIONS)
+template<typename F>
+static std::size_t count_allocations(F f)
+{
+#ifdef QORA_COUNT_ALLOCATIONS
+    std::size_t before = allocation_count.load();
+    allocation_counting = true;
+    f();
+    allocation_counting = false;
+    return allocation_count.load() - before;
+#else
+    f();
+    return 0;
+#endif
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//benchmarks
+////////////////////////////////////////////////////////////////////////////////
+
+//cost of a single observe() + recalculate() + getSuccessInterval() on tables with an increasing number of occupied input rows
+//this is what the predictors do for every candidate on every observation, so it should stay flat as the tables fill up
+static int bench_frequency_table(int argc, char** argv)
+{
+    std::size_t n = 1000000; //observations timed per occupancy level
+    if (argc > 0) n = atoi(argv[0]);
+    const std::size_t outcomes = 4;
+    const double alpha = 0.05;
+    //
+    Random random;
+    random.seed(0);
+    printf("%10s %10s %14s %12s\n", "inputs", "outcomes", "ns/observe", "bytes");
+    for (std::size_t occupancy = 1; occupancy <= (1 << 16); occupancy *= 16) {
+        FrequencyTable table(occupancy);
+        //fill every input row so the table is fully occupied before timing
+        for (std::size_t in = 0; in < occupancy; in++) {
+            for (std::size_t out = 0; out < outcomes; out++) {
+                table.observe(in, out);
+            }
+        }
+        table.recalculate(alpha);
+        //pre-generate the observations so the rng isn't timed
+        std::vector<std::pair<std::size_t, size_t>> observations(n);
+        for (auto& o : observations) {
+            o.first = random.random_int(int(occupancy));
+            o.second = random.random_int(int(outcomes));
+        }
+        //
+        double sink = 0; //keep the interval calculation from being optimized out
+        INT64 begin = QPC();
+        for (const auto& o : observations) {
+            table.observe(o.first, o.second);
+            table.recalculate(alpha);
+            sink += table.getSuccessInterval().lower;
+        }
+        INT64 end = QPC();
+        printf("%10zu %10zu %14.1f %12zu\n", occupancy, outcomes, ns_per(end - begin, n), table.getMemoryUsage());
+        if (sink < 0) printf("?\n");
+    }
+    return EXIT_SUCCESS;
+}
+
+//the same singleton conditions that the qora learner creates for a target (see StochasticEffectPredictor::observe)
+static std::vector<l_qora::Condition> singleton_conditions(const Types& types, const Object& target, const ObjectsByType& objects_by_type)
+{
+    using namespace l_qora;
+    std::vector<Condition> conditions;
+    const ObjectType& target_type_obj = types.getObjectType(target.getTypeId());
+    for (int attribute : target_type_obj.attribute_types) {
+        conditions.push_back(Condition{ {RelationGroup{-1, {Predicate{attribute, false, true, target.getAttribute(attribute)}} }} });
+    }
+    for (int other_object_type = 0; other_object_type < objects_by_type.getTypeCount(); other_object_type++) {
+        ObjectSpan others = objects_by_type.at(other_object_type);
+        if (others.empty()) continue;
+        const ObjectType& other_type_obj = types.getObjectType(other_object_type);
+        for (const Object* other : others) {
+            if (other->getObjectId() == target.getObjectId()) continue;
+            for (int attribute : target_type_obj.attribute_types) {
+                if (other_type_obj.attribute_types.find(attribute) != other_type_obj.attribute_types.end()) {
+                    conditions.push_back(Condition{ {RelationGroup{other_object_type, {Predicate{attribute, true, false, other->getAttribute(attribute) - target.getAttribute(attribute)}} }} });
+                }
+            }
+            for (int attribute : other_type_obj.attribute_types) {
+                conditions.push_back(Condition{ {RelationGroup{other_object_type, {Predicate{attribute, false, false, other->getAttribute(attribute)}} }} });
+            }
+        }
+    }
+    return conditions;
+}
+
+//cost of Condition::evaluate, interpreted vs compiled, on a mix of singleton conditions and pairs of them (like the ones test_add_pairs makes)
+static int bench_condition_evaluate(int argc, char** argv)
+{
+    using namespace l_qora;
+    int n_states = 100; //number of random states to evaluate on
+    int n_conditions = 2000; //number of conditions to evaluate per state
+    if (argc > 0) n_states = atoi(argv[0]);
+    if (argc > 1) n_conditions = atoi(argv[1]);
+    //
+    std::vector<std::pair<std::string, std::shared_ptr<Environment>>> domains{
+        {"walls", std::make_shared<DomainWalls>(8, 8)},
+        {"doors", std::make_shared<DomainWallsDoors>(8, 8, 4)}
+    };
+    printf("%10s %12s %12s %16s %16s %10s %16s %10s %12s\n", "domain", "states", "conditions", "ns/interpreted", "ns/compiled", "speedup", "ns/cached", "speedup", "predicates");
+    for (auto& domain : domains) {
+        const Types& types = domain.second->getTypes();
+        Random random;
+        random.seed(0);
+        //the target is an object of the rarest type (e.g. the player)
+        std::vector<State> states;
+        std::vector<const Object*> targets;
+        std::vector<const ObjectsByType*> objects_by_types;
+        states.reserve(n_states);
+        for (int i = 0; i < n_states; i++) {
+            states.push_back(domain.second->createRandomState(random));
+        }
+        for (const State& state : states) {
+            const ObjectsByType& objects_by_type = state.getObjectsByType();
+            const Object* target = nullptr;
+            for (int type = 0; type < objects_by_type.getTypeCount(); type++) {
+                ObjectSpan objects = objects_by_type.at(type);
+                if (!objects.empty() && (target == nullptr || objects.size() < objects_by_type.at(target->getTypeId()).size())) target = objects[0];
+            }
+            targets.push_back(target);
+            objects_by_types.push_back(&objects_by_type);
+        }
+        //build the conditions from the first few states, then pair them up at random
+        std::vector<Condition> singletons;
+        for (int i = 0; i < std::min(n_states, 4); i++) {
+            std::vector<Condition> cs = singleton_conditions(types, *targets[i], *objects_by_types[i]);
+            singletons.insert(singletons.end(), cs.begin(), cs.end());
+        }
+        std::vector<Condition> interpreted;
+        for (int i = 0; i < n_conditions; i++) {
+            const Condition& a = singletons[random.random_int(int(singletons.size()))];
+            if (i < n_conditions / 4) {
+                interpreted.push_back(a);
+            }
+            else {
+                interpreted.push_back(a + singletons[random.random_int(int(singletons.size()))]);
+            }
+        }
+        std::vector<CompiledCondition> compiled;
+        for (const Condition& c : interpreted) {
+            compiled.push_back(CompiledCondition(c));
+        }
+        PredicateCache cache;
+        std::vector<CompiledCondition> cached;
+        for (const Condition& c : interpreted) {
+            cached.push_back(CompiledCondition(c, &cache));
+        }
+        //
+        std::size_t checksum_interpreted = 0;
+        INT64 begin = QPC();
+        for (int i = 0; i < n_states; i++) {
+            for (const Condition& c : interpreted) {
+                checksum_interpreted += c.evaluate(*targets[i], *objects_by_types[i]);
+            }
+        }
+        INT64 time_interpreted = QPC() - begin;
+        std::size_t checksum_compiled = 0;
+        begin = QPC();
+        for (int i = 0; i < n_states; i++) {
+            for (const CompiledCondition& c : compiled) {
+                checksum_compiled += c.evaluate(*targets[i], *objects_by_types[i]);
+            }
+        }
+        INT64 time_compiled = QPC() - begin;
+        //the cache's setup (evaluating every unique predicate once per state) is included in its time
+        std::size_t checksum_cached = 0;
+        begin = QPC();
+        for (int i = 0; i < n_states; i++) {
+            cache.begin(*targets[i], *objects_by_types[i]);
+            cache.update();
+            for (const CompiledCondition& c : cached) {
+                checksum_cached += c.evaluate(cache);
+            }
+        }
+        INT64 time_cached = QPC() - begin;
+        //
+        std::size_t n = std::size_t(n_states) * n_conditions;
+        printf("%10s %12d %12d %16.1f %16.1f %9.1fx %16.1f %9.1fx %12zu\n", domain.first.c_str(), n_states, n_conditions, ns_per(time_interpreted, n), ns_per(time_compiled, n), double(time_interpreted) / time_compiled, ns_per(time_cached, n), double(time_interpreted) / time_cached, cache.size());
+        if (checksum_interpreted != checksum_compiled || checksum_interpreted != checksum_cached) {
+            Logger::log(Logger::formatString("Compiled conditions disagree with interpreted ones on %s", domain.first.c_str()), true);
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+//cost of evaluating conditions with and without a SpatialIndex, on walls levels of increasing size
+//without the index every positional predicate looks at every wall; with it, only at the walls in the cells it names
+static int bench_spatial_index(int argc, char** argv)
+{
+    using namespace l_qora;
+    int n_states = 4; //number of random states to evaluate on (generating the large levels takes a while)
+    int n_conditions = 1000; //number of conditions to evaluate per state
+    if (argc > 0) n_states = atoi(argv[0]);
+    if (argc > 1) n_conditions = atoi(argv[1]);
+    //
+    printf("%10s %10s %12s %14s %14s %10s %14s %14s %10s\n", "size", "objects", "conditions", "ns/compiled", "ns/indexed", "speedup", "ns/cached", "ns/indexed", "speedup");
+    for (int size : {8, 32, 100}) {
+        DomainWalls domain(size, size);
+        const Types& types = domain.getTypes();
+        Random random;
+        random.seed(0);
+        //the target is an object of the rarest type (e.g. the player)
+        std::vector<State> states;
+        std::vector<const Object*> targets;
+        std::vector<const ObjectsByType*> objects_by_types;
+        states.reserve(n_states);
+        for (int i = 0; i < n_states; i++) {
+            states.push_back(domain.createRandomState(random));
+        }
+        for (const State& state : states) {
+            const ObjectsByType& objects_by_type = state.getObjectsByType();
+            const Object* target = nullptr;
+            for (int type = 0; type < objects_by_type.getTypeCount(); type++) {
+                ObjectSpan objects = objects_by_type.at(type);
+                if (!objects.empty() && (target == nullptr || objects.size() < objects_by_type.at(target->getTypeId()).size())) target = objects[0];
+            }
+            targets.push_back(target);
+            objects_by_types.push_back(&objects_by_type);
+        }
+        //the index is built for each state, as the learner does for each observation
+        std::vector<SpatialIndex> indices(n_states);
+        //conditions from the first state, singletons and pairs
+        std::vector<Condition> singletons = singleton_conditions(types, *targets[0], *objects_by_types[0]);
+        std::vector<Condition> conditions;
+        for (int i = 0; i < n_conditions; i++) {
+            const Condition& a = singletons[random.random_int(int(singletons.size()))];
+            if (i < n_conditions / 4) {
+                conditions.push_back(a);
+            }
+            else {
+                conditions.push_back(a + singletons[random.random_int(int(singletons.size()))]);
+            }
+        }
+        std::vector<CompiledCondition> compiled;
+        for (const Condition& c : conditions) {
+            compiled.push_back(CompiledCondition(c));
+        }
+        PredicateCache cache;
+        std::vector<CompiledCondition> cached;
+        for (const Condition& c : conditions) {
+            cached.push_back(CompiledCondition(c, &cache));
+        }
+        //
+        std::size_t checksum_compiled = 0;
+        INT64 begin = QPC();
+        for (int i = 0; i < n_states; i++) {
+            for (const CompiledCondition& c : compiled) {
+                checksum_compiled += c.evaluate(*targets[i], *objects_by_types[i]);
+            }
+        }
+        INT64 time_compiled = QPC() - begin;
+        std::size_t checksum_compiled_indexed = 0;
+        begin = QPC();
+        for (int i = 0; i < n_states; i++) {
+            indices[i].build(domain.getPositionAttribute(), *objects_by_types[i]);
+            for (const CompiledCondition& c : compiled) {
+                checksum_compiled_indexed += c.evaluate(*targets[i], *objects_by_types[i], &indices[i]);
+            }
+        }
+        INT64 time_compiled_indexed = QPC() - begin;
+        std::size_t checksum_cached = 0;
+        begin = QPC();
+        for (int i = 0; i < n_states; i++) {
+            cache.begin(*targets[i], *objects_by_types[i]);
+            cache.update();
+            for (const CompiledCondition& c : cached) {
+                checksum_cached += c.evaluate(cache);
+            }
+        }
+        INT64 time_cached = QPC() - begin;
+        std::size_t checksum_cached_indexed = 0;
+        begin = QPC();
+        for (int i = 0; i < n_states; i++) {
+            indices[i].build(domain.getPositionAttribute(), *objects_by_types[i]);
+            cache.begin(*targets[i], *objects_by_types[i], &indices[i]);
+            cache.update();
+            for (const CompiledCondition& c : cached) {
+                checksum_cached_indexed += c.evaluate(cache);
+            }
+        }
+        INT64 time_cached_indexed = QPC() - begin;
+        //the interpreted groups use the index too
+        std::size_t checksum_interpreted_indexed = 0;
+        for (int i = 0; i < n_states; i++) {
+            for (const Condition& c : conditions) {
+                checksum_interpreted_indexed += c.evaluate(*targets[i], *objects_by_types[i], &indices[i]);
+            }
+        }
+        //
+        std::size_t n = std::size_t(n_states) * n_conditions;
+        printf("%10d %10zu %12d %14.1f %14.1f %9.1fx %14.1f %14.1f %9.1fx\n", size, states[0].getObjects().size(), n_conditions, ns_per(time_compiled, n), ns_per(time_compiled_indexed, n), double(time_compiled) / time_compiled_indexed, ns_per(time_cached, n), ns_per(time_cached_indexed, n), double(time_cached) / time_cached_indexed);
+        if (checksum_compiled != checksum_compiled_indexed || checksum_compiled != checksum_cached || checksum_compiled != checksum_cached_indexed || checksum_compiled != checksum_interpreted_indexed) {
+            Logger::log(Logger::formatString("Indexed evaluation disagrees with the full scan on a %dx%d level", size, size), true);
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+//heap allocations made by StochasticEffectPredictor::observe while generating singleton candidates, on walls levels of increasing size
+//each observation looks at every (other object, attribute) pair, but only the new candidates among them should cost any allocations,
+//so once the states repeat, the allocations per observation should stay flat as the levels grow
+static int bench_candidate_generation(int argc, char** argv)
+{
+    using namespace l_qora;
+    int n_observations = 200; //observations per level size
+    int n_states = 10; //number of distinct random states they cycle through
+    if (argc > 0) n_observations = atoi(argv[0]);
+    if (argc > 1) n_states = atoi(argv[1]);
+    //
+    printf("%10s %10s %12s %14s %14s %14s %16s\n", "size", "objects", "pairs/obs", "candidates", "allocations", "allocs/new", "repeat allocs/obs");
+    for (int size : {8, 16, 32}) {
+        DomainWalls domain(size, size);
+        const Types& types = domain.getTypes();
+        Random random;
+        random.seed(0);
+        std::vector<State> states;
+        states.reserve(n_states);
+        for (int i = 0; i < n_states; i++) {
+            states.push_back(domain.createRandomState(random));
+        }
+        //the target is an object of the rarest type (e.g. the player), as in bench_spatial_index
+        std::vector<const Object*> targets;
+        std::vector<const ObjectsByType*> objects_by_types;
+        std::size_t pairs = 0; //(other object, attribute) pairs looked at per pass over the states
+        for (const State& state : states) {
+            const ObjectsByType& objects_by_type = state.getObjectsByType();
+            const Object* target = nullptr;
+            for (int type = 0; type < objects_by_type.getTypeCount(); type++) {
+                ObjectSpan objects = objects_by_type.at(type);
+                if (!objects.empty() && (target == nullptr || objects.size() < objects_by_type.at(target->getTypeId()).size())) target = objects[0];
+            }
+            for (int type = 0; type < objects_by_type.getTypeCount(); type++) {
+                ObjectSpan objects = objects_by_type.at(type);
+                if (!objects.empty()) pairs += (objects.size() - (type == target->getTypeId() ? 1 : 0)) * types.getObjectType(type).attribute_types.size();
+            }
+            targets.push_back(target);
+            objects_by_types.push_back(&objects_by_type);
+        }
+        //random effects, so no condition explains them and every observation reaches candidate generation
+        std::vector<Effect> effects;
+        for (int i = 0; i < n_observations; i++) {
+            effects.push_back(AttributeValue::DEFAULT_NEIGHBORS[random.random_int(int(AttributeValue::DEFAULT_NEIGHBORS.size()))]);
+        }
+        //
+        StochasticEffectPredictor predictor;
+        std::size_t first_allocations = 0; //the first pass over the states, where the candidates are new
+        std::size_t repeat_allocations = 0; //the remaining passes, where they have all been generated before
+        for (int i = 0; i < n_observations; i++) {
+            int s = i % n_states;
+            std::size_t allocations = count_allocations([&]() { predictor.observe(types, *targets[s], *objects_by_types[s], effects[i]); });
+            ((i < n_states) ? first_allocations : repeat_allocations) += allocations;
+        }
+        std::size_t candidates = predictor.getCountPredicatesObserved();
+        int repeats = std::max(n_observations - n_states, 1);
+        printf("%10d %10zu %12.1f %14zu %14zu %14.1f %16.1f\n", size, states[0].getObjects().size(), double(pairs) / n_states, candidates, first_allocations + repeat_allocations, double(first_allocations) / std::max<std::size_t>(candidates, 1), double(repeat_allocations) / repeats);
+    }
+    return EXIT_SUCCESS;
+}
+
+//stress test for LearnerQORA's snapshots: one thread learns (publishing a snapshot every few observations) while several reader threads
+//predict from the latest snapshot, without any locks on the read path
+//every reader prediction is sanity-checked, and at the end the final snapshot has to predict exactly what the learner does
+static int bench_snapshot_stress(int argc, char** argv)
+{
+    using namespace l_qora;
+    int n_readers = 4;
+    int n_observations = 2000;
+    int publish_every = 1; //observations between snapshots
+    if (argc > 0) n_readers = atoi(argv[0]);
+    if (argc > 1) n_observations = atoi(argv[1]);
+    if (argc > 2) publish_every = std::max(atoi(argv[2]), 1);
+    //
+    DomainWalls domain(8, 8);
+    const Types& types = domain.getTypes();
+    const std::vector<Action>& actions = types.getActions();
+    Random random;
+    random.seed(0);
+    //pre-generate the transitions (random walks, restarted every 50 steps) so the learning thread only learns
+    std::deque<State> states;
+    std::vector<Transition> transitions;
+    states.push_back(domain.createRandomState(random));
+    for (int i = 0; i < n_observations; i++) {
+        const State& state = states.back();
+        ActionId action = actions[random.random_int(int(actions.size()))].id;
+        State next = domain.act(state, action, random).sample(random);
+        if (next.getObjects().empty() || (i + 1) % 50 == 0) {
+            states.push_back(domain.createRandomState(random));
+            continue;
+        }
+        states.push_back(next);
+        transitions.push_back(Transition{ &states[states.size() - 2], action, &states.back() });
+    }
+    //
+    LearnerQORA learner(types, 0.05);
+    std::atomic<bool> done{ false };
+    std::vector<std::size_t> predictions(n_readers, 0);
+    std::vector<std::size_t> epochs_seen(n_readers, 0);
+    std::vector<std::size_t> failures(n_readers, 0);
+    std::vector<std::thread> readers;
+    for (int r = 0; r < n_readers; r++) {
+        readers.push_back(std::thread([&, r]() {
+            SnapshotReader reader(learner);
+            Random reader_random;
+            reader_random.seed(r + 1);
+            std::uint64_t last_epoch = 0;
+            while (!done.load()) {
+                const Transition& t = transitions[reader_random.random_int(int(transitions.size()))];
+                const ModelSnapshot& snapshot = reader.get();
+                if (snapshot.getEpoch() != last_epoch) {
+                    last_epoch = snapshot.getEpoch();
+                    epochs_seen[r]++;
+                }
+                StateDistribution prediction = snapshot.predictTransition(*t.prevState, t.action, reader_random);
+                //every object has to come out with a value for each of its attributes
+                State sampled = prediction.sample(reader_random);
+                if (sampled.getObjects().size() != t.prevState->getObjects().size()) failures[r]++;
+                predictions[r]++;
+            }
+        }));
+    }
+    //
+    INT64 time_observe = 0;
+    INT64 time_publish = 0;
+    for (std::size_t i = 0; i < transitions.size(); i++) {
+        const Transition& t = transitions[i];
+        INT64 begin = QPC();
+        learner.observeTransition(*t.prevState, t.action, *t.nextState);
+        INT64 mid = QPC();
+        if ((i + 1) % publish_every == 0) learner.publishSnapshot();
+        INT64 end = QPC();
+        time_observe += mid - begin;
+        time_publish += end - mid;
+    }
+    done = true;
+    for (std::thread& t : readers) t.join();
+    //the final snapshot has to agree with the learner exactly
+    learner.publishSnapshot();
+    std::shared_ptr<const ModelSnapshot> snapshot = learner.getSnapshot();
+    std::size_t mismatches = 0;
+    for (const Transition& t : transitions) {
+        if (learner.predictTransition(*t.prevState, t.action, random).error(snapshot->predictTransition(*t.prevState, t.action, random)) != 0) mismatches++;
+    }
+    //
+    std::size_t total_predictions = 0;
+    std::size_t total_epochs = 0;
+    std::size_t total_failures = 0;
+    for (int r = 0; r < n_readers; r++) {
+        total_predictions += predictions[r];
+        total_epochs += epochs_seen[r];
+        total_failures += failures[r];
+    }
+    std::size_t publishes = transitions.size() / publish_every;
+    double seconds = QPC_TO_MS(time_observe + time_publish) / 1000;
+    printf("%10s %14s %14s %14s %14s %16s %12s\n", "readers", "observations", "ns/observe", "ns/publish", "predictions", "predictions/s", "snapshots");
+    printf("%10d %14zu %14.1f %14.1f %14zu %16.1f %12.1f\n", n_readers, transitions.size(), ns_per(time_observe, transitions.size()), ns_per(time_publish, std::max<std::size_t>(publishes, 1)), total_predictions, total_predictions / std::max(seconds, 1e-9), double(total_epochs) / std::max(n_readers, 1));
+    if (total_failures > 0 || mismatches > 0) {
+        Logger::log(Logger::formatString("Snapshot predictions failed: %zu malformed, %zu different from the learner", total_failures, mismatches), true);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+//remove the values from a saved model that are derived rather than loaded, so models can be compared:
+//memory estimates (which depend on vector capacities) and prediction scores (which are summed in a different order after loading)
+static void strip_derived(json& j)
+{
+    if (j.is_object()) {
+        j.erase("memory");
+        j.erase("prediction_score");
+    }
+    if (j.is_structured()) {
+        for (json& child : j) strip_derived(child);
+    }
+}
+
+//size and save/load time of a trained LearnerQORA model, as pretty-printed json (the predict default) vs the compact binary format
+//the model loaded from each format is checked against the original
+static int bench_model_format(int argc, char** argv)
+{
+    using namespace l_qora;
+    int n_observations = 2000; //random-walk observations to train on
+    if (argc > 0) n_observations = atoi(argv[0]);
+    //
+    std::vector<std::pair<std::string, std::shared_ptr<Environment>>> domains{
+        {"walls", std::make_shared<DomainWalls>(8, 8)},
+        {"doors", std::make_shared<DomainWallsDoors>(8, 8, 2, 2)}
+    };
+    printf("%10s %14s %14s %10s %14s %14s %10s %14s %14s %10s\n", "domain", "json bytes", "binary bytes", "ratio", "ms/json save", "ms/bin save", "speedup", "ms/json load", "ms/bin load", "speedup");
+    //the binary format is loaded lazily, so the load times above leave out most of the work; these include the first predictions
+    struct FirstPredictions {
+        std::string domain;
+        std::size_t count;
+        INT64 time_json;
+        INT64 time_binary;
+        INT64 time_predict_only;
+    };
+    std::vector<FirstPredictions> first_predictions;
+    for (const auto& domain : domains) {
+        const Environment& env = *domain.second;
+        const Types& types = env.getTypes();
+        const std::vector<Action>& actions = types.getActions();
+        Random random;
+        random.seed(0);
+        LearnerQORA learner(types, 0.05);
+        //random walks, restarted every 50 steps
+        std::deque<State> states; //the first few transitions are kept to predict after loading
+        std::vector<Transition> transitions;
+        State state = env.createRandomState(random);
+        for (int i = 0; i < n_observations; i++) {
+            ActionId action = actions[random.random_int(int(actions.size()))].id;
+            State next = env.act(state, action, random).sample(random);
+            if (next.getObjects().empty() || (i + 1) % 50 == 0) {
+                state = env.createRandomState(random);
+                continue;
+            }
+            learner.observeTransition(state, action, next);
+            if (transitions.size() < 200) {
+                states.push_back(state);
+                transitions.push_back(Transition{ &states.back(), action, nullptr });
+            }
+            state = next;
+        }
+        //
+        INT64 begin = QPC();
+        std::stringstream json_stream;
+        json_stream << std::setw(2) << learner.to_json();
+        std::string json_text = json_stream.str();
+        INT64 time_json_save = QPC() - begin;
+        begin = QPC();
+        BinaryWriter out;
+        learner.to_binary(out);
+        INT64 time_binary_save = QPC() - begin;
+        //
+        LearnerQORA from_json(types, 0.05);
+        begin = QPC();
+        from_json.from_json(json::parse(json_text));
+        INT64 time_json_load = QPC() - begin;
+        LearnerQORA from_binary(types, 0.05);
+        begin = QPC();
+        BinaryReader in(out.data().data(), out.size());
+        from_binary.from_binary(in);
+        INT64 time_binary_load = QPC() - begin;
+        //
+        printf("%10s %14zu %14zu %9.1fx %14.2f %14.2f %9.1fx %14.2f %14.2f %9.1fx\n", domain.first.c_str(), json_text.size(), out.size(), double(json_text.size()) / out.size(),
+            QPC_TO_MS(time_json_save), QPC_TO_MS(time_binary_save), double(time_json_save) / time_binary_save,
+            QPC_TO_MS(time_json_load), QPC_TO_MS(time_binary_load), double(time_json_load) / time_binary_load);
+        json original = learner.to_json();
+        json loaded_json = from_json.to_json();
+        json loaded_binary = from_binary.to_json();
+        for (json* j : { &original, &loaded_json, &loaded_binary }) {
+            strip_derived(*j);
+        }
+        if (!in.ok() || loaded_binary != original || loaded_json != original) {
+            Logger::log(Logger::formatString("Model loaded from the %s format differs from the original (%s domain)", (loaded_json != original) ? "json" : "binary", domain.first.c_str()), true);
+            return EXIT_FAILURE;
+        }
+        //load again and predict the kept transitions: from json, from binary, and from binary for prediction only
+        std::vector<StateDistribution> expected = learner.predictTransitions(transitions, random);
+        INT64 times[3];
+        for (int mode = 0; mode < 3; mode++) {
+            LearnerQORA loaded(types, 0.05);
+            loaded.setPredictOnly(mode == 2);
+            begin = QPC();
+            if (mode == 0) {
+                loaded.from_json(json::parse(json_text));
+            }
+            else {
+                BinaryReader in(out.data().data(), out.size());
+                loaded.from_binary(in);
+            }
+            //the snapshot published by loading has to agree as well; it's taken before the learner has read any predictors, so it reads them itself
+            std::shared_ptr<const ModelSnapshot> snapshot = loaded.getSnapshot();
+            std::vector<StateDistribution> predicted = loaded.predictTransitions(transitions, random);
+            times[mode] = QPC() - begin;
+            for (std::size_t i = 0; i < transitions.size(); i++) {
+                if (predicted[i].error(expected[i]) != 0 || snapshot->predictTransition(*transitions[i].prevState, transitions[i].action, random).error(expected[i]) != 0) {
+                    Logger::log(Logger::formatString("Prediction after loading differs from the original (%s domain, %s)", domain.first.c_str(), (mode == 0) ? "json" : (mode == 1) ? "binary" : "binary, predict only"), true);
+                    return EXIT_FAILURE;
+                }
+            }
+        }
+        first_predictions.push_back(FirstPredictions{ domain.first, transitions.size(), times[0], times[1], times[2] });
+    }
+    printf("\n%10s %14s %14s %14s %14s %10s\n", "domain", "predictions", "ms/json", "ms/bin", "ms/bin pred.", "speedup");
+    for (const FirstPredictions& row : first_predictions) {
+        printf("%10s %14zu %14.2f %14.2f %14.2f %9.1fx\n", row.domain.c_str(), row.count, QPC_TO_MS(row.time_json), QPC_TO_MS(row.time_binary), QPC_TO_MS(row.time_predict_only), double(row.time_json) / row.time_predict_only);
+    }
+    return EXIT_SUCCESS;
+}
+
+//prediction time of a trained LearnerQORA vs the LearnerQORAFrozen exported from it (also with its predictions in an arena), checked against each other,
+//and the heap allocations made by the frozen predictors' lookups (which should be none)
+static int bench_frozen_predict(int argc, char** argv)
+{
+    using namespace l_qora;
+    int n_observations = 2000; //random-walk observations to train on
+    if (argc > 0) n_observations = atoi(argv[0]);
+    //
+    std::vector<std::pair<std::string, std::shared_ptr<Environment>>> domains{
+        {"walls", std::make_shared<DomainWalls>(8, 8)},
+        {"doors", std::make_shared<DomainWallsDoors>(8, 8, 2, 2)}
+    };
+    printf("%10s %12s %14s %14s %10s %14s %12s %14s %12s\n", "domain", "predictions", "ns/qora", "ns/frozen", "speedup", "ns/arena", "lookups", "ns/lookup", "allocations");
+    for (const auto& domain : domains) {
+        const Environment& env = *domain.second;
+        const Types& types = env.getTypes();
+        const std::vector<Action>& actions = types.getActions();
+        Random random;
+        random.seed(0);
+        LearnerQORA learner(types, 0.05, 1, nullptr, 0, 0, env.getPositionAttribute());
+        //random walks, restarted every 50 steps
+        std::deque<State> states; //the first few transitions are kept to predict
+        std::vector<Transition> transitions;
+        State state = env.createRandomState(random);
+        for (int i = 0; i < n_observations; i++) {
+            ActionId action = actions[random.random_int(int(actions.size()))].id;
+            State next = env.act(state, action, random).sample(random);
+            if (next.getObjects().empty() || (i + 1) % 50 == 0) {
+                state = env.createRandomState(random);
+                continue;
+            }
+            learner.observeTransition(state, action, next);
+            if (transitions.size() < 500) {
+                states.push_back(state);
+                transitions.push_back(Transition{ &states.back(), action, nullptr });
+            }
+            state = next;
+        }
+        std::unique_ptr<LearnerQORAFrozen> frozen = learner.freeze();
+        //whole transitions, through the Learner interface
+        std::vector<StateDistribution> expected(transitions.size());
+        INT64 begin = QPC();
+        for (std::size_t i = 0; i < transitions.size(); i++) {
+            expected[i] = learner.predictTransition(*transitions[i].prevState, transitions[i].action, random);
+        }
+        INT64 time_learner = QPC() - begin;
+        std::vector<StateDistribution> predicted(transitions.size());
+        begin = QPC();
+        for (std::size_t i = 0; i < transitions.size(); i++) {
+            predicted[i] = frozen->predictTransition(*transitions[i].prevState, transitions[i].action, random);
+        }
+        INT64 time_frozen = QPC() - begin;
+        //the same, with the frozen model's StateDistributions in an arena rewound after each one (how a planner would use it)
+        Arena arena;
+        frozen->setArena(&arena);
+        begin = QPC();
+        for (std::size_t i = 0; i < transitions.size(); i++) {
+            Arena::Scope scope(&arena);
+            frozen->predictTransition(*transitions[i].prevState, transitions[i].action, random);
+        }
+        INT64 time_arena = QPC() - begin;
+        frozen->setArena(nullptr);
+        for (std::size_t i = 0; i < transitions.size(); i++) {
+            if (predicted[i].error(expected[i]) != 0) {
+                Logger::log(Logger::formatString("Frozen prediction differs from the learner (%s domain)", domain.first.c_str()), true);
+                return EXIT_FAILURE;
+            }
+        }
+        //just the predictors' lookups, without building a StateDistribution
+        struct Lookup {
+            const FrozenPredictor* predictor;
+            const Object* target;
+            const ObjectsByType* objects_by_type;
+        };
+        std::vector<Lookup> lookups;
+        for (std::size_t i = 0; i < transitions.size(); i++) {
+            const State& s = *transitions[i].prevState;
+            for (const auto& pair : s.getObjects()) {
+                const Object& obj = pair.second;
+                for (int attribute : types.getObjectType(obj.getTypeId()).attribute_types) {
+                    const FrozenPredictor* predictor = frozen->getPredictor({ EffectType{ obj.getTypeId(), attribute }, transitions[i].action });
+                    if (predictor) lookups.push_back(Lookup{ predictor, &obj, &s.getObjectsByType() });
+                }
+            }
+        }
+        std::size_t sink = 0; //keep the lookups from being optimized out
+        begin = QPC();
+        std::size_t allocations = count_allocations([&]() {
+            for (const Lookup& lookup : lookups) {
+                sink += lookup.predictor->predict(*lookup.target, *lookup.objects_by_type).size();
+            }
+        });
+        INT64 time_lookups = QPC() - begin;
+        //
+        printf("%10s %12zu %14.1f %14.1f %9.1fx %14.1f %12zu %14.1f %12zu\n", domain.first.c_str(), transitions.size(), ns_per(time_learner, transitions.size()), ns_per(time_frozen, transitions.size()), double(time_learner) / time_frozen,
+            ns_per(time_arena, transitions.size()), lookups.size(), ns_per(time_lookups, std::max<std::size_t>(lookups.size(), 1)), allocations);
+        if (sink == 0 && !lookups.empty()) printf("?\n");
+    }
+    return EXIT_SUCCESS;
+}
+
+//time and heap allocations of the AttributeValue-heavy operations: a move action, State::diff, and a relative Predicate::evaluate
+//(player vs every other object), on walls and doors levels
+static int bench_attribute_value(int argc, char** argv)
+{
+    using namespace l_qora;
+    std::size_t n_states = 100; //random states per domain
+    if (argc > 0) n_states = atoi(argv[0]);
+    std::size_t reps = 20; //times each state is run through each operation
+    if (argc > 1) reps = atoi(argv[1]);
+    //
+    std::vector<std::pair<std::string, std::shared_ptr<Environment>>> domains{
+        {"walls", std::make_shared<DomainWalls>(8, 8)},
+        {"walls_32", std::make_shared<DomainWalls>(32, 32)},
+        {"doors", std::make_shared<DomainWallsDoors>(8, 8, 2, 2)}
+    };
+    const ActionId moves[] = { Action::ID_MOVE_LEFT, Action::ID_MOVE_RIGHT, Action::ID_MOVE_UP, Action::ID_MOVE_DOWN };
+    printf("%10s %10s %14s %14s %14s %14s %14s %14s\n", "domain", "objects", "ns/act", "allocs/act", "ns/diff", "allocs/diff", "ns/evaluate", "allocs/eval");
+    for (const auto& domain : domains) {
+        const Environment& env = *domain.second;
+        Random random;
+        random.seed(0);
+        int position = env.getPositionAttribute();
+        std::vector<State> states;
+        std::vector<State> nexts;
+        std::size_t objects = 0;
+        for (std::size_t i = 0; i < n_states; i++) {
+            states.push_back(env.createRandomState(random));
+            nexts.push_back(env.act(states.back(), moves[i % 4], random).sample(random));
+            objects += states.back().getObjects().size();
+        }
+        //the target of each evaluation is the player
+        std::vector<const Object*> players;
+        for (const State& state : states) {
+            for (const auto& pair : state.getObjects()) {
+                if (env.getTypes().getObjectType(pair.second.getTypeId()).name == "player") players.push_back(&pair.second);
+            }
+        }
+        Predicate predicate{ position, true, false, AttributeValue::RIGHT };
+        //
+        std::size_t sink = 0; //keep the results from being optimized out
+        std::size_t count_act = n_states * reps;
+        INT64 begin = QPC();
+        std::size_t allocs_act = count_allocations([&]() {
+            for (std::size_t r = 0; r < reps; r++) {
+                for (std::size_t i = 0; i < n_states; i++) {
+                    env.act(states[i], moves[(i + r) % 4], random);
+                    sink++;
+                }
+            }
+        });
+        INT64 time_act = QPC() - begin;
+        std::size_t count_diff = n_states * reps;
+        begin = QPC();
+        std::size_t allocs_diff = count_allocations([&]() {
+            for (std::size_t r = 0; r < reps; r++) {
+                for (std::size_t i = 0; i < n_states; i++) {
+                    sink += nexts[i].diff(states[i]).getObjects().size();
+                }
+            }
+        });
+        INT64 time_diff = QPC() - begin;
+        std::size_t count_evaluate = objects * reps;
+        begin = QPC();
+        std::size_t allocs_evaluate = count_allocations([&]() {
+            for (std::size_t r = 0; r < reps; r++) {
+                for (std::size_t i = 0; i < n_states; i++) {
+                    for (const auto& pair : states[i].getObjects()) {
+                        sink += predicate.evaluate(*players[i], pair.second);
+                    }
+                }
+            }
+        });
+        INT64 time_evaluate = QPC() - begin;
+        //
+        printf("%10s %10.1f %14.1f %14.2f %14.1f %14.2f %14.1f %14.2f\n", domain.first.c_str(), double(objects) / n_states,
+            ns_per(time_act, count_act), double(allocs_act) / count_act,
+            ns_per(time_diff, count_diff), double(allocs_diff) / count_diff,
+            ns_per(time_evaluate, count_evaluate), double(allocs_evaluate) / count_evaluate);
+        if (sink == 0) printf("?\n");
+    }
+    return EXIT_SUCCESS;
+}
+
+//State vs ColumnarState on big walls, doors and fish levels (thousands of objects):
+//a scan over every wall, diff, error and flatten, each checked against the State result, plus the cost of converting a State
+static int bench_columnar(int argc, char** argv)
+{
+    int size = 64; //width and height of the levels
+    if (argc > 0) size = atoi(argv[0]);
+    std::size_t n_states = 4; //random states per domain
+    if (argc > 1) n_states = atoi(argv[1]);
+    std::size_t reps = 20; //times each state is run through each operation
+    if (argc > 2) reps = atoi(argv[2]);
+    //
+    std::vector<std::pair<std::string, std::shared_ptr<Environment>>> domains{
+        {"walls", std::make_shared<DomainWalls>(size, size)},
+        {"doors", std::make_shared<DomainWallsDoors>(size, size, size / 4, 2)},
+        {"fish", std::make_shared<DomainFish>(size, size, size)}
+    };
+    const ActionId moves[] = { Action::ID_MOVE_LEFT, Action::ID_MOVE_RIGHT, Action::ID_MOVE_UP, Action::ID_MOVE_DOWN };
+    printf("%8s %8s %8s %14s %14s %14s %14s %14s\n", "domain", "backend", "objects", "ns/convert", "ns/scan", "ns/diff", "ns/error", "ns/flatten");
+    for (const auto& domain : domains) {
+        const Environment& env = *domain.second;
+        const Types& types = env.getTypes();
+        int wall = types.getObjectType("wall").id;
+        int position = env.getPositionAttribute();
+        Random random;
+        random.seed(0);
+        std::vector<State> states;
+        std::vector<State> nexts;
+        std::vector<ColumnarState> columnar_states;
+        std::vector<ColumnarState> columnar_nexts;
+        std::size_t objects = 0;
+        for (std::size_t i = 0; i < n_states; i++) {
+            states.push_back(env.createRandomState(random));
+            ActionId action = (domain.first == "fish") ? types.getActionByName("MOVE") : moves[i % 4];
+            nexts.push_back(env.act(states.back(), action, random).sample(random));
+            columnar_states.emplace_back(types, states.back());
+            columnar_nexts.emplace_back(types, nexts.back());
+            objects += states.back().getObjects().size();
+        }
+        //both backends have to agree before they're timed
+        bool same = true;
+        for (std::size_t i = 0; i < n_states; i++) {
+            same = same && columnar_states[i].toState() == states[i];
+            same = same && columnar_nexts[i].diff(columnar_states[i]).toState() == nexts[i].diff(states[i]);
+            same = same && columnar_nexts[i].error(columnar_states[i]) == nexts[i].error(states[i]);
+            same = same && columnar_states[i].flatten(size, size, position).first.getValues() == env.flatten(states[i]).first.getValues();
+        }
+        if (!same) {
+            Logger::log("bench columnar: ColumnarState disagrees with State on " + domain.first, true);
+            return EXIT_FAILURE;
+        }
+        //
+        std::size_t sink = 0; //keep the results from being optimized out
+        std::size_t count = n_states * reps;
+        auto time = [&](std::function<void(std::size_t)> f) {
+            INT64 begin = QPC();
+            for (std::size_t r = 0; r < reps; r++) {
+                for (std::size_t i = 0; i < n_states; i++) {
+                    f(i);
+                }
+            }
+            return ns_per(QPC() - begin, count);
+        };
+        double state_scan = time([&](std::size_t i) {
+            for (const Object* obj : states[i].getObjectsOfClass(wall)) sink += obj->getAttribute(position)[0];
+        });
+        double state_diff = time([&](std::size_t i) { sink += nexts[i].diff(states[i]).getObjects().size(); });
+        double state_error = time([&](std::size_t i) { sink += nexts[i].error(states[i]); });
+        double state_flatten = time([&](std::size_t i) { sink += env.flatten(states[i]).first.getValues().size(); });
+        //
+        double columnar_convert = time([&](std::size_t i) { sink += ColumnarState(types, states[i]).size(); });
+        double columnar_scan = time([&](std::size_t i) {
+            const ColumnarState::Table& table = columnar_states[i].getTable(wall);
+            for (int x : table.columns[table.getColumn(position)]) sink += x;
+        });
+        double columnar_diff = time([&](std::size_t i) { sink += columnar_nexts[i].diff(columnar_states[i]).size(); });
+        double columnar_error = time([&](std::size_t i) { sink += columnar_nexts[i].error(columnar_states[i]); });
+        double columnar_flatten = time([&](std::size_t i) { sink += columnar_states[i].flatten(size, size, position).first.getValues().size(); });
+        //
+        printf("%8s %8s %8.1f %14s %14.1f %14.1f %14.1f %14.1f\n", domain.first.c_str(), "State", double(objects) / n_states,
+            "-", state_scan, state_diff, state_error, state_flatten);
+        printf("%8s %8s %8.1f %14.1f %14.1f %14.1f %14.1f %14.1f\n", domain.first.c_str(), "Columnar", double(objects) / n_states,
+            columnar_convert, columnar_scan, columnar_diff, columnar_error, columnar_flatten);
+        if (sink == 0) printf("?\n");
+    }
+    return EXIT_SUCCESS;
+}
+
+//the first half of every domain step: copy the current State and move the player (as DomainWalls::act_move does), on walls levels of increasing size
+//with copy-on-write States this should cost about the same at every size, since only the player's objects are copied
+static int bench_state_copy(int argc, char** argv)
+{
+    std::size_t n_states = 10; //random states per level size
+    if (argc > 0) n_states = atoi(argv[0]);
+    std::size_t reps = 200; //times each state is run through each operation
+    if (argc > 1) reps = atoi(argv[1]);
+    //
+    const int sizes[] = { 10, 25, 50 };
+    printf("%10s %10s %14s %14s %14s %14s %14s\n", "size", "objects", "ns/copy", "allocs/copy", "ns/step", "allocs/step", "ns/compare");
+    for (int size : sizes) {
+        DomainWalls env(size, size);
+        int player_type = env.getTypes().getObjectType("player").id;
+        int position = env.getPositionAttribute();
+        Random random;
+        random.seed(0);
+        std::vector<State> states;
+        std::size_t objects = 0;
+        for (std::size_t i = 0; i < n_states; i++) {
+            states.push_back(env.createRandomState(random));
+            objects += states.back().getObjects().size();
+        }
+        auto step = [&](const State& current) {
+            State next = current;
+            Object& player = *next.findObjectOfClass(player_type);
+            player.setAttribute(position, player.getAttribute(position) + AttributeValue::RIGHT);
+            return next;
+        };
+        std::vector<State> nexts;
+        for (const State& state : states) nexts.push_back(step(state));
+        //
+        std::size_t sink = 0; //keep the results from being optimized out
+        std::size_t count = n_states * reps;
+        INT64 begin = QPC();
+        std::size_t allocs_copy = count_allocations([&]() {
+            for (std::size_t r = 0; r < reps; r++) {
+                for (std::size_t i = 0; i < n_states; i++) {
+                    const State copy = states[i];
+                    sink += copy.getObjects().size();
+                }
+            }
+        });
+        INT64 time_copy = QPC() - begin;
+        begin = QPC();
+        std::size_t allocs_step = count_allocations([&]() {
+            for (std::size_t r = 0; r < reps; r++) {
+                for (std::size_t i = 0; i < n_states; i++) {
+                    const State next = step(states[i]);
+                    sink += next.getObjects().size();
+                }
+            }
+        });
+        INT64 time_step = QPC() - begin;
+        begin = QPC();
+        for (std::size_t r = 0; r < reps; r++) {
+            for (std::size_t i = 0; i < n_states; i++) {
+                sink += (states[i] == nexts[i]) + (states[i] < nexts[i]);
+            }
+        }
+        INT64 time_compare = QPC() - begin;
+        //
+        printf("%10d %10.1f %14.1f %14.2f %14.1f %14.2f %14.1f\n", size, double(objects) / n_states,
+            ns_per(time_copy, count), double(allocs_copy) / count,
+            ns_per(time_step, count), double(allocs_step) / count,
+            ns_per(time_compare, count));
+        if (sink == 0) printf("?\n");
+    }
+    return EXIT_SUCCESS;
+}
+
+//comparison-counting wrappers for bench_state_search
+struct CountingStateLess {
+    std::size_t* count;
+    bool operator()(const State& a, const State& b) const { (*count)++; return a < b; }
+};
+struct CountingStateEqual {
+    std::size_t* count;
+    bool operator()(const State& a, const State& b) const { (*count)++; return a == b; }
+};
+
+//breadth-first search over every state reachable from a random start (with the domain itself as the model),
+//keeping the visited set and depths the way run_bfs_to does: in ordered containers vs unordered ones keyed by State::hash
+//counts the State comparisons each needs, and the time spent in the containers
+static int bench_state_search(int argc, char** argv)
+{
+    int size = 20; //width and height of the walls levels
+    if (argc > 0) size = atoi(argv[0]);
+    std::size_t n_states = 3; //start states
+    if (argc > 1) n_states = atoi(argv[1]);
+    //
+    DomainWalls env(size, size);
+    const ActionId moves[] = { Action::ID_MOVE_LEFT, Action::ID_MOVE_RIGHT, Action::ID_MOVE_UP, Action::ID_MOVE_DOWN };
+    Random random;
+    random.seed(0);
+    printf("%8s %10s %10s %10s %16s %16s %14s %14s\n", "start", "objects", "states", "lookups", "compares/set", "compares/hash", "ms/set", "ms/hash");
+    for (std::size_t i = 0; i < n_states; i++) {
+        State start = env.createRandomState(random);
+        //expand the whole reachable space once, so both container types get exactly the same lookups
+        std::vector<std::pair<const State*, State>> lookups; //(state being expanded, successor)
+        std::unordered_set<State, StateHash> seen{ start };
+        std::vector<State> order{ start };
+        for (std::size_t q = 0; q < order.size(); q++) {
+            for (ActionId action : moves) {
+                State next = env.act(order[q], action, random).sample(random);
+                if (seen.insert(next).second) order.push_back(next);
+            }
+        }
+        for (const State& state : order) {
+            for (ActionId action : moves) lookups.emplace_back(&state, env.act(state, action, random).sample(random));
+        }
+        //ordered
+        std::size_t compares_set = 0;
+        INT64 begin = QPC();
+        {
+            std::set<State, CountingStateLess> visited(CountingStateLess{ &compares_set });
+            std::map<State, int, CountingStateLess> depths(CountingStateLess{ &compares_set });
+            visited.insert(start);
+            depths[start] = 0;
+            for (const auto& lookup : lookups) {
+                if (visited.insert(lookup.second).second) depths[lookup.second] = depths.at(*lookup.first) + 1;
+            }
+        }
+        INT64 time_set = QPC() - begin;
+        //unordered
+        std::size_t compares_hash = 0;
+        begin = QPC();
+        {
+            std::unordered_set<State, StateHash, CountingStateEqual> visited(16, StateHash(), CountingStateEqual{ &compares_hash });
+            std::unordered_map<State, int, StateHash, CountingStateEqual> depths(16, StateHash(), CountingStateEqual{ &compares_hash });
+            visited.insert(start);
+            depths[start] = 0;
+            for (const auto& lookup : lookups) {
+                if (visited.insert(lookup.second).second) depths[lookup.second] = depths.at(*lookup.first) + 1;
+            }
+        }
+        INT64 time_hash = QPC() - begin;
+        //
+        printf("%8zu %10zu %10zu %10zu %16zu %16zu %14.3f %14.3f\n", i, start.getObjects().size(), order.size(), lookups.size(),
+            compares_set, compares_hash, QPC_TO_MS(time_set), QPC_TO_MS(time_hash));
+    }
+    return EXIT_SUCCESS;
+}
+
+//the memory a breadth-first search needs per state: a StatePool (whole root, every other state as its differences from its parent)
+//vs whole States, on walls levels; every state is sampled from the domain's prediction, the way run_bfs_to gets them from a learner
+static int bench_state_pool(int argc, char** argv)
+{
+    std::size_t n_states = 3; //start states per level size
+    if (argc > 0) n_states = atoi(argv[0]);
+    //
+    const int sizes[] = { 10, 20, 40 };
+    const ActionId moves[] = { Action::ID_MOVE_LEFT, Action::ID_MOVE_RIGHT, Action::ID_MOVE_UP, Action::ID_MOVE_DOWN };
+    printf("%8s %10s %10s %14s %14s %14s %14s\n", "size", "objects", "states", "bytes/State", "bytes/pooled", "ns/intern", "ns/get");
+    for (int size : sizes) {
+        DomainWalls env(size, size);
+        Random random;
+        random.seed(0);
+        for (std::size_t s = 0; s < n_states; s++) {
+            State start = env.createRandomState(random);
+            StatePool pool;
+            std::size_t interns = 0;
+            INT64 time_intern = 0;
+            INT64 begin = QPC();
+            std::deque<StatePool::Id> queue{ pool.intern(start).first };
+            time_intern += QPC() - begin;
+            while (!queue.empty()) {
+                StatePool::Id id = queue.front();
+                queue.pop_front();
+                State state = pool.get(id);
+                for (ActionId action : moves) {
+                    State next = env.act(state, action, random).sample(random);
+                    begin = QPC();
+                    std::pair<StatePool::Id, bool> interned = pool.intern(next, id, state);
+                    time_intern += QPC() - begin;
+                    interns++;
+                    if (interned.second) queue.push_back(interned.first);
+                }
+            }
+            //rebuild every state once, checking the last one
+            std::size_t sink = 0;
+            begin = QPC();
+            for (StatePool::Id id = 0; id < pool.size(); id++) sink += pool.get(id).getObjects().size();
+            INT64 time_get = QPC() - begin;
+            if (sink != pool.size() * start.getObjects().size()) {
+                Logger::log("bench state_pool: a rebuilt state has the wrong objects", true);
+                return EXIT_FAILURE;
+            }
+            //
+            printf("%8d %10zu %10zu %14zu %14.1f %14.1f %14.1f\n", size, start.getObjects().size(), pool.size(),
+                StatePool::estimateMemoryUsage(start), double(pool.getMemoryUsage()) / pool.size(),
+                ns_per(time_intern, interns + 1), ns_per(time_get, pool.size()));
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+//State::diff (every value of every object) vs State::delta (only what changed), and LearnerQORA::observeTransition, which goes through the delta,
+//on random walks in walls levels of increasing size; the learner is trained on the first half of the walk and timed on the second
+static int bench_state_delta(int argc, char** argv)
+{
+    using namespace l_qora;
+    int n_observations = 1000; //random-walk observations per level size
+    if (argc > 0) n_observations = atoi(argv[0]);
+    //
+    const int sizes[] = { 8, 20, 40 };
+    printf("%8s %10s %14s %14s %14s %14s %14s %14s\n", "size", "objects", "ns/diff", "allocs/diff", "ns/delta", "allocs/delta", "ns/observe", "allocs/observe");
+    for (int size : sizes) {
+        DomainWalls env(size, size);
+        const std::vector<Action>& actions = env.getTypes().getActions();
+        Random random;
+        random.seed(0);
+        //random walks, restarted every 50 steps
+        std::deque<State> states;
+        std::vector<Transition> transitions;
+        states.push_back(env.createRandomState(random));
+        for (int i = 0; i < n_observations; i++) {
+            ActionId action = actions[random.random_int(int(actions.size()))].id;
+            State next = env.act(states.back(), action, random).sample(random);
+            transitions.push_back(Transition{ &states.back(), action, nullptr });
+            states.push_back(next);
+            transitions.back().nextState = &states.back();
+            if ((i + 1) % 50 == 0) states.push_back(env.createRandomState(random));
+        }
+        std::size_t objects = states.front().getObjects().size();
+        //
+        std::size_t sink = 0; //keep the results from being optimized out
+        INT64 begin = QPC();
+        std::size_t allocs_diff = count_allocations([&]() {
+            for (const Transition& t : transitions) sink += t.nextState->diff(*t.prevState).length();
+        });
+        INT64 time_diff = QPC() - begin;
+        begin = QPC();
+        std::size_t allocs_delta = count_allocations([&]() {
+            for (const Transition& t : transitions) sink -= t.nextState->delta(*t.prevState).length();
+        });
+        INT64 time_delta = QPC() - begin;
+        if (sink != 0) {
+            Logger::log("bench state_delta: diff and delta disagree", true);
+            return EXIT_FAILURE;
+        }
+        //
+        LearnerQORA learner(env.getTypes(), 0.05, 1, nullptr, 0, 0, env.getPositionAttribute());
+        std::size_t half = transitions.size() / 2;
+        for (std::size_t i = 0; i < half; i++) learner.observeTransition(*transitions[i].prevState, transitions[i].action, *transitions[i].nextState);
+        begin = QPC();
+        std::size_t allocs_observe = count_allocations([&]() {
+            for (std::size_t i = half; i < transitions.size(); i++) learner.observeTransition(*transitions[i].prevState, transitions[i].action, *transitions[i].nextState);
+        });
+        INT64 time_observe = QPC() - begin;
+        //
+        printf("%8d %10zu %14.1f %14.2f %14.1f %14.2f %14.1f %14.2f\n", size, objects,
+            ns_per(time_diff, transitions.size()), double(allocs_diff) / transitions.size(),
+            ns_per(time_delta, transitions.size()), double(allocs_delta) / transitions.size(),
+            ns_per(time_observe, transitions.size() - half), double(allocs_observe) / (transitions.size() - half));
+    }
+    return EXIT_SUCCESS;
+}
+
+//LearnerQORA::predictTransition (+ StateDistribution::error against the real next state) and observeTransition with and without an arena,
+//on random walks in walls and doors levels; the learners are trained on the first half of the walk and timed on the second,
+//and the arena is rewound after every transition, the way predict does it
+static int bench_arena(int argc, char** argv)
+{
+    using namespace l_qora;
+    int n_observations = 1000; //random-walk observations per domain
+    if (argc > 0) n_observations = atoi(argv[0]);
+    //
+    std::vector<std::pair<std::string, std::shared_ptr<Environment>>> domains{
+        {"walls", std::make_shared<DomainWalls>(20, 20)},
+        {"doors", std::make_shared<DomainWallsDoors>(20, 20, 4, 2)}
+    };
+    printf("%8s %8s %14s %16s %14s %16s %12s\n", "domain", "arena", "ns/predict", "allocs/predict", "ns/observe", "allocs/observe", "arena KB");
+    for (const auto& domain : domains) {
+        const Environment& env = *domain.second;
+        const std::vector<Action>& actions = env.getTypes().getActions();
+        Random random;
+        random.seed(0);
+        //random walks, restarted every 50 steps
+        std::deque<State> states;
+        std::vector<Transition> transitions;
+        states.push_back(env.createRandomState(random));
+        for (int i = 0; i < n_observations; i++) {
+            ActionId action = actions[random.random_int(int(actions.size()))].id;
+            State next = env.act(states.back(), action, random).sample(random);
+            transitions.push_back(Transition{ &states.back(), action, nullptr });
+            states.push_back(next);
+            transitions.back().nextState = &states.back();
+            if ((i + 1) % 50 == 0) states.push_back(env.createRandomState(random));
+        }
+        std::size_t half = transitions.size() / 2;
+        //one learner per run, trained the same way, since observing changes them
+        std::vector<double> errors[2];
+        for (int use_arena = 0; use_arena < 2; use_arena++) {
+            Arena arena;
+            LearnerQORA learner(env.getTypes(), 0.05, 1, nullptr, 0, 0, env.getPositionAttribute());
+            for (std::size_t i = 0; i < half; i++) learner.observeTransition(*transitions[i].prevState, transitions[i].action, *transitions[i].nextState);
+            if (use_arena) learner.setArena(&arena);
+            //
+            INT64 begin = QPC();
+            std::size_t allocs_predict = count_allocations([&]() {
+                for (std::size_t i = half; i < transitions.size(); i++) {
+                    Arena::Scope scope(learner.getArena());
+                    StateDistribution prediction = learner.predictTransition(*transitions[i].prevState, transitions[i].action, random);
+                    errors[use_arena].push_back(prediction.error(*transitions[i].nextState));
+                }
+            });
+            INT64 time_predict = QPC() - begin;
+            begin = QPC();
+            std::size_t allocs_observe = count_allocations([&]() {
+                for (std::size_t i = half; i < transitions.size(); i++) {
+                    Arena::Scope scope(learner.getArena());
+                    learner.observeTransition(*transitions[i].prevState, transitions[i].action, *transitions[i].nextState);
+                }
+            });
+            INT64 time_observe = QPC() - begin;
+            //
+            printf("%8s %8s %14.1f %16.2f %14.1f %16.2f %12.1f\n", domain.first.c_str(), use_arena ? "yes" : "no",
+                ns_per(time_predict, transitions.size() - half), double(allocs_predict) / (transitions.size() - half),
+                ns_per(time_observe, transitions.size() - half), double(allocs_observe) / (transitions.size() - half),
+                arena.getCapacity() / 1024.0);
+        }
+        if (errors[0] != errors[1]) {
+            Logger::log(Logger::formatString("bench arena: predictions differ with the arena (%s domain)", domain.first.c_str()), true);
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//registry
+////////////////////////////////////////////////////////////////////////////////
+
+const std::vector<Benchmark>& getBenchmarks()
+{
+    static const std::vector<Benchmark> benchmarks{
+        {"frequency_table", "[n=1000000]: per-observation cost of FrequencyTable as the number of occupied inputs grows", bench_frequency_table},
+        {"condition_evaluate", "[states=100] [conditions=2000]: Condition::evaluate, interpreted vs compiled vs from a PredicateCache, on the walls and doors domains", bench_condition_evaluate},
+        {"spatial_index", "[states=4] [conditions=1000]: Condition::evaluate with and without a SpatialIndex, on walls levels from 8x8 to 100x100", bench_spatial_index},
+        {"candidate_generation", "[observations=200] [states=10]: heap allocations made by candidate generation, for new vs already generated candidates, on walls levels from 8x8 to 32x32", bench_candidate_generation},
+        {"snapshot_stress", "[readers=4] [observations=2000] [publish_every=1]: one learning thread vs reader threads predicting from LearnerQORA snapshots, checked against the learner", bench_snapshot_stress},
+        {"model_format", "[observations=2000]: size and save/load time of a trained qora model, json vs the compact binary format, and the time to the first predictions after loading", bench_model_format},
+        {"frozen_predict", "[observations=2000]: prediction time of a trained qora model vs the qora_frozen model exported from it (on the heap and in an arena), and the heap allocations of the frozen lookups", bench_frozen_predict},
+        {"attribute_value", "[states=100] [reps=20]: time and heap allocations per move action, State::diff and relative Predicate::evaluate, on walls and doors levels", bench_attribute_value},
+        {"columnar", "[size=64] [states=4] [reps=20]: State vs ColumnarState (scan over the walls, diff, error, flatten) on size x size walls, doors and fish levels", bench_columnar},
+        {"state_copy", "[states=10] [reps=200]: time and heap allocations to copy a State, and to copy it and move the player, plus State ==/< on the result, on walls levels up to 50x50", bench_state_copy},
+        {"state_search", "[size=20] [starts=3]: State comparisons and container time of a full breadth-first search of a size x size walls level, std::set/map vs unordered containers keyed by State::hash", bench_state_search},
+        {"state_pool", "[starts=3]: bytes per state of a full breadth-first search kept in a StatePool vs as whole States, and the time to intern and rebuild states, on walls levels from 10x10 to 40x40", bench_state_pool},
+        {"state_delta", "[observations=1000]: time and heap allocations of State::diff vs State::delta, and of LearnerQORA::observeTransition, on random walks in walls levels from 8x8 to 40x40", bench_state_delta},
+        {"arena", "[observations=1000]: time and heap allocations of LearnerQORA::predictTransition (+ error) and observeTransition with and without a per-transition arena, on walls and doors levels", bench_arena}
+    };
+    return benchmarks;
+}
+
+int run_benchmark(const std::string& name, int argc, char** argv)
+{
+    for (const Benchmark& b : getBenchmarks()) {
+        if (b.name == name) {
+            return b.run(argc, argv);
+        }
+    }
+    Logger::log(Logger::formatString("Benchmark not found: \"%s\"", name.c_str()), true);
+    return EXIT_FAILURE;
+}
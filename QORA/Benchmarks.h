@@ -0,0 +1,15 @@
+#pragma once
+
+//microbenchmarks for the hot paths of the learners and domains
+//run with: bench <name> [args]; each benchmark prints its own timings to stdout
+
+struct Benchmark {
+	typedef std::function<int(int argc, char** argv)> Runnable;
+	//
+	std::string name;
+	std::string usage; //argument list + short description, for the usage info
+	Runnable run;
+};
+
+const std::vector<Benchmark>& getBenchmarks();
+int run_benchmark(const std::string& name, int argc, char** argv); //returns EXIT_FAILURE if the benchmark doesn't exist
@@ -0,0 +1,313 @@
+#include "pch.h"
+#include "ColumnarState.h"
+
+#include <algorithm>
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//table
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+std::size_t ColumnarState::Table::size() const
+{
+	return ids.size();
+}
+
+int ColumnarState::Table::getColumn(int attribute_id) const
+{
+	for (std::size_t i = 0; i < attributes.size(); i++) {
+		if (attributes[i] == attribute_id) return offsets[i];
+	}
+	return -1;
+}
+
+std::size_t ColumnarState::Table::getRow(int object_id) const
+{
+	auto it = std::lower_bound(ids.begin(), ids.end(), object_id);
+	if (it == ids.end() || *it != object_id) return ids.size();
+	return std::size_t(it - ids.begin());
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+//state
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+ColumnarState::ColumnarState(const Types& types) : types(&types), nextObjectId(0)
+{
+	const std::vector<ObjectType>& object_types = types.getObjectTypes();
+	tables.resize(object_types.size());
+	for (std::size_t i = 0; i < object_types.size(); i++) {
+		Table& table = tables[i];
+		const ObjectLayout& layout = types.getObjectLayout(int(i));
+		table.type = int(i);
+		table.attributes = layout.attributes;
+		int columns = 0;
+		for (int size : layout.sizes) {
+			table.offsets.push_back(columns);
+			columns += size;
+		}
+		table.offsets.push_back(columns);
+		table.columns.resize(columns);
+	}
+}
+
+ColumnarState::ColumnarState(const Types& types, const State& state) : ColumnarState(types)
+{
+	nextObjectId = state.nextObjectId;
+	//the map is in id order, so every object goes on the end of its table
+	for (const auto& pair : state.getObjects()) {
+		add(pair.second);
+	}
+}
+
+ColumnarState::Table* ColumnarState::findTable(int object_id)
+{
+	if (object_id < 0 || object_id >= int(object_types.size()) || object_types[object_id] < 0) return nullptr;
+	return &tables[object_types[object_id]];
+}
+
+const ColumnarState::Table* ColumnarState::findTable(int object_id) const
+{
+	if (object_id < 0 || object_id >= int(object_types.size()) || object_types[object_id] < 0) return nullptr;
+	return &tables[object_types[object_id]];
+}
+
+void ColumnarState::clear()
+{
+	for (Table& table : tables) {
+		table.ids.clear();
+		for (std::vector<int>& column : table.columns) column.clear();
+	}
+	object_types.clear();
+}
+
+int ColumnarState::getNextObjectId()
+{
+	return nextObjectId++;
+}
+
+void ColumnarState::add(const Object& object)
+{
+	int id = object.getObjectId();
+	remove(id); //same as State::add, which replaces
+	if (id >= int(object_types.size())) object_types.resize(id + 1, -1);
+	object_types[id] = object.getTypeId();
+	//
+	Table& table = tables.at(object.getTypeId());
+	auto it = std::lower_bound(table.ids.begin(), table.ids.end(), id);
+	std::size_t row = std::size_t(it - table.ids.begin());
+	table.ids.insert(it, id);
+	for (std::vector<int>& column : table.columns) column.insert(column.begin() + row, 0);
+	//
+	for (std::size_t i = 0; i < table.attributes.size(); i++) {
+		if (!object.hasAttribute(table.attributes[i])) continue;
+		const AttributeValue& value = object.getAttribute(table.attributes[i]);
+		int n = std::min(value.size(), table.offsets[i + 1] - table.offsets[i]);
+		for (int c = 0; c < n; c++) {
+			table.columns[table.offsets[i] + c][row] = value[c];
+		}
+	}
+}
+
+void ColumnarState::remove(int objectId)
+{
+	Table* table = findTable(objectId);
+	if (table == nullptr) return;
+	std::size_t row = table->getRow(objectId);
+	table->ids.erase(table->ids.begin() + row);
+	for (std::vector<int>& column : table->columns) column.erase(column.begin() + row);
+	object_types[objectId] = -1;
+}
+
+void ColumnarState::setAttribute(int objectId, int attribute_id, const AttributeValue& value)
+{
+	Table* table = findTable(objectId);
+	if (table == nullptr) return;
+	int column = table->getColumn(attribute_id);
+	if (column < 0) return;
+	std::size_t row = table->getRow(objectId);
+	for (int c = 0; c < value.size(); c++) {
+		table->columns[column + c][row] = value[c];
+	}
+}
+
+std::size_t ColumnarState::size() const
+{
+	std::size_t n = 0;
+	for (const Table& table : tables) n += table.size();
+	return n;
+}
+
+bool ColumnarState::hasObject(int id) const
+{
+	return findTable(id) != nullptr;
+}
+
+Object ColumnarState::getObject(int id) const
+{
+	const Table* table = findTable(id);
+	if (table == nullptr) return Object();
+	std::size_t row = table->getRow(id);
+	Object obj = types->createObject(table->type, id);
+	for (std::size_t i = 0; i < table->attributes.size(); i++) {
+		AttributeValue& value = obj.getAttribute(table->attributes[i]);
+		for (int c = 0; c < value.size(); c++) {
+			value[c] = table->columns[table->offsets[i] + c][row];
+		}
+	}
+	return obj;
+}
+
+const std::vector<ColumnarState::Table>& ColumnarState::getTables() const
+{
+	return tables;
+}
+
+const ColumnarState::Table& ColumnarState::getTable(int type) const
+{
+	return tables.at(type);
+}
+
+const std::vector<int>& ColumnarState::getObjectsOfClass(int type) const
+{
+	return tables.at(type).ids;
+}
+
+State ColumnarState::toState() const
+{
+	State state;
+	state.nextObjectId = nextObjectId;
+	for (int id = 0; id < int(object_types.size()); id++) {
+		if (object_types[id] >= 0) state.add(getObject(id));
+	}
+	return state;
+}
+
+ColumnarState ColumnarState::diff(const ColumnarState& prev) const
+{
+	ColumnarState diff(*this);
+	for (Table& table : diff.tables) {
+		const Table& prev_table = prev.tables.at(table.type);
+		if (table.ids == prev_table.ids) {
+			//the usual case, the same objects in both: one sweep per column
+			std::size_t rows = table.size();
+			for (std::size_t c = 0; c < table.columns.size(); c++) {
+				int* values = table.columns[c].data();
+				const int* prev_values = prev_table.columns[c].data();
+				for (std::size_t row = 0; row < rows; row++) {
+					values[row] -= prev_values[row];
+				}
+			}
+		}
+		else {
+			//match the rows by id; objects that aren't in prev are left as they are (State::diff requires them to be there)
+			for (std::size_t row = 0; row < table.size(); row++) {
+				std::size_t prev_row = prev_table.getRow(table.ids[row]);
+				if (prev_row == prev_table.size()) continue;
+				for (std::size_t c = 0; c < table.columns.size(); c++) {
+					table.columns[c][row] -= prev_table.columns[c][prev_row];
+				}
+			}
+		}
+	}
+	return diff;
+}
+
+int ColumnarState::length() const
+{
+	int len = 0;
+	for (const Table& table : tables) {
+		for (const std::vector<int>& column : table.columns) {
+			for (int value : column) {
+				len += abs(value);
+			}
+		}
+	}
+	return len;
+}
+
+int ColumnarState::error(const ColumnarState& other) const
+{
+	int len = 0;
+	for (const Table& table : tables) {
+		const Table& other_table = other.tables.at(table.type);
+		if (table.ids == other_table.ids) {
+			std::size_t rows = table.size();
+			for (std::size_t c = 0; c < table.columns.size(); c++) {
+				const int* values = table.columns[c].data();
+				const int* other_values = other_table.columns[c].data();
+				for (std::size_t row = 0; row < rows; row++) {
+					len += abs(values[row] - other_values[row]);
+				}
+			}
+		}
+		else {
+			for (std::size_t row = 0; row < table.size(); row++) {
+				std::size_t other_row = other_table.getRow(table.ids[row]);
+				for (std::size_t c = 0; c < table.columns.size(); c++) {
+					int other_value = (other_row == other_table.size()) ? 0 : other_table.columns[c][other_row];
+					len += abs(table.columns[c][row] - other_value);
+				}
+			}
+		}
+	}
+	return len;
+}
+
+std::pair<IntTensor, std::vector<int>> ColumnarState::flatten(int w, int h, int ATTR_POS) const
+{
+	//same layers as Types::flatten: each position-having class gets 1+n layers, where n is the total size of that class' other attributes
+	int d = 0;
+	std::vector<int> class_index(tables.size(), -1); //starting depth of each class with a position; -1 = positionless
+	for (const Table& table : tables) {
+		if (table.getColumn(ATTR_POS) < 0) continue;
+		class_index[table.type] = d;
+		d += 1 + int(table.columns.size()) - types->getAttributeType(ATTR_POS).size;
+	}
+	//
+	IntTensor grid(w, h, d);
+	std::vector<std::pair<int, const Table*>> positionless; //(object id, table) of each positionless object, since their data goes out in id order
+	for (const Table& table : tables) {
+		int pos = table.getColumn(ATTR_POS);
+		if (pos < 0) {
+			for (int id : table.ids) positionless.emplace_back(id, &table);
+			continue;
+		}
+		//the non-position columns, in order
+		std::vector<int> columns;
+		for (std::size_t i = 0; i < table.attributes.size(); i++) {
+			if (table.attributes[i] == ATTR_POS) continue;
+			for (int c = table.offsets[i]; c < table.offsets[i + 1]; c++) columns.push_back(c);
+		}
+		const int* xs = table.columns[pos].data();
+		const int* ys = table.columns[pos + 1].data();
+		int base = class_index[table.type];
+		for (std::size_t row = 0; row < table.size(); row++) {
+			int* arr = grid.block(xs[row], ys[row]);
+			arr[base] = 1;
+			for (std::size_t i = 0; i < columns.size(); i++) {
+				arr[base + 1 + i] = table.columns[columns[i]][row];
+			}
+		}
+	}
+	//
+	std::vector<int> data;
+	std::sort(positionless.begin(), positionless.end());
+	for (const auto& pair : positionless) {
+		const Table& table = *pair.second;
+		std::size_t row = table.getRow(pair.first);
+		for (const std::vector<int>& column : table.columns) {
+			data.push_back(column[row]);
+		}
+	}
+	//
+	return {grid, data};
+}
+
+bool ColumnarState::operator==(const ColumnarState& other) const
+{
+	if (tables.size() != other.tables.size()) return false;
+	for (std::size_t i = 0; i < tables.size(); i++) {
+		if (tables[i].ids != other.tables[i].ids || tables[i].columns != other.tables[i].columns) return false;
+	}
+	return true;
+}
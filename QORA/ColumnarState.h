@@ -0,0 +1,56 @@
+#pragma once
+
+#include "Environment.h"
+
+//the same data as a State, stored by columns instead of as a map of Objects:
+//the objects of each type go in one table, with their ids in one array and each component of each attribute in its own packed int array
+//(e.g. the x coordinates of every wall are one contiguous array), so scans over a type, diff, error and flatten are straight sweeps
+//it converts to and from State, so domains and learners keep working on States and only the code that needs the speed has to use this
+class ColumnarState {
+public:
+	//all objects of one type, with the attributes of that type's ObjectLayout; rows are in increasing order of object id
+	struct Table {
+		int type = -1;
+		std::vector<int> attributes; //attribute ids
+		std::vector<int> offsets; //first column of each attribute; one extra entry at the end = the number of columns
+		std::vector<int> ids; //object id of each row
+		std::vector<std::vector<int>> columns; //[column][row]
+		//
+		std::size_t size() const; //number of rows
+		int getColumn(int attribute_id) const; //first column of an attribute, or -1 if this type doesn't have it
+		std::size_t getRow(int object_id) const; //row of an object, or size() if it isn't here
+	};
+private:
+	const Types* types;
+	int nextObjectId;
+	std::vector<Table> tables; //[object type id]
+	std::vector<int> object_types; //[object id] -> object type id, or -1 if there is no such object
+	//
+	Table* findTable(int object_id); //null if there is no such object
+	const Table* findTable(int object_id) const;
+public:
+	ColumnarState(const Types& types);
+	ColumnarState(const Types& types, const State& state);
+	//
+	void clear();
+	int getNextObjectId();
+	void add(const Object& object); //the object's attributes that aren't in its type's layout are dropped, and missing ones are 0
+	void remove(int objectId);
+	void setAttribute(int objectId, int attribute_id, const AttributeValue& value);
+	//
+	std::size_t size() const; //number of objects
+	bool hasObject(int id) const;
+	Object getObject(int id) const;
+	const std::vector<Table>& getTables() const; //one per object type, in order of type id
+	const Table& getTable(int type) const;
+	const std::vector<int>& getObjectsOfClass(int type) const; //ids, in increasing order
+	//
+	State toState() const;
+	//same as the State versions
+	ColumnarState diff(const ColumnarState& prev) const;
+	int length() const;
+	int error(const ColumnarState& other) const; //without building the diff
+	std::pair<IntTensor, std::vector<int>> flatten(int w, int h, int ATTR_POS) const; //same output as Types::flatten
+	//
+	bool operator==(const ColumnarState& other) const;
+};
@@ -12,10 +12,10 @@ DomainTest::DomainTest() : Environment(2, 2)
 	ATTR_COUNT = types.addAttributeType("count", 1);
 	//
 	CLASS_PLAYER = types.addObjectType("player");
-	types.getObjectType(CLASS_PLAYER).attribute_types.insert(ATTR_POS);
-	types.getObjectType(CLASS_PLAYER).attribute_types.insert(ATTR_COUNT);
+	types.addObjectAttribute(CLASS_PLAYER, ATTR_POS);
+	types.addObjectAttribute(CLASS_PLAYER, ATTR_COUNT);
 	CLASS_WALL = types.addObjectType("wall");
-	types.getObjectType(CLASS_WALL).attribute_types.insert(ATTR_POS);
+	types.addObjectAttribute(CLASS_WALL, ATTR_POS);
 }
 
 State DomainTest::createRandomState(Random& random) const
@@ -36,7 +36,7 @@ StateDistribution DomainTest::act(const State& current, ActionId action, Random&
 {
 	State state = current;
 	//
-	Object* const ptr = *state.getObjectsOfClass(CLASS_PLAYER).begin();
+	Object* const ptr = state.findObjectOfClass(CLASS_PLAYER);
 	Object& player = *ptr;
 	//
 	if (action == ACTION_UP) {
@@ -50,7 +50,7 @@ StateDistribution DomainTest::act(const State& current, ActionId action, Random&
 
 void DomainTest::print(const State& state) const
 {
-	const Object* const ptr = *state.getObjectsOfClass(CLASS_PLAYER).begin();
+	const Object* const ptr = state.findObjectOfClass(CLASS_PLAYER);
 	const Object& player = *ptr;
 
 	printf("%c \n P\nCount: %d\n", 219, player.getAttribute(ATTR_COUNT)[0]);
@@ -59,7 +59,7 @@ void DomainTest::print(const State& state) const
 State DomainWalls::act_move(const State& current, AttributeValue direction) const
 {
 	State new_state = current;
-	Object* const ptr = *new_state.getObjectsOfClass(CLASS_PLAYER).begin();
+	Object* const ptr = new_state.findObjectOfClass(CLASS_PLAYER);
 	Object& player = *ptr;
 	//
 	AttributeValue player_pos = player.getAttribute(ATTR_POS);
@@ -80,9 +80,9 @@ DomainWalls::DomainWalls(int width, int height) : Environment(width, height)
 	//
 	ATTR_POS = types.addAttributeType("position", 2);
 	CLASS_PLAYER = types.addObjectType("player");
-	types.getObjectType(CLASS_PLAYER).attribute_types.insert(ATTR_POS);
+	types.addObjectAttribute(CLASS_PLAYER, ATTR_POS);
 	CLASS_WALL = types.addObjectType("wall");
-	types.getObjectType(CLASS_WALL).attribute_types.insert(ATTR_POS);
+	types.addObjectAttribute(CLASS_WALL, ATTR_POS);
 }
 
 State DomainWalls::createRandomState(Random& random) const
@@ -180,9 +180,9 @@ DomainFish::DomainFish(int width, int height, int n_fish) : Environment(width, h
 	//
 	ATTR_POS = types.addAttributeType("position", 2);
 	CLASS_FISH = types.addObjectType("fish");
-	types.getObjectType(CLASS_FISH).attribute_types.insert(ATTR_POS);
+	types.addObjectAttribute(CLASS_FISH, ATTR_POS);
 	CLASS_WALL = types.addObjectType("wall");
-	types.getObjectType(CLASS_WALL).attribute_types.insert(ATTR_POS);
+	types.addObjectAttribute(CLASS_WALL, ATTR_POS);
 }
 
 State DomainFish::createRandomState(Random& random) const
@@ -294,12 +294,12 @@ void DomainFish::print(const State& state) const
 State DomainWallsDoors::act_move(const State& current, AttributeValue direction) const
 {
 	State new_state = current;
-	Object* const ptr = *new_state.getObjectsOfClass(CLASS_PLAYER).begin();
+	Object* const ptr = new_state.findObjectOfClass(CLASS_PLAYER);
 	Object& player = *ptr;
 	//
 	AttributeValue player_pos = player.getAttribute(ATTR_POS);
 	AttributeValue target_pos = player_pos + direction;
-	for (const auto& pair : new_state.getObjects()) {
+	for (const auto& pair : current.getObjects()) {
 		const Object& obj = pair.second;
 		if (!obj.hasAttribute(ATTR_POS)) continue;
 		AttributeValue pos = obj.getAttribute(ATTR_POS);
@@ -328,13 +328,13 @@ DomainWallsDoors::DomainWallsDoors(int width, int height, int n_doors, int n_col
 	ATTR_POS = types.addAttributeType("position", 2);
 	ATTR_COLOR = types.addAttributeType("color", 1);
 	CLASS_PLAYER = types.addObjectType("player");
-	types.getObjectType(CLASS_PLAYER).attribute_types.insert(ATTR_POS);
-	types.getObjectType(CLASS_PLAYER).attribute_types.insert(ATTR_COLOR);
+	types.addObjectAttribute(CLASS_PLAYER, ATTR_POS);
+	types.addObjectAttribute(CLASS_PLAYER, ATTR_COLOR);
 	CLASS_WALL = types.addObjectType("wall");
-	types.getObjectType(CLASS_WALL).attribute_types.insert(ATTR_POS);
+	types.addObjectAttribute(CLASS_WALL, ATTR_POS);
 	CLASS_DOOR = types.addObjectType("door");
-	types.getObjectType(CLASS_DOOR).attribute_types.insert(ATTR_POS);
-	types.getObjectType(CLASS_DOOR).attribute_types.insert(ATTR_COLOR);
+	types.addObjectAttribute(CLASS_DOOR, ATTR_POS);
+	types.addObjectAttribute(CLASS_DOOR, ATTR_COLOR);
 }
 
 State DomainWallsDoors::createRandomState(Random& random) const
@@ -409,7 +409,7 @@ StateDistribution DomainWallsDoors::act(const State& current, ActionId action, R
 		break;
 	}
 	if (action == ACTION_CHANGE_COLOR) {
-		const Object* const ptr = *current.getObjectsOfClass(CLASS_PLAYER).begin();
+		const Object* const ptr = current.findObjectOfClass(CLASS_PLAYER);
 		const Object& player = *ptr;
 		AttributeValue player_pos = player.getAttribute(ATTR_POS);
 		//change color if there is no door under the player
@@ -481,10 +481,10 @@ DomainLights::DomainLights(int min_lights, int max_lights) : Environment(1, 1),
 	ATTR_ON = types.addAttributeType("on", 1);
 	//
 	CLASS_SWITCH = types.addObjectType("switch");
-	types.getObjectType(CLASS_SWITCH).attribute_types.insert(ATTR_ID);
+	types.addObjectAttribute(CLASS_SWITCH, ATTR_ID);
 	CLASS_LIGHT = types.addObjectType("light");
-	types.getObjectType(CLASS_LIGHT).attribute_types.insert(ATTR_ID);
-	types.getObjectType(CLASS_LIGHT).attribute_types.insert(ATTR_ON);
+	types.addObjectAttribute(CLASS_LIGHT, ATTR_ID);
+	types.addObjectAttribute(CLASS_LIGHT, ATTR_ON);
 }
 
 State DomainLights::createRandomState(Random& random) const
@@ -523,7 +523,7 @@ StateDistribution DomainLights::act(const State& current, ActionId action, Rando
 	}
 	State next = current;
 	//find the switch
-	Object& the_switch = **(next.getObjectsOfClass(CLASS_SWITCH).begin());
+	Object& the_switch = *next.findObjectOfClass(CLASS_SWITCH);
 	//
 	if (action == ACTION_INCR) {
 		the_switch.getAttribute(ATTR_ID)[0]++;
@@ -547,7 +547,7 @@ StateDistribution DomainLights::act(const State& current, ActionId action, Rando
 
 void DomainLights::print(const State& state) const
 {
-	const Object& the_switch = **(state.getObjectsOfClass(CLASS_SWITCH).begin());
+	const Object& the_switch = *state.findObjectOfClass(CLASS_SWITCH);
 	int id = the_switch.getAttribute(ATTR_ID)[0];
 	//
 	printf("Switch: %d\n", id);
@@ -578,7 +578,7 @@ void DomainLights::print(const State& state) const
 State DomainPaths::act_move(const State& current, AttributeValue direction) const
 {
 	State new_state = current;
-	Object* const ptr = *new_state.getObjectsOfClass(CLASS_PLAYER).begin();
+	Object* const ptr = new_state.findObjectOfClass(CLASS_PLAYER);
 	Object& player = *ptr;
 	//
 	AttributeValue player_pos = player.getAttribute(ATTR_POS);
@@ -609,9 +609,9 @@ DomainPaths::DomainPaths(int n, int b, int a_) : Environment(1, 1), n(n), b(b),
 	//
 	ATTR_POS = types.addAttributeType("position", n);
 	CLASS_PLAYER = types.addObjectType("player");
-	types.getObjectType(CLASS_PLAYER).attribute_types.insert(ATTR_POS);
+	types.addObjectAttribute(CLASS_PLAYER, ATTR_POS);
 	CLASS_PATH = types.addObjectType("path");
-	types.getObjectType(CLASS_PATH).attribute_types.insert(ATTR_POS);
+	types.addObjectAttribute(CLASS_PATH, ATTR_POS);
 }
 
 State DomainPaths::createRandomState(Random& random) const
@@ -693,7 +693,7 @@ StateDistribution DomainEnigma::act(const State& current, ActionId action, Rando
 {
 	State next = current;
 	//
-	Object& player = **next.getObjectsOfClass(CLASS_PLAYER).begin();
+	Object& player = *next.findObjectOfClass(CLASS_PLAYER);
 	//
 	if (action == ACTION_UP) {
 		int& y = player.getAttribute(ATTR_Y).get(0);
@@ -716,14 +716,14 @@ StateDistribution DomainEnigma::act(const State& current, ActionId action, Rando
 
 void DomainEnigma::print(const State& state) const
 {
-	const Object& player = **state.getObjectsOfClass(CLASS_PLAYER).begin();
+	const Object& player = *state.findObjectOfClass(CLASS_PLAYER);
 	printf("Player: (%d, %d) secret: %d\n", player.getAttribute(ATTR_X).get(0), player.getAttribute(ATTR_Y).get(0), player.getAttribute(ATTR_SECRET).get(0));
 }
 
 State DomainEnigma::hideInformation(const State& state) const
 {
 	State next = state;
-	Object& player = **next.getObjectsOfClass(CLASS_PLAYER).begin();
+	Object& player = *next.findObjectOfClass(CLASS_PLAYER);
 	player.getAttribute(ATTR_SECRET).set(0, 0); //set secret to 0 to hide it
 	return next;
 }
@@ -731,15 +731,16 @@ State DomainEnigma::hideInformation(const State& state) const
 void DomainComplex::act_switches(State& next) const
 {
 	if (has_switches) {
-		Object* const ptr = *next.getObjectsOfClass(CLASS_PLAYER).begin();
+		Object* const ptr = next.findObjectOfClass(CLASS_PLAYER);
 		Object& player = *ptr;
 		AttributeValue player_pos = player.getAttribute(ATTR_POS);
 		//
-		for (auto& pair : next.getObjects()) {
-			Object& obj = pair.second;
+		const State& current = next; //search without copying any shared objects; only the switch is changed
+		for (const auto& pair : current.getObjects()) {
+			const Object& obj = pair.second;
 			if (obj.getTypeId() == CLASS_SWITCH && obj.getAttribute(ATTR_POS) == player_pos) {
 				//switch is under player
-				int& i = obj.getAttribute(ATTR_ON).get(0);
+				int& i = next.getObject(pair.first).getAttribute(ATTR_ON).get(0);
 				i = (1 - i);
 				//can't have more than one switch in a single position
 				break;
@@ -754,13 +755,13 @@ State DomainComplex::act_player(const State& current, const AttributeValue& delt
 	//check if switch must be toggled
 	act_switches(new_state);
 	//
-	Object* const ptr = *new_state.getObjectsOfClass(CLASS_PLAYER).begin();
+	Object* const ptr = new_state.findObjectOfClass(CLASS_PLAYER);
 	Object& player = *ptr;
 	AttributeValue player_pos = player.getAttribute(ATTR_POS);
 	AttributeValue target_pos = player_pos + delta;
 	//check if guard is adjacent to player
 	//or if wall/gate is blocking player
-	for (const auto& pair : new_state.getObjects()) {
+	for (const auto& pair : current.getObjects()) {
 		const Object& obj = pair.second;
 		//if (obj.getTypeId() == CLASS_GUARD && (obj.getAttribute(ATTR_POS) - player_pos).length() == 1) {
 		//	//guard is adjacent to player
@@ -786,13 +787,13 @@ State DomainComplex::act_guard(const State& current, const AttributeValue& delta
 	//check if switch must be toggled
 	act_switches(new_state);
 	//
-	Object* const ptr = *new_state.getObjectsOfClass(CLASS_GUARD).begin();
+	Object* const ptr = new_state.findObjectOfClass(CLASS_GUARD);
 	Object& guard = *ptr;
 	AttributeValue guard_pos = guard.getAttribute(ATTR_POS);
 	AttributeValue target_pos = guard_pos + delta;
 	//check if guard is adjacent to player
 	//or if wall/gate is blocking player
-	for (const auto& pair : new_state.getObjects()) {
+	for (const auto& pair : current.getObjects()) {
 		const Object& obj = pair.second;
 		if (obj.getTypeId() == CLASS_WALL || obj.getTypeId() == CLASS_PLAYER) {
 			const AttributeValue& pos = obj.getAttribute(ATTR_POS);
@@ -814,7 +815,7 @@ State DomainComplex::act_jump(const State& current, const AttributeValue& delta)
 	//check if switch must be toggled
 	act_switches(new_state);
 	//
-	Object* const ptr = *new_state.getObjectsOfClass(CLASS_PLAYER).begin();
+	Object* const ptr = new_state.findObjectOfClass(CLASS_PLAYER);
 	Object& player = *ptr;
 	AttributeValue player_pos = player.getAttribute(ATTR_POS);
 	AttributeValue mid_pos = player_pos + delta;
@@ -822,7 +823,7 @@ State DomainComplex::act_jump(const State& current, const AttributeValue& delta)
 	//check if wall is blocking player (mid_pos or target_pos)
 	//and make sure there is a gate at mid_pos (and not at target_pos)
 	bool is_gate_present = false;
-	for (const auto& pair : new_state.getObjects()) {
+	for (const auto& pair : current.getObjects()) {
 		const Object& obj = pair.second;
 		if (!obj.hasAttribute(ATTR_POS)) continue;
 		//
@@ -884,21 +885,21 @@ DomainComplex::DomainComplex(int width, int height, int mode) :
 	if(has_switches) ATTR_ON = types.addAttributeType("on", 1);
 	//
 	CLASS_PLAYER = types.addObjectType("player");
-	types.getObjectType(CLASS_PLAYER).attribute_types.insert(ATTR_POS);
+	types.addObjectAttribute(CLASS_PLAYER, ATTR_POS);
 	CLASS_WALL = types.addObjectType("wall");
-	types.getObjectType(CLASS_WALL).attribute_types.insert(ATTR_POS);
+	types.addObjectAttribute(CLASS_WALL, ATTR_POS);
 	if (has_gates) {
 		CLASS_GATE = types.addObjectType("gate");
-		types.getObjectType(CLASS_GATE).attribute_types.insert(ATTR_POS);
+		types.addObjectAttribute(CLASS_GATE, ATTR_POS);
 	}
 	if (has_guard) {
 		CLASS_GUARD = types.addObjectType("guard");
-		types.getObjectType(CLASS_GUARD).attribute_types.insert(ATTR_POS);
+		types.addObjectAttribute(CLASS_GUARD, ATTR_POS);
 	}
 	if (has_switches) {
 		CLASS_SWITCH = types.addObjectType("switch");
-		types.getObjectType(CLASS_SWITCH).attribute_types.insert(ATTR_POS);
-		types.getObjectType(CLASS_SWITCH).attribute_types.insert(ATTR_ON);
+		types.addObjectAttribute(CLASS_SWITCH, ATTR_POS);
+		types.addObjectAttribute(CLASS_SWITCH, ATTR_ON);
 	}
 
 }
@@ -1073,12 +1074,12 @@ void DomainComplex::print(const State& state) const
 State DomainPlayers::act_move(const State& current, int player_class, AttributeValue direction) const
 {
 	State new_state = current;
-	Object* const ptr = *new_state.getObjectsOfClass(player_class).begin();
+	Object* const ptr = new_state.findObjectOfClass(player_class);
 	Object& player = *ptr;
 	//
 	AttributeValue player_pos = player.getAttribute(ATTR_POS);
 	AttributeValue target_pos = player_pos + direction;
-	for (auto& pair : new_state.getObjects()) {
+	for (const auto& pair : current.getObjects()) {
 		const Object& o = pair.second;
 		if (o.getTypeId() == CLASS_WALL && o.getAttribute(ATTR_POS) == target_pos) {
 			return new_state; //can't move
@@ -1103,7 +1104,7 @@ DomainPlayers::DomainPlayers(int width, int height, int n_players) : Environment
 	ATTR_POS = types.addAttributeType("position", 2);
 	//
 	CLASS_WALL = types.addObjectType("wall");
-	types.getObjectType(CLASS_WALL).attribute_types.insert(ATTR_POS);
+	types.addObjectAttribute(CLASS_WALL, ATTR_POS);
 	//
 	std::pair<AttributeValue, std::string> dirs[] = {
 		{AttributeValue::UP, "UP"},
@@ -1115,7 +1116,7 @@ DomainPlayers::DomainPlayers(int width, int height, int n_players) : Environment
 	for (int i = 0; i < n_players; i++) {
 		std::string name = "P" + std::to_string(i + 1);
 		int class_player = types.addObjectType(name);
-		types.getObjectType(class_player).attribute_types.insert(ATTR_POS);
+		types.addObjectAttribute(class_player, ATTR_POS);
 		//
 		player_classes.push_back(class_player);
 		class_to_char[class_player] = 'A' + i;
@@ -1213,12 +1214,12 @@ void DomainPlayers::print(const State& state) const
 State DomainMoves::act_move(const State& current, AttributeValue direction) const
 {
 	State new_state = current;
-	Object* const ptr = *new_state.getObjectsOfClass(CLASS_PLAYER).begin();
+	Object* const ptr = new_state.findObjectOfClass(CLASS_PLAYER);
 	Object& player = *ptr;
 	//
 	AttributeValue player_pos = player.getAttribute(ATTR_POS);
 	AttributeValue target_pos = player_pos + direction;
-	for (auto& pair : new_state.getObjects()) {
+	for (const auto& pair : current.getObjects()) {
 		const Object& o = pair.second;
 		if (o.getTypeId() == CLASS_WALL && o.getAttribute(ATTR_POS) == target_pos) {
 			return new_state; //can't move
@@ -1241,9 +1242,9 @@ DomainMoves::DomainMoves(int width, int height, int n_copies) : Environment(widt
 	ATTR_POS = types.addAttributeType("position", 2);
 	//
 	CLASS_PLAYER = types.addObjectType("player");
-	types.getObjectType(CLASS_PLAYER).attribute_types.insert(ATTR_POS);
+	types.addObjectAttribute(CLASS_PLAYER, ATTR_POS);
 	CLASS_WALL = types.addObjectType("wall");
-	types.getObjectType(CLASS_WALL).attribute_types.insert(ATTR_POS);
+	types.addObjectAttribute(CLASS_WALL, ATTR_POS);
 	//
 	std::pair<AttributeValue, std::string> dirs[] = {
 		{AttributeValue::UP, "UP"},
@@ -1,6 +1,8 @@
 #include "pch.h"
 #include "Environment.h"
 
+#include <algorithm>
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 //actions
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -87,36 +89,84 @@ const AttributeValue AttributeValue::LEFT{-1, 0};
 const AttributeValue AttributeValue::RIGHT{1, 0};
 const std::vector<AttributeValue> AttributeValue::DEFAULT_NEIGHBORS{ AttributeValue::UP, AttributeValue::DOWN, AttributeValue::LEFT, AttributeValue::RIGHT };
 
-AttributeValue::AttributeValue(int sz) : sz(sz), data(new int[sz])
+constexpr int AttributeValue::INLINE_SIZE;
+
+void AttributeValue::allocate(int sz)
+{
+    this->sz = sz;
+    data = (sz <= INLINE_SIZE) ? inline_data : new int[sz];
+}
+
+bool AttributeValue::isInline() const
 {
+    return data == inline_data;
+}
+
+AttributeValue::AttributeValue(int sz)
+{
+    allocate(sz);
     if (sz > 0) memset(data, 0, sz * sizeof(*data));
 }
 
-AttributeValue::AttributeValue(std::initializer_list<int> values) : sz(values.size()), data(new int[sz])
+AttributeValue::AttributeValue(std::initializer_list<int> values)
 {
+    allocate(int(values.size()));
     int index = 0;
     for (int i : values) data[index++] = i;
 }
 
 AttributeValue::AttributeValue(const AttributeValue& other)
 {
-    sz = other.sz;
-    data = new int[sz];
+    allocate(other.sz);
     memcpy(data, other.data, sz * sizeof(*data));
 }
 
+AttributeValue::AttributeValue(AttributeValue&& other) noexcept
+{
+    if (other.isInline()) {
+        allocate(other.sz);
+        memcpy(data, other.data, sz * sizeof(*data));
+    }
+    else {
+        //take the heap storage
+        sz = other.sz;
+        data = other.data;
+    }
+    other.sz = 0;
+    other.data = other.inline_data;
+}
+
 AttributeValue& AttributeValue::operator=(const AttributeValue& other)
 {
-    delete[] data;
-    sz = other.sz;
-    data = new int[sz];
+    if (this == &other) return *this;
+    //the storage can be reused as long as it's the right size (always, for inline values)
+    if (sz != other.sz) {
+        if (!isInline()) delete[] data;
+        allocate(other.sz);
+    }
     memcpy(data, other.data, sz * sizeof(*data));
     return *this;
 }
 
+AttributeValue& AttributeValue::operator=(AttributeValue&& other) noexcept
+{
+    if (this == &other) return *this;
+    if (other.isInline()) {
+        *this = static_cast<const AttributeValue&>(other);
+    }
+    else {
+        if (!isInline()) delete[] data;
+        sz = other.sz;
+        data = other.data;
+    }
+    other.sz = 0;
+    other.data = other.inline_data;
+    return *this;
+}
+
 AttributeValue::~AttributeValue()
 {
-    delete[] data;
+    if (!isInline()) delete[] data;
 }
 
 int AttributeValue::size() const
@@ -245,6 +295,11 @@ std::string AttributeValue::to_string() const
     return s + ')';
 }
 
+std::size_t AttributeValue::getHeapUsage() const
+{
+    return isInline() ? 0 : sz * sizeof(*data);
+}
+
 void to_json(json& j, const AttributeValue& p)
 {
     j = json();
@@ -264,27 +319,29 @@ void from_json(const json& j, AttributeValue& p)
 
 ProbabilityDistribution<Object> Object::combine(const ProbabilityDistribution<Object>& obj_base, int attribute_id, const AttributeValue& attribute_value)
 {
-    ProbabilityDistribution<Object> obj;
+    Arena* arena = obj_base.getArena();
+    ProbabilityDistribution<Object> obj(arena);
     for (const auto& pair : obj_base.getProbabilities()) {
-        Object o = pair.first;
+        Object o(pair.first, arena);
         o.setAttribute(attribute_id, attribute_value);
-        obj.setProbability(o, pair.second);
+        obj.setProbability(std::move(o), pair.second);
     }
     return obj;
 }
 
 ProbabilityDistribution<Object> Object::combine(const ProbabilityDistribution<Object>& obj_base, int attribute_id, const ProbabilityDistribution<AttributeValue>& attribute_values)
 {
-    ProbabilityDistribution<Object> obj;
+    Arena* arena = obj_base.getArena();
+    ProbabilityDistribution<Object> obj(arena);
     for (const auto& pair : obj_base.getProbabilities()) {
         double p_obj = pair.second;
         for (const auto& pair2 : attribute_values.getProbabilities()) {
             double p_attr = pair2.second;
             //new copy of object
-            Object o = pair.first;
+            Object o(pair.first, arena);
             //
             o.setAttribute(attribute_id, pair2.first);
-            obj.setProbability(o, p_obj * p_attr);
+            obj.setProbability(std::move(o), p_obj * p_attr);
         }
     }
     return obj;
@@ -294,6 +351,36 @@ Object::Object(int type_id, int object_id) : type(type_id), id(object_id)
 {
 }
 
+Object::Object(int type_id, int object_id, const ObjectLayout& layout) : type(type_id), id(object_id)
+{
+    attributes.reserve(layout.attributes.size());
+    for (std::size_t i = 0; i < layout.attributes.size(); i++) {
+        attributes.emplace_back(layout.attributes[i], AttributeValue(layout.sizes[i]));
+    }
+}
+
+Object::Object(int type_id, int object_id, Arena* arena) : type(type_id), id(object_id), attributes(ArenaAllocator<std::pair<int, AttributeValue>>(arena))
+{
+}
+
+Object::Object(const Object& other, Arena* arena) : type(other.type), id(other.id), attributes(other.attributes, ArenaAllocator<std::pair<int, AttributeValue>>(arena))
+{
+}
+
+Object::Attributes::iterator Object::find(int id)
+{
+    auto it = attributes.begin();
+    while (it != attributes.end() && it->first < id) it++;
+    return it;
+}
+
+Object::Attributes::const_iterator Object::find(int id) const
+{
+    auto it = attributes.begin();
+    while (it != attributes.end() && it->first < id) it++;
+    return it;
+}
+
 int Object::getTypeId() const
 {
     return type;
@@ -306,37 +393,46 @@ int Object::getObjectId() const
 
 AttributeValue& Object::addAttribute(int id, int size)
 {
-    return attributes[id] = AttributeValue(size);
+    return getAttribute(id) = AttributeValue(size);
 }
 
 AttributeValue& Object::getAttribute(int id)
 {
-    return attributes[id];
+    auto it = find(id);
+    if (it == attributes.end() || it->first != id) {
+        it = attributes.emplace(it, id, AttributeValue());
+    }
+    return it->second;
 }
 
 const AttributeValue& Object::getAttribute(int id) const
 {
-    return attributes.at(id);
+    auto it = find(id);
+    if (it == attributes.end() || it->first != id) {
+        throw std::out_of_range("Object::getAttribute: no such attribute");
+    }
+    return it->second;
 }
 
 void Object::setAttribute(int id, const AttributeValue& value)
 {
-    attributes[id] = value;
+    getAttribute(id) = value;
 }
 
-std::map<int, AttributeValue>& Object::getAttributes()
+Object::Attributes& Object::getAttributes()
 {
     return attributes;
 }
 
-const std::map<int, AttributeValue>& Object::getAttributes() const
+const Object::Attributes& Object::getAttributes() const
 {
     return attributes;
 }
 
 bool Object::hasAttribute(int id) const
 {
-    return attributes.find(id) != attributes.end();
+    auto it = find(id);
+    return it != attributes.end() && it->first == id;
 }
 
 bool Object::operator<(const Object& b) const
@@ -359,23 +455,94 @@ int Object::distance(const Object& other) const
 {
     int sum = 0;
     //
-    const std::map<int, AttributeValue>& other_attributes = other.attributes;
     for (const auto& pair : attributes) {
         const AttributeValue& v1 = pair.second;
-        const AttributeValue& v2 = other_attributes.at(pair.first);
+        const AttributeValue& v2 = other.getAttribute(pair.first);
         //
         sum += (v1 - v2).length();
     }
     return sum;
 }
 
-State::State() : nextObjectId(0)
+constexpr int State::CHUNK_SIZE;
+
+State::Chunk::Chunk() : count(0), hash(0)
 {
+    for (auto& slot : slots) slot.first = -1;
+}
+
+State::Chunk::Chunk(const Chunk& other) : count(other.count), hash(other.hash.load(std::memory_order_relaxed))
+{
+    std::copy(std::begin(other.slots), std::end(other.slots), std::begin(slots));
+}
+
+//splitmix64 finalizer
+static inline std::uint64_t mix_hash(std::uint64_t x)
+{
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+std::uint64_t State::Chunk::getHash() const
+{
+    //a chunk is only ever changed by the one State that owns it, so threads sharing it can only race to store the same value
+    std::uint64_t h = hash.load(std::memory_order_relaxed);
+    if (h != 0) return h;
+    for (const auto& slot : slots) {
+        if (slot.first < 0) continue;
+        const Object& obj = slot.second;
+        std::uint64_t object_key = mix_hash((std::uint64_t(std::uint32_t(slot.first)) << 32) | std::uint32_t(obj.getTypeId()));
+        h ^= object_key;
+        for (const auto& pair : obj.getAttributes()) {
+            const AttributeValue& value = pair.second;
+            for (int i = 0; i < value.size(); i++) {
+                std::uint64_t feature = (std::uint64_t(std::uint32_t(pair.first)) << 48) ^ (std::uint64_t(std::uint32_t(i)) << 32) ^ std::uint32_t(value[i]);
+                h ^= mix_hash(object_key ^ mix_hash(feature));
+            }
+        }
+    }
+    if (h == 0) h = 1; //0 means "not worked out"
+    hash.store(h, std::memory_order_relaxed);
+    return h;
+}
+
+State::State() : nextObjectId(0), count(0)
+{
+}
+
+State::State(const State& other) : nextObjectId(other.nextObjectId), chunks(other.chunks), count(other.count), objects_by_type(std::atomic_load(&other.objects_by_type))
+{
+}
+
+State& State::operator=(const State& other)
+{
+    nextObjectId = other.nextObjectId;
+    chunks = other.chunks;
+    count = other.count;
+    objects_by_type = std::atomic_load(&other.objects_by_type);
+    return *this;
+}
+
+State::Chunk& State::detach(std::size_t chunk)
+{
+    std::shared_ptr<Chunk>& ptr = chunks[chunk];
+    if (!ptr) {
+        ptr = std::make_shared<Chunk>();
+    }
+    else if (ptr.use_count() > 1) {
+        ptr = std::make_shared<Chunk>(*ptr);
+    }
+    ptr->hash.store(0, std::memory_order_relaxed); //about to be changed
+    objects_by_type.reset();
+    return *ptr;
 }
 
 void State::clear()
 {
-    objects.clear();
+    chunks.clear();
+    objects_by_type.reset();
+    count = 0;
     nextObjectId = 0;
 }
 
@@ -386,90 +553,156 @@ int State::getNextObjectId()
 
 Object& State::add(const Object& object)
 {
-    return objects[object.getObjectId()] = object;
+    int id = object.getObjectId();
+    assert(id >= 0);
+    std::size_t index = std::size_t(id / CHUNK_SIZE);
+    if (index >= chunks.size()) chunks.resize(index + 1);
+    Chunk& chunk = detach(index);
+    std::pair<int, Object>& slot = chunk.slots[id % CHUNK_SIZE];
+    if (slot.first < 0) {
+        chunk.count++;
+        count++;
+    }
+    slot.first = id;
+    slot.second = object;
+    return slot.second;
 }
 
 void State::remove(int objectId)
 {
-    objects.erase(objectId);
+    if (findObject(objectId) == nullptr) return;
+    std::size_t index = std::size_t(objectId / CHUNK_SIZE);
+    Chunk& chunk = detach(index);
+    chunk.slots[objectId % CHUNK_SIZE] = { -1, Object() };
+    count--;
+    if (--chunk.count == 0) chunks[index].reset();
 }
 
-std::map<int, Object>& State::getObjects()
+State::ObjectRange<std::pair<int, Object>> State::getObjects()
 {
-    return objects;
+    for (std::size_t i = 0; i < chunks.size(); i++) {
+        if (chunks[i]) detach(i);
+    }
+    return ObjectRange<std::pair<int, Object>>(chunks, count);
 }
 
-const std::map<int, Object>& State::getObjects() const
+State::ObjectRange<const std::pair<int, Object>> State::getObjects() const
 {
-    return objects;
+    return ObjectRange<const std::pair<int, Object>>(chunks, count);
 }
 
 Object& State::getObject(int id)
 {
-    return objects.at(id);
+    if (findObject(id) == nullptr) throw std::out_of_range("State::getObject: no such object");
+    return detach(std::size_t(id / CHUNK_SIZE)).slots[id % CHUNK_SIZE].second;
 }
 
 const Object& State::getObject(int id) const
 {
-    return objects.at(id);
+    const Object* obj = findObject(id);
+    if (obj == nullptr) throw std::out_of_range("State::getObject: no such object");
+    return *obj;
 }
 
-std::set<Object*> State::getObjectsOfClass(int type)
+const Object* State::findObject(int id) const
 {
-    std::set<Object*> objs;
-    for (auto& pair : objects) {
-        Object& obj = pair.second;
-        if (obj.getTypeId() == type) objs.insert(&obj);
-    }
-    return objs;
+    if (id < 0 || std::size_t(id / CHUNK_SIZE) >= chunks.size()) return nullptr;
+    const std::shared_ptr<Chunk>& chunk = chunks[id / CHUNK_SIZE];
+    if (!chunk || chunk->slots[id % CHUNK_SIZE].first < 0) return nullptr;
+    return &chunk->slots[id % CHUNK_SIZE].second;
 }
 
-std::set<const Object*> State::getObjectsOfClass(int type) const
+ObjectSpan State::getObjectsOfClass(int type) const
 {
-    std::set<const Object*> objs;
-    for (auto& pair : objects) {
-        const Object& obj = pair.second;
-        if (obj.getTypeId() == type) objs.insert(&obj);
+    return getObjectsByType().at(type);
+}
+
+Object* State::findObjectOfClass(int type)
+{
+    //changing the object throws the index away, so only use it if it's already there
+    const Object* found = nullptr;
+    std::shared_ptr<const ObjectsByType> current = std::atomic_load(&objects_by_type);
+    if (current) {
+        ObjectSpan objs = current->at(type);
+        if (!objs.empty()) found = objs[0];
+    }
+    else {
+        for (const auto& pair : static_cast<const State&>(*this).getObjects()) {
+            if (pair.second.getTypeId() == type) {
+                found = &pair.second;
+                break;
+            }
+        }
     }
-    return objs;
+    if (found == nullptr) return nullptr;
+    return &getObject(found->getObjectId());
 }
 
-std::map<int, std::set<const Object*>> State::getObjectsByType() const
+const Object* State::findObjectOfClass(int type) const
 {
-    std::map<int, std::set<const Object*>> objects_by_type;
-    for (auto& obj_pair : objects) {
-        int object_id = obj_pair.first;
-        const Object* obj = &obj_pair.second;
-        int type_id = obj->getTypeId();
-        objects_by_type[type_id].insert(obj);
+    ObjectSpan objs = getObjectsOfClass(type);
+    return objs.empty() ? nullptr : objs[0];
+}
+
+const ObjectsByType& State::getObjectsByType() const
+{
+    //threads sharing a State can race to build it, but only the first one is kept, so a returned reference stays valid
+    std::shared_ptr<const ObjectsByType> current = std::atomic_load(&objects_by_type);
+    if (!current) {
+        std::shared_ptr<const ObjectsByType> built = std::make_shared<ObjectsByType>(*this);
+        if (std::atomic_compare_exchange_strong(&objects_by_type, &current, built)) current = built;
     }
-    return objects_by_type;
+    return *current;
 }
 
 State State::diff(const State& prev) const
 {
     State diff;
     diff.nextObjectId = nextObjectId;
-    for (const auto& pair : objects) {
+    for (const auto& pair : getObjects()) {
         int id = pair.first;
         const Object& obj = pair.second;
-        const Object& prevObj = prev.objects.at(id); //this will crash if it's not there :^) hehehe
+        const Object& prevObj = prev.getObject(id); //this will crash if it's not there :^) hehehe
         //
-        Object diffObj(obj.getTypeId(), id);
+        Object& diffObj = diff.add(obj); //same attributes as obj, then overwritten with the differences
         //
-        for (const auto& pair : obj.getAttributes()) {
-            diffObj.getAttribute(pair.first) = pair.second - prevObj.getAttribute(pair.first);
+        for (auto& pair : diffObj.getAttributes()) {
+            pair.second -= prevObj.getAttribute(pair.first);
         }
-        //
-        diff.objects[id] = diffObj;
     }
     return diff;
 }
 
+StateDelta State::delta(const State& prev, Arena* arena) const
+{
+    StateDelta delta(arena);
+    for (std::size_t c = 0; c < chunks.size(); c++) {
+        if (!chunks[c]) continue;
+        const Chunk* prev_chunk = (c < prev.chunks.size()) ? prev.chunks[c].get() : nullptr;
+        if (chunks[c].get() == prev_chunk) continue; //shared, so nothing in it changed
+        for (const auto& slot : chunks[c]->slots) {
+            if (slot.first < 0) continue;
+            const Object& obj = slot.second;
+            const Object* prev_obj = (prev_chunk != nullptr && prev_chunk->slots[slot.first % CHUNK_SIZE].first >= 0) ? &prev_chunk->slots[slot.first % CHUNK_SIZE].second : nullptr;
+            for (const auto& pair : obj.getAttributes()) {
+                const AttributeValue& value = pair.second;
+                if (prev_obj == nullptr) {
+                    //not in prev: the whole value is the change
+                    if (value.length() != 0) delta.add(slot.first, obj.getTypeId(), pair.first, value);
+                    continue;
+                }
+                const AttributeValue& prev_value = prev_obj->getAttribute(pair.first);
+                if (!(value == prev_value)) delta.add(slot.first, obj.getTypeId(), pair.first, value - prev_value);
+            }
+        }
+    }
+    return delta;
+}
+
 int State::length() const
 {
     int len = 0;
-    for (const auto& pair : objects) {
+    for (const auto& pair : getObjects()) {
         const Object& obj = pair.second;
         //
         for (const auto& pair : obj.getAttributes()) {
@@ -482,17 +715,134 @@ int State::length() const
 int State::error(const State& other) const
 {
     //TODO: handle mismatch in object sets
-    return diff(other).length();
+    return delta(other).length();
+}
+
+std::uint64_t State::hash() const
+{
+    std::uint64_t h = 0;
+    for (const std::shared_ptr<Chunk>& chunk : chunks) {
+        if (chunk) h ^= chunk->getHash();
+    }
+    return h;
+}
+
+std::size_t StateHash::operator()(const State& state) const
+{
+    return std::size_t(state.hash());
+}
+
+StateDelta::StateDelta()
+{
+}
+
+StateDelta::StateDelta(Arena* arena) : changes(ArenaAllocator<Change>(arena))
+{
+}
+
+void StateDelta::add(int object, int type, int attribute, AttributeValue delta)
+{
+    changes.push_back(Change{ object, type, attribute, std::move(delta) });
+}
+
+const ArenaVector<StateDelta::Change>& StateDelta::getChanges() const
+{
+    return changes;
+}
+
+std::size_t StateDelta::size() const
+{
+    return changes.size();
+}
+
+bool StateDelta::empty() const
+{
+    return changes.empty();
+}
+
+const AttributeValue* StateDelta::find(int object, int attribute) const
+{
+    auto it = std::lower_bound(changes.begin(), changes.end(), std::make_pair(object, attribute), [](const Change& change, const std::pair<int, int>& key) {
+        return std::make_pair(change.object, change.attribute) < key;
+    });
+    if (it == changes.end() || it->object != object || it->attribute != attribute) return nullptr;
+    return &it->delta;
+}
+
+int StateDelta::length() const
+{
+    int len = 0;
+    for (const Change& change : changes) {
+        len += change.delta.length();
+    }
+    return len;
+}
+
+ObjectsByType::ObjectsByType()
+{
+}
+
+ObjectsByType::ObjectsByType(const State& state)
+{
+    //count the objects of each type, then place them (the objects are visited in increasing order of id, so each type's run is too)
+    //(objects without a type can't be asked for, so they're left out)
+    for (const auto& pair : state.getObjects()) {
+        int type = pair.second.getTypeId();
+        if (type < 0) continue;
+        if (std::size_t(type) + 2 > offsets.size()) offsets.resize(std::size_t(type) + 2, 0);
+        offsets[type + 1]++;
+    }
+    for (std::size_t type = 1; type < offsets.size(); type++) {
+        offsets[type] += offsets[type - 1];
+    }
+    objects.resize(offsets.empty() ? 0 : offsets.back());
+    std::vector<std::size_t> next(offsets);
+    for (const auto& pair : state.getObjects()) {
+        int type = pair.second.getTypeId();
+        if (type >= 0) objects[next[type]++] = &pair.second;
+    }
+}
+
+ObjectSpan ObjectsByType::at(int type) const
+{
+    if (type < 0 || type >= getTypeCount()) return ObjectSpan();
+    const Object* const* data = objects.data();
+    return ObjectSpan(data + offsets[type], data + offsets[type + 1]);
+}
+
+int ObjectsByType::getTypeCount() const
+{
+    return offsets.empty() ? 0 : int(offsets.size() - 1);
+}
+
+std::size_t ObjectsByType::size() const
+{
+    return objects.size();
 }
 
 bool State::operator==(const State& other) const
 {
-    return objects == other.objects;
+    if (count != other.count) return false;
+    for (std::size_t i = 0; i < std::max(chunks.size(), other.chunks.size()); i++) {
+        const Chunk* a = (i < chunks.size()) ? chunks[i].get() : nullptr;
+        const Chunk* b = (i < other.chunks.size()) ? other.chunks[i].get() : nullptr;
+        if (a == b) continue; //shared (or both empty)
+        if (a == nullptr || b == nullptr || a->count != b->count) return false;
+        if (!std::equal(std::begin(a->slots), std::end(a->slots), std::begin(b->slots))) return false;
+    }
+    return true;
 }
 
 bool State::operator<(const State& other) const
 {
-    return objects < other.objects;
+    //same order as comparing two std::map<int, Object>, but chunks shared by both states are skipped over
+    std::size_t shared = 0;
+    while (shared < chunks.size() && shared < other.chunks.size() && chunks[shared] == other.chunks[shared]) shared++;
+    auto begin = ObjectIterator<const std::pair<int, Object>>(chunks.data() + shared, chunks.data() + chunks.size());
+    auto end = ObjectIterator<const std::pair<int, Object>>(chunks.data() + chunks.size(), chunks.data() + chunks.size());
+    auto other_begin = ObjectIterator<const std::pair<int, Object>>(other.chunks.data() + shared, other.chunks.data() + other.chunks.size());
+    auto other_end = ObjectIterator<const std::pair<int, Object>>(other.chunks.data() + other.chunks.size(), other.chunks.data() + other.chunks.size());
+    return std::lexicographical_compare(begin, end, other_begin, other_end);
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -549,9 +899,29 @@ StateDistribution::StateDistribution(const State& state)
     }
 }
 
+StateDistribution::StateDistribution(Arena* arena) : objects(ArenaAllocator<std::pair<const int, ProbabilityDistribution<Object>>>(arena))
+{
+}
+
 void StateDistribution::addObject(int type_id, int obj_id)
 {
-    objects[obj_id] = ProbabilityDistribution<Object>(Object(type_id, obj_id));
+    addObject(Object(type_id, obj_id, objects.get_allocator().getArena()));
+}
+
+void StateDistribution::addObject(Object&& object)
+{
+    //built in place, since assigning it over a default (heap) entry would copy it out of the arena
+    Arena* arena = objects.get_allocator().getArena();
+    int obj_id = object.getObjectId();
+    ProbabilityDistribution<Object> distribution(arena);
+    distribution.setProbability(std::move(object), 1);
+    auto it = objects.find(obj_id);
+    if (it == objects.end()) {
+        objects.emplace(obj_id, std::move(distribution));
+    }
+    else {
+        it->second = std::move(distribution);
+    }
 }
 
 void StateDistribution::addObject(const ProbabilityDistribution<Object>& distribution)
@@ -578,7 +948,7 @@ double StateDistribution::error(const StateDistribution& other) const
 {
     double err = 0;
     //for each object that is in both distributions,
-    const std::map<int, ProbabilityDistribution<Object>>& other_objects = other.objects;
+    const ArenaMap<int, ProbabilityDistribution<Object>>& other_objects = other.objects;
     for (const auto& pair : objects) {
         int id = pair.first;
         const ProbabilityDistribution<Object>& objs = pair.second;
@@ -597,13 +967,13 @@ double StateDistribution::error(const State& other) const
 {
     double err = 0;
     //
-    const std::map<int, Object>& other_objects = other.getObjects();
     for (const auto& pair : objects) {
         int id = pair.first;
         const ProbabilityDistribution<Object>& objs = pair.second;
-        if (other_objects.find(id) != other_objects.end()) {
+        const Object* other_object = other.findObject(id);
+        if (other_object != nullptr) {
             //object exists in both, calc weighted errors
-            const Object& o = other_objects.at(id);
+            const Object& o = *other_object;
             for (const auto& opair : objs.getProbabilities()) {
                 err += o.distance(opair.first) * opair.second;
             }
@@ -682,9 +1052,32 @@ int Types::addObjectType(const std::string& name)
     int index = object_types.size() - 1;
     object_types[index].id = index;
     object_type_names[name] = index;
+    object_layouts.emplace_back();
     return index;
 }
 
+void Types::updateLayout(int object_type_id)
+{
+    const ObjectType& type = object_types.at(object_type_id);
+    ObjectLayout& layout = object_layouts.at(object_type_id);
+    layout.attributes.assign(type.attribute_types.begin(), type.attribute_types.end()); //sets are already sorted
+    layout.sizes.clear();
+    for (std::size_t i = 0; i < layout.attributes.size(); i++) {
+        layout.sizes.push_back(attribute_types.at(layout.attributes[i]).size);
+    }
+}
+
+void Types::addObjectAttribute(int object_type_id, int attribute_type_id)
+{
+    object_types.at(object_type_id).attribute_types.insert(attribute_type_id);
+    updateLayout(object_type_id);
+}
+
+const ObjectLayout& Types::getObjectLayout(int object_type_id) const
+{
+    return object_layouts.at(object_type_id);
+}
+
 ObjectType& Types::getObjectType(int id)
 {
     return object_types.at(id);
@@ -717,9 +1110,14 @@ const std::vector<ObjectType>& Types::getObjectTypes() const
 
 Object Types::createObject(int type_id, int object_id) const
 {
+    const ObjectLayout& layout = object_layouts[type_id];
+    const std::set<int>& attributes = object_types[type_id].attribute_types;
+    if (layout.attributes.size() == attributes.size() && std::equal(attributes.begin(), attributes.end(), layout.attributes.begin())) {
+        return Object(type_id, object_id, layout);
+    }
+    //the type was changed without addObjectAttribute, so its layout is out of date: add all attributes as blank
     Object obj(type_id, object_id);
-    //add all attributes as blank
-    for (int attribute_type : object_types[type_id].attribute_types) {
+    for (int attribute_type : attributes) {
         obj.addAttribute(attribute_type, attribute_types[attribute_type].size);
     }
     //
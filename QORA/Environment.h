@@ -66,8 +66,14 @@ void from_json(const json& j, ObjectType& t);
 
 //basically just a simple vector type, that supports element-wise addition/subtraction for convenience
 class AttributeValue {
+	constexpr static int INLINE_SIZE = 4; //values with up to this many components are stored inline; only bigger ones allocate
+	//
 	int sz;
-	int* data;
+	int* data; //points to 'inline_data' if sz <= INLINE_SIZE
+	int inline_data[INLINE_SIZE];
+	//
+	void allocate(int sz); //point 'data' at storage for sz components (contents undefined); any old heap storage must already be freed
+	bool isInline() const;
 	//
 public:
 	const static AttributeValue UP;
@@ -79,7 +85,9 @@ public:
 	AttributeValue(int sz = 0);
 	AttributeValue(std::initializer_list<int> values);
 	AttributeValue(const AttributeValue& other);
+	AttributeValue(AttributeValue&& other) noexcept; //leaves 'other' empty
 	AttributeValue& operator=(const AttributeValue& other);
+	AttributeValue& operator=(AttributeValue&& other) noexcept; //leaves 'other' empty
 	~AttributeValue();
 	//
 	int size() const;
@@ -105,32 +113,50 @@ public:
 	//
 	int length() const; //manhattan distance (sum of abs)
 	std::string to_string() const;
+	std::size_t getHeapUsage() const; //bytes allocated outside the object itself (0 unless there are more than INLINE_SIZE components)
 };
 
 void to_json(json& j, const AttributeValue& p);
 void from_json(const json& j, AttributeValue& p);
 
+//where an object type's attributes are stored in an Object (see Types::getObjectLayout)
+struct ObjectLayout {
+	std::vector<int> attributes; //attribute ids, in increasing order; this is the order an Object stores (and iterates) them in
+	std::vector<int> sizes; //number of components of each attribute, in the same order
+};
+
 class Object {
 public:
+	//these are made in the same arena as obj_base, if it has one
 	static ProbabilityDistribution<Object> combine(const ProbabilityDistribution<Object>& obj_base, int attribute_id, const AttributeValue& attribute_value);
 	static ProbabilityDistribution<Object> combine(const ProbabilityDistribution<Object>& obj_base, int attribute_id, const ProbabilityDistribution<AttributeValue>& attribute_values);
 
+	typedef ArenaVector<std::pair<int, AttributeValue>> Attributes;
 private:
 	int type; //the class of this object (player, goal, wall, ...)
 	int id; //the unique id of this object
 	//
-	std::map<int, AttributeValue> attributes;
+	//(attribute id, value), sorted by id, in one contiguous block: objects have very few attributes,
+	//so a scan over this beats a tree lookup, and copying an object is a single allocation
+	//(on the heap, unless the object was made in an arena; copies always go on the heap)
+	Attributes attributes;
+	//
+	Attributes::iterator find(int id); //the attribute's entry, or where it would be inserted
+	Attributes::const_iterator find(int id) const;
 public:
 	Object(int type_id = -1, int object_id = -1);
+	Object(int type_id, int object_id, const ObjectLayout& layout); //with every attribute of the layout, set to 0
+	Object(int type_id, int object_id, Arena* arena); //with its attributes in the arena
+	Object(const Object& other, Arena* arena); //copy into the arena
 	int getTypeId() const;
 	int getObjectId() const;
 	//
 	AttributeValue& addAttribute(int id, int size);
-	AttributeValue& getAttribute(int id);
-	const AttributeValue& getAttribute(int id) const;
+	AttributeValue& getAttribute(int id); //adds an empty value if the object doesn't have it
+	const AttributeValue& getAttribute(int id) const; //throws std::out_of_range if the object doesn't have it
 	void setAttribute(int id, const AttributeValue& value);
-	std::map<int, AttributeValue>& getAttributes();
-	const std::map<int, AttributeValue>& getAttributes() const;
+	Attributes& getAttributes(); //sorted by id
+	const Attributes& getAttributes() const;
 	bool hasAttribute(int id) const;
 
 	bool operator<(const Object& b) const; //for usage in map
@@ -139,53 +165,189 @@ public:
 	int distance(const Object& other) const;
 };
 
+class StateDelta;
+class State;
+
+//a contiguous run of object pointers, such as every object of one type (see State::getObjectsOfClass)
+class ObjectSpan {
+	const Object* const* first;
+	const Object* const* last;
+public:
+	ObjectSpan() : first(nullptr), last(nullptr) {}
+	ObjectSpan(const Object* const* first, const Object* const* last) : first(first), last(last) {}
+	const Object* const* begin() const { return first; }
+	const Object* const* end() const { return last; }
+	std::size_t size() const { return std::size_t(last - first); }
+	bool empty() const { return first == last; }
+	const Object* operator[](std::size_t i) const { return first[i]; }
+};
+
+//the objects of a State grouped by type, each type's objects in increasing order of id
+class ObjectsByType {
+	std::vector<const Object*> objects; //grouped by type
+	std::vector<std::size_t> offsets; //[type id] -> start of its objects in 'objects', plus one more entry for the end of the last type
+public:
+	ObjectsByType();
+	explicit ObjectsByType(const State& state);
+	ObjectSpan at(int type) const; //empty if the state has no objects of this type
+	int getTypeCount() const; //one more than the largest type id that has objects
+	std::size_t size() const; //number of objects
+};
+
+//objects are stored in chunks of CHUNK_SIZE consecutive ids, and copies of a State share their chunks:
+//a chunk is only copied when a State that shares it changes one of its objects (copy-on-write),
+//so copying a State and changing a few objects costs about as much as the objects changed, not every object in it
+//(so a reference to an object can be used to change it only until the State is next copied or hashed)
+//the objects grouped by type are worked out on first use and kept (and shared by copies) until the State is changed
 class State {
+	friend class ColumnarState; //converts to and from State
+public:
+	constexpr static int CHUNK_SIZE = 16;
+	//
+	struct Chunk {
+		std::pair<int, Object> slots[CHUNK_SIZE]; //slot i holds the object with id (chunk index * CHUNK_SIZE + i), or has first = -1 if there isn't one
+		int count; //number of objects in the chunk
+		mutable std::atomic<std::uint64_t> hash; //xor of the hashes of its objects; 0 = not worked out since the chunk was last changed
+		Chunk();
+		Chunk(const Chunk& other);
+		std::uint64_t getHash() const;
+	};
+	//visits the objects of a State in increasing order of id, as (id, object) pairs, like a std::map<int, Object>
+	template<typename Value>
+	class ObjectIterator {
+		const std::shared_ptr<Chunk>* chunk;
+		const std::shared_ptr<Chunk>* chunks_end;
+		int slot;
+		//
+		void settle() //move on to the next object, unless already at one
+		{
+			while (chunk != chunks_end) {
+				if (*chunk) {
+					while (slot < CHUNK_SIZE && (*chunk)->slots[slot].first < 0) slot++;
+					if (slot < CHUNK_SIZE) return;
+				}
+				chunk++;
+				slot = 0;
+			}
+		}
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef typename std::remove_const<Value>::type value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef Value* pointer;
+		typedef Value& reference;
+		//
+		ObjectIterator(const std::shared_ptr<Chunk>* chunk, const std::shared_ptr<Chunk>* chunks_end) : chunk(chunk), chunks_end(chunks_end), slot(0) { settle(); }
+		Value& operator*() const { return (*chunk)->slots[slot]; }
+		Value* operator->() const { return &(*chunk)->slots[slot]; }
+		ObjectIterator& operator++() { slot++; settle(); return *this; }
+		bool operator==(const ObjectIterator& other) const { return chunk == other.chunk && slot == other.slot; }
+		bool operator!=(const ObjectIterator& other) const { return !(*this == other); }
+	};
+	//every object of a State, for range-for loops
+	template<typename Value>
+	class ObjectRange {
+		const std::vector<std::shared_ptr<Chunk>>& chunks;
+		std::size_t count;
+	public:
+		ObjectRange(const std::vector<std::shared_ptr<Chunk>>& chunks, std::size_t count) : chunks(chunks), count(count) {}
+		ObjectIterator<Value> begin() const { return ObjectIterator<Value>(chunks.data(), chunks.data() + chunks.size()); }
+		ObjectIterator<Value> end() const { return ObjectIterator<Value>(chunks.data() + chunks.size(), chunks.data() + chunks.size()); }
+		std::size_t size() const { return count; }
+		bool empty() const { return count == 0; }
+	};
 private:
 	int nextObjectId;
-	std::map<int, Object> objects;
+	std::vector<std::shared_ptr<Chunk>> chunks; //[id / CHUNK_SIZE]; null where there are no objects
+	std::size_t count; //number of objects
+	mutable std::shared_ptr<const ObjectsByType> objects_by_type; //null until asked for, and again whenever a chunk is changed
+	//
+	Chunk& detach(std::size_t chunk); //the chunk, copied first if another State shares it, so it can be changed
 public:
 	State();
+	State(const State& other);
+	State(State&& other) = default;
+	State& operator=(const State& other);
+	State& operator=(State&& other) = default;
 	//
 	void clear();
 	int getNextObjectId();
 	Object& add(const Object& object); //add a copy of this object and return a reference to the stored copy
 	void remove(int objectId);
 	//
-	std::map<int, Object>& getObjects();
-	const std::map<int, Object>& getObjects() const;
-	Object& getObject(int id);
+	ObjectRange<std::pair<int, Object>> getObjects(); //this copies all shared chunks, so only use it to change objects (iterate over a const State otherwise)
+	ObjectRange<const std::pair<int, Object>> getObjects() const;
+	Object& getObject(int id); //throws std::out_of_range if there's no such object
 	const Object& getObject(int id) const;
+	const Object* findObject(int id) const; //null if there's no such object
 	//
-	std::set<Object*> getObjectsOfClass(int type);
-	std::set<const Object*> getObjectsOfClass(int type) const;
+	ObjectSpan getObjectsOfClass(int type) const; //in increasing order of id; only valid until the State is changed
+	Object* findObjectOfClass(int type); //the one with the lowest id, or null; this only copies its chunk, if shared
+	const Object* findObjectOfClass(int type) const;
 	//
-	std::map<int, std::set<const Object*>> getObjectsByType() const;
+	const ObjectsByType& getObjectsByType() const; //only valid until the State is changed
 	//return set of attributes that have changed
 	//each Object in the returned state actually contains the derivatives of its values, not the values themselves
 	//this can be used repeatedly to get nth derivatives
 	State diff(const State& prev) const;
+	StateDelta delta(const State& prev, Arena* arena = nullptr) const; //same as diff, but only lists the values that changed (optionally in an arena)
 	int length() const; //return the sum of abs of each attribute of each object (so diff->length gives error of prediction)
 	int error(const State& other) const; //gives error including object set mismatches
 
+	//
+	//Zobrist-style hash: the xor of a hash of each (object, attribute component, value)
+	//each chunk keeps its part, so this only hashes the objects of chunks that were changed since the last call
+	std::uint64_t hash() const;
 	//
 	bool operator==(const State& other) const;
 	bool operator<(const State& other) const;
 };
 
+//for unordered containers of States
+struct StateHash {
+	std::size_t operator()(const State& state) const;
+};
+
+//the attribute values that differ between two States (see State::delta), as (object, attribute, difference),
+//so the cost of going over it is the number of changes rather than the number of objects
+class StateDelta {
+public:
+	struct Change {
+		int object;
+		int type; //of the object
+		int attribute;
+		AttributeValue delta; //never all zero
+	};
+private:
+	ArenaVector<Change> changes; //in order of object id, then attribute id
+public:
+	StateDelta();
+	explicit StateDelta(Arena* arena);
+	void add(int object, int type, int attribute, AttributeValue delta); //must come after every change already added
+	const ArenaVector<Change>& getChanges() const;
+	std::size_t size() const;
+	bool empty() const;
+	const AttributeValue* find(int object, int attribute) const; //null if it didn't change
+	int length() const; //same as State::diff(...).length()
+};
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 //probabilistic states
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
+//everything in it can be kept in an arena (see Learner::setArena), in which case it can only be used until the arena is rewound; copies of it go on the heap
 class StateDistribution {
-	std::map<int, ProbabilityDistribution<Object>> objects; //for each object id, keep track of a distribution over the attribute values for that object
+	ArenaMap<int, ProbabilityDistribution<Object>> objects; //for each object id, keep track of a distribution over the attribute values for that object
 
 	//helper
 	static double calc_EarthMoversDistance(const ProbabilityDistribution<Object>& objs1, const ProbabilityDistribution<Object>& objs2);
 public:
 	StateDistribution();
 	StateDistribution(const State& state); //create a singleton distribution for each object
+	explicit StateDistribution(Arena* arena); //empty, in the arena
 	//object manipulation
 	void addObject(int type_id, int obj_id); //adds a new empty object to the distribution
+	void addObject(Object&& object); //adds an object whose attributes are all certain (a singleton distribution); cheaper than adding its attributes one at a time
 	void addObject(const ProbabilityDistribution<Object>& distribution); //adds a new object with distribution over values
 	void addObjectAttribute(int obj_id, int attribute_id, const AttributeValue& attribute_value); //used to extend an existing object's distribution
 	void addObjectAttribute(int obj_id, int attribute_id, const ProbabilityDistribution<AttributeValue>& attribute_values); //used to extend an existing object's distribution
@@ -207,10 +369,12 @@ private:
 	std::map<std::string, int> attribute_type_names;
 	std::vector<ObjectType> object_types;
 	std::map<std::string, int> object_type_names;
+	std::vector<ObjectLayout> object_layouts; //same order as 'object_types'
 	//
 	std::vector<Action> actions;
 	std::map<ActionName, ActionId> action_names;
 	//
+	void updateLayout(int object_type_id); //rebuild object_layouts[object_type_id] from its attribute_types
 public:
 	Types();
 	//
@@ -229,7 +393,9 @@ public:
 	const ObjectType& getObjectType(const std::string& name) const;
 	std::vector<ObjectType>& getObjectTypes();
 	const std::vector<ObjectType>& getObjectTypes() const;
-	//create a blank object (init all attributes to 0)
+	void addObjectAttribute(int object_type_id, int attribute_type_id); //give an object type an attribute, and update its layout
+	const ObjectLayout& getObjectLayout(int object_type_id) const;
+	//create a blank object (init all attributes to 0), laid out by its type's ObjectLayout
 	Object createObject(int type_id, int object_id) const;
 	//
 	void addAction(const Action& action);
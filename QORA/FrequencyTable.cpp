@@ -7,20 +7,122 @@
 //tabular function approximator
 ////////////////////////////////////////////////////////////////////////////////
 
+constexpr std::size_t FrequencyTable::DENSE_MAX_CELLS;
+constexpr uint32_t FrequencyTable::SLOT_EMPTY;
+constexpr size_t FrequencyTable::ROW_HEADER;
+
 FrequencyTable::FrequencyTable(std::size_t m) : m(m)
 {
 }
 
+size_t FrequencyTable::rowWidth() const
+{
+    return ROW_HEADER + k_capacity;
+}
+
+//fibonacci hashing, spreads out the (usually small, sequential) input values
+static inline size_t slot_hash(std::size_t key, size_t mask)
+{
+    return size_t((uint64_t(key) * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+}
+
+const size_t* FrequencyTable::findRow(std::size_t state_in) const
+{
+    if (k_capacity == 0) return nullptr;
+    if (dense) {
+        if (state_in >= m) return nullptr;
+        const size_t* row = &rows[state_in * rowWidth()];
+        return (row[0] > 0) ? row : nullptr;
+    }
+    size_t mask = slots.size() - 1;
+    for (size_t i = slot_hash(state_in, mask); ; i = (i + 1) & mask) {
+        uint32_t r = slots[i];
+        if (r == SLOT_EMPTY) return nullptr;
+        if (row_inputs[r] == state_in) return &rows[r * rowWidth()];
+    }
+}
+
+size_t* FrequencyTable::findOrAddRow(std::size_t state_in)
+{
+    //an out-of-range input can't be stored densely
+    if (dense && state_in >= m) relayout(k_capacity, true);
+    //
+    if (dense) {
+        size_t* row = &rows[state_in * rowWidth()];
+        if (row[0] == 0) row_inputs.push_back(state_in);
+        return row;
+    }
+    //keep the load factor <= 1/2
+    if ((row_inputs.size() + 1) * 2 > slots.size()) rehash(slots.size() * 2);
+    size_t mask = slots.size() - 1;
+    size_t i = slot_hash(state_in, mask);
+    for (; slots[i] != SLOT_EMPTY; i = (i + 1) & mask) {
+        uint32_t r = slots[i];
+        if (row_inputs[r] == state_in) return &rows[r * rowWidth()];
+    }
+    //new row
+    slots[i] = uint32_t(row_inputs.size());
+    row_inputs.push_back(state_in);
+    rows.resize(rows.size() + rowWidth(), 0);
+    //enough of the inputs are in use now that a dense layout is worth it (see DENSE_MAX_CELLS)
+    if (row_inputs.size() * 2 >= m && m <= DENSE_MAX_CELLS / rowWidth()) {
+        relayout(k_capacity, false);
+        if (dense) return &rows[state_in * rowWidth()];
+    }
+    return &rows[rows.size() - rowWidth()];
+}
+
+void FrequencyTable::relayout(size_t capacity, bool force_sparse)
+{
+    size_t width_old = rowWidth();
+    size_t width_new = ROW_HEADER + capacity;
+    bool dense_new = !force_sparse && m <= DENSE_MAX_CELLS / width_new && row_inputs.size() * 2 >= m;
+    for (std::size_t in : row_inputs) {
+        if (in >= m) dense_new = false; //an out-of-range input was already stored, so it has to stay sparse
+    }
+    //
+    std::vector<size_t> rows_new(dense_new ? (m * width_new) : (row_inputs.size() * width_new), 0);
+    for (size_t r = 0; r < row_inputs.size(); r++) {
+        const size_t* src = findRow(row_inputs[r]);
+        size_t* dst = &rows_new[(dense_new ? row_inputs[r] : r) * width_new];
+        std::copy(src, src + width_old, dst);
+    }
+    rows.swap(rows_new);
+    k_capacity = capacity;
+    dense = dense_new;
+    if (dense) {
+        std::vector<uint32_t>().swap(slots);
+    }
+    else {
+        rehash(std::max<size_t>(16, slots.size()));
+    }
+}
+
+void FrequencyTable::rehash(size_t slot_count)
+{
+    while (slot_count < row_inputs.size() * 2) slot_count *= 2;
+    slots.assign(slot_count, SLOT_EMPTY);
+    size_t mask = slot_count - 1;
+    for (size_t r = 0; r < row_inputs.size(); r++) {
+        size_t i = slot_hash(row_inputs[r], mask);
+        while (slots[i] != SLOT_EMPTY) i = (i + 1) & mask;
+        slots[i] = uint32_t(r);
+    }
+}
+
 void FrequencyTable::reset()
 {
     count_total = 0;
-    count_m.clear();
-    count_k.clear();
-    count_joint.clear();
-    frequency_m.clear();
-    frequency_k.clear();
-    frequency_joint.clear();
+    //release the storage, since reset tables may sit around for a long time before they see anything again
+    std::vector<size_t>().swap(count_k);
+    std::vector<size_t>().swap(rows);
+    std::vector<std::size_t>().swap(row_inputs);
+    std::vector<uint32_t>().swap(slots);
+    dense = false;
+    k_capacity = 0;
+    prediction_count = 0;
     prediction_score = 0;
+    success_interval_stale = false;
     success_interval = { 0, 1 };
 }
 
@@ -31,9 +133,7 @@ size_t FrequencyTable::getInputStates() const
 
 std::set<std::size_t> FrequencyTable::getObservedInputStates() const
 {
-    std::set<std::size_t> s;
-    for (const auto& pair : count_m) s.insert(pair.first);
-    return s;
+    return std::set<std::size_t>(row_inputs.begin(), row_inputs.end());
 }
 
 size_t FrequencyTable::getOutputStates() const
@@ -48,56 +148,38 @@ size_t FrequencyTable::getCountTotal() const
 
 size_t FrequencyTable::getCountInput(std::size_t state_in) const
 {
-    auto it = count_m.find(state_in);
-    if (it != count_m.end()) {
-        return it->second;
-    }
-    return 0;
+    const size_t* row = findRow(state_in);
+    return row ? row[0] : 0;
 }
 
 size_t FrequencyTable::getCountOutput(size_t state_out) const
 {
-    auto it = count_k.find(state_out);
-    if (it != count_k.end()) {
-        return it->second;
-    }
-    return 0;
+    return (state_out < count_k.size()) ? count_k[state_out] : 0;
 }
 
 size_t FrequencyTable::getCount(std::size_t state_in, size_t state_out) const
 {
-    auto it = count_joint.find(std::pair<std::size_t, size_t>{state_in, state_out});
-    if (it != count_joint.end()) {
-        return it->second;
-    }
-    return 0;
+    if (state_out >= k_capacity) return 0;
+    const size_t* row = findRow(state_in);
+    return row ? row[ROW_HEADER + state_out] : 0;
 }
 
 double FrequencyTable::getFrequencyInput(std::size_t state_in) const
 {
-    auto it = frequency_m.find(state_in);
-    if (it != frequency_m.end()) {
-        return it->second;
-    }
-    return 0.0;
+    if (count_total == 0) return 0.0;
+    return double(getCountInput(state_in)) / count_total;
 }
 
 double FrequencyTable::getFrequencyOutput(size_t state_out) const
 {
-    auto it = frequency_k.find(state_out);
-    if (it != frequency_k.end()) {
-        return it->second;
-    }
-    return 0.0;
+    if (count_total == 0) return 0.0;
+    return double(getCountOutput(state_out)) / count_total;
 }
 
 double FrequencyTable::getFrequency(std::size_t state_in, size_t state_out) const
 {
-    auto it = frequency_joint.find(std::pair<std::size_t, size_t>{state_in, state_out});
-    if (it != frequency_joint.end()) {
-        return it->second;
-    }
-    return 0.0;
+    if (count_total == 0) return 0.0;
+    return double(getCount(state_in, state_out)) / count_total;
 }
 
 double FrequencyTable::getFrequencyConditional(std::size_t state_in, size_t state_out) const
@@ -123,14 +205,15 @@ FrequencyTable FrequencyTable::slice(std::size_t in) const
     //increase k if necessary
     c.k = k;
     //counts
-    if (count_m.find(in) != count_m.end()) {
-        c.count_total = c.count_m[0] = count_m.at(in);
-        for (size_t i = 0; i < k; i++) {
-            auto it = count_joint.find({ in, i });
-            if (it != count_joint.end()) {
-                c.count_joint[{0, i}] = c.count_k[i] = it->second;
-            }
-        }
+    const size_t* row = findRow(in);
+    if (row) {
+        c.relayout(k_capacity, false);
+        size_t* dst = c.findOrAddRow(0);
+        std::copy(row, row + rowWidth(), dst);
+        c.count_total = row[0];
+        c.count_k.assign(row + ROW_HEADER, row + rowWidth());
+        c.prediction_count = double(row[1]) / c.count_total;
+        c.prediction_score = c.prediction_count / c.count_total;
     }
     //
     return c;
@@ -143,6 +226,11 @@ double FrequencyTable::getPredictionScore() const
 
 ConfidenceInterval FrequencyTable::getSuccessInterval() const
 {
+    if (success_interval_stale) {
+        //the running sum can pick up a tiny bit of rounding error, so don't let it truncate an exact count down by 1
+        success_interval = Statistics::estimate_binomial_interval(count_total, std::size_t(prediction_count + 1e-6), alpha);
+        success_interval_stale = false;
+    }
     return success_interval;
 }
 
@@ -150,49 +238,30 @@ void FrequencyTable::observe(std::size_t state_in, size_t state_out)
 {
     //increase k if necessary
     if (state_out >= k) k = state_out + 1;
+    if (state_out >= k_capacity) relayout(std::max(k, k_capacity * 2), false);
+    if (state_out >= count_k.size()) count_k.resize(k, 0);
     //counts
     count_total++;
-    count_m[state_in]++;
     count_k[state_out]++;
-    count_joint[{state_in, state_out}]++;
+    //only the row of this input changes, so swap out its old contribution to the score for the new one
+    size_t* row = findOrAddRow(state_in);
+    size_t& n_in = row[0];
+    size_t& sq_in = row[1];
+    size_t& n_joint = row[ROW_HEADER + state_out];
+    double term_old = (n_in > 0) ? (double(sq_in) / n_in) : 0.0;
+    sq_in += 2 * n_joint + 1; //(n + 1)^2 = n^2 + 2n + 1
+    n_joint++;
+    n_in++;
+    prediction_count += double(sq_in) / n_in - term_old;
+    prediction_score = prediction_count / count_total;
 }
 
 void FrequencyTable::recalculate(double a)
 {
     if (count_total == 0) return;
     //
-    for (auto& pair : count_joint) {
-        frequency_joint[pair.first] = double(pair.second) / count_total;
-    }
-    for (auto& pair : count_m) {
-        frequency_m[pair.first] = double(pair.second) / count_total;
-    }
-    for (auto& pair : count_k) {
-        frequency_k[pair.first] = double(pair.second) / count_total;
-    }
-    //recalculate score with paper's formula
-    prediction_score = 0;
-    for (auto& pair : frequency_m) {
-        size_t in = pair.first;
-        double f = pair.second;
-        //
-        double term = 0;
-        auto it = frequency_m.find(in);
-        if (it != frequency_m.end()) {
-            double f = it->second;
-            if (f > 0) {
-                for (size_t out = 0; out < k; out++) {
-                    if (frequency_joint.find({ in, out }) != frequency_joint.end()) {
-                        double x = frequency_joint.at({ in, out });
-                        term += x * x;
-                    }
-                }
-                prediction_score += term / f;
-            }
-        }
-    }
-    //printf("prediction score: %f, count: %zu\n", prediction_score, count_total);
-    success_interval = Statistics::estimate_binomial_interval(count_total, prediction_score * count_total, a);
+    alpha = a;
+    success_interval_stale = true;
 }
 
 size_t FrequencyTable::predict(std::size_t state_in) const
@@ -223,56 +292,146 @@ double FrequencyTable::confidence(std::size_t state_in) const
     return best_prob;
 }
 
+size_t FrequencyTable::getMemoryUsage() const
+{
+    return sizeof(FrequencyTable)
+        + count_k.capacity() * sizeof(size_t)
+        + rows.capacity() * sizeof(size_t)
+        + row_inputs.capacity() * sizeof(std::size_t)
+        + slots.capacity() * sizeof(uint32_t);
+}
+
 void FrequencyTable::print(FILE* f) const
 {
     //print out m and k, then the table of joint frequencies
     fprintf(f, "Counter(%zu x %zu), success: ", m, k);
-    success_interval.print(f);
+    getSuccessInterval().print(f);
 }
 
 bool FrequencyTable::operator>(const FrequencyTable& b) const
 {
-    return success_interval > b.success_interval;
+    return getSuccessInterval() > b.getSuccessInterval();
 }
 
 bool FrequencyTable::operator<(const FrequencyTable& b) const
 {
-    return success_interval < b.success_interval;
+    return getSuccessInterval() < b.getSuccessInterval();
 }
 
 void FrequencyTable::to_json(json& j) const
 {
+    //same layout as the old map-based storage, so existing model files still load
+    std::map<std::size_t, size_t> count_m;
+    for (std::size_t in : row_inputs) count_m[in] = getCountInput(in);
+    std::map<size_t, size_t> count_k_nonzero;
+    for (size_t out = 0; out < count_k.size(); out++) {
+        if (count_k[out] > 0) count_k_nonzero[out] = count_k[out];
+    }
     j = json{
         {"m", m},
         {"k", k},
         {"count_total", count_total},
         {"count_m", count_m},
-        {"count_k", count_k},
+        {"count_k", count_k_nonzero},
         {"prediction_score", prediction_score}
     };
     json& j_joint = j["count_joint"];
-    for (const auto& pair : count_joint) {
-        std::string key = std::to_string(pair.first.first) + "," + std::to_string(pair.first.second); //input,outcome
-        int value = pair.second; //count
-        j_joint[key] = value;
+    for (const auto& pair : count_m) {
+        for (size_t out = 0; out < k; out++) {
+            size_t count = getCount(pair.first, out);
+            if (count == 0) continue;
+            std::string key = std::to_string(pair.first) + "," + std::to_string(out); //input,outcome
+            int value = count; //count
+            j_joint[key] = value;
+        }
     }
 }
 
 void FrequencyTable::from_json(const json& j)
 {
+    reset();
     j.at("m").get_to(m);
     j.at("k").get_to(k);
-    j.at("count_total").get_to(count_total);
-    j.at("count_m").get_to(count_m);
-    j.at("count_k").get_to(count_k);
-    j.at("prediction_score").get_to(prediction_score);
-    count_joint.clear();
+    relayout(k, false);
+    count_k.resize(k, 0);
+    //count_total, count_m and count_k are all implied by the joint counts
     const json& j_joint = j.at("count_joint");
     for (json::const_iterator it = j_joint.cbegin(); it != j_joint.cend(); ++it) {
     	const std::string& key = it.key(); //input,outcome
     	const json& value = it.value(); //count
     	//
         std::vector<std::string> key_split = str_split(key, ",");
-        count_joint[std::pair<std::size_t, int>{std::stoll(key_split[0]), std::stoi(key_split[1])}] = value.get<int>();
+        std::size_t in = std::stoll(key_split[0]);
+        size_t out = std::stoi(key_split[1]);
+        size_t count = value.get<int>();
+        loadCount(in, out, count);
     }
+    loadFinish();
+}
+
+void FrequencyTable::to_binary(BinaryWriter& out) const
+{
+    //m, k, then each observed row: input, number of nonzero outcomes, and (outcome, count) for each of them
+    out.writeVarint(m);
+    out.writeVarint(k);
+    out.writeVarint(row_inputs.size());
+    for (std::size_t in : row_inputs) {
+        const size_t* row = findRow(in);
+        std::size_t nonzero = 0;
+        for (size_t o = 0; o < k_capacity; o++) {
+            if (row[ROW_HEADER + o] > 0) nonzero++;
+        }
+        out.writeVarint(in);
+        out.writeVarint(nonzero);
+        for (size_t o = 0; o < k_capacity; o++) {
+            if (row[ROW_HEADER + o] == 0) continue;
+            out.writeVarint(o);
+            out.writeVarint(row[ROW_HEADER + o]);
+        }
+    }
+}
+
+void FrequencyTable::from_binary(BinaryReader& in)
+{
+    reset();
+    m = std::size_t(in.readVarint());
+    k = size_t(in.readVarint());
+    relayout(k, false);
+    count_k.resize(k, 0);
+    std::size_t rows_n = std::size_t(in.readVarint());
+    for (std::size_t r = 0; r < rows_n && in.ok(); r++) {
+        std::size_t state_in = std::size_t(in.readVarint());
+        std::size_t nonzero = std::size_t(in.readVarint());
+        for (std::size_t i = 0; i < nonzero && in.ok(); i++) {
+            size_t out = size_t(in.readVarint());
+            size_t count = size_t(in.readVarint());
+            loadCount(state_in, out, count);
+        }
+    }
+    loadFinish();
+}
+
+void FrequencyTable::loadCount(std::size_t state_in, size_t state_out, size_t count)
+{
+    if (count == 0) return;
+    if (state_out >= k) return; //corrupt (outcome index past the table), from either format
+    //
+    size_t* row = findOrAddRow(state_in);
+    row[0] += count;
+    row[1] += count * count;
+    row[ROW_HEADER + state_out] += count;
+    count_k[state_out] += count;
+    count_total += count;
+}
+
+void FrequencyTable::loadFinish()
+{
+    //rebuild the running score from the loaded counts
+    for (std::size_t in : row_inputs) {
+        const size_t* row = findRow(in);
+        prediction_count += double(row[1]) / row[0];
+    }
+    prediction_score = (count_total > 0) ? (prediction_count / count_total) : 0.0;
+    success_interval_stale = false;
+    success_interval = { 0, 1 };
 }
@@ -2,28 +2,52 @@
 
 #include "Statistics.h"
 #include "ProbabilityDistribution.h"
+#include "util.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 //tabular function approximator
 ////////////////////////////////////////////////////////////////////////////////
 
 class FrequencyTable {
+	//tables only store rows for the inputs that have actually been observed, and find them through a small open-addressing hash table,
+	//until at least half of the possible inputs have a row: then, if the table has at most this many cells (inputs * row width),
+	//it switches to one row per possible input value, which costs at most about twice the memory and skips the hashing
+	//(most tables never get there: a Condition's stateSize is usually far more than the inputs it actually sees)
+	constexpr static std::size_t DENSE_MAX_CELLS = 256;
+	constexpr static uint32_t SLOT_EMPTY = 0xFFFFFFFF;
+	constexpr static size_t ROW_HEADER = 2; //count_m and sum_squares_m come before the joint counts in each row
 	//
 	std::size_t m; //number of input states
 	size_t k = 2; //number of outcomes (may change dynamically as observations are made, begins at 2 since that's the minimum interesting number)
 	//counts, from calls to observe()
 	std::size_t count_total = 0; //total number of calls to observe()
-	std::map<std::size_t, size_t> count_m; //number of calls to observe() per input value
-	std::map<size_t, size_t> count_k; //number of calls to observer() per outcome value
-	std::map<std::pair<std::size_t, size_t>, size_t> count_joint; //counts indexed by [input value, outcome value]
-	//frequencies, estimated from above
-	std::map<std::size_t, double> frequency_m; //number of calls to observe() per input value
-	std::map<size_t, double> frequency_k; //number of calls to observer() per outcome value
-	std::map<std::pair<std::size_t, size_t>, double> frequency_joint; //counts indexed by [input value, outcome value]
-	//the prediction score (S score from the paper)
+	std::vector<size_t> count_k; //number of calls to observe() per outcome value
+	//per-input rows, stored contiguously; each row is [count_m, sum_squares_m, count_joint[0], ..., count_joint[k_capacity - 1]]
+	//sum_squares_m = sum over outcomes of count_joint^2 (so each observation only touches one input row)
+	bool dense = false; //true: row index = input value; false: row index comes from slots (see DENSE_MAX_CELLS)
+	size_t k_capacity = 0; //number of outcome columns allocated per row (0 until the first observation)
+	std::vector<size_t> rows;
+	std::vector<std::size_t> row_inputs; //input value of each observed row, in the order they were first observed
+	std::vector<uint32_t> slots; //sparse only: open-addressing index (input value -> row index), size is a power of 2
+	//frequencies are not stored, they are computed from the counts on demand
+	//the prediction score (S score from the paper), maintained incrementally by observe()
+	//S = sum_in (sum_out f(in, out)^2) / f(in) = (1 / count_total) * sum_in sum_squares_m[in] / count_m[in]
+	double prediction_count = 0; //S * count_total, i.e. the running sum of sum_squares_m[in] / count_m[in]
 	double prediction_score = 0;
 	//prediction success confidence interval (estimate of how often it predicts the outcome correctly)
-	ConfidenceInterval success_interval;
+	//only refreshed when it is actually requested after a call to recalculate()
+	double alpha = 0;
+	mutable bool success_interval_stale = false;
+	mutable ConfidenceInterval success_interval;
+	//storage helpers
+	size_t rowWidth() const;
+	const size_t* findRow(std::size_t state_in) const; //returns nullptr if the input has never been observed
+	size_t* findOrAddRow(std::size_t state_in);
+	void relayout(size_t capacity, bool force_sparse); //move all rows into new storage with the given number of outcome columns
+	void rehash(size_t slot_count); //rebuild the sparse index
+	//loading helpers (from_json/from_binary): add saved counts, then rebuild the running score once they are all in
+	void loadCount(std::size_t state_in, size_t state_out, size_t count);
+	void loadFinish();
 public:
 	FrequencyTable(std::size_t m); //m = number of inputs
 	//
@@ -49,12 +73,14 @@ public:
 	ConfidenceInterval getSuccessInterval() const;
 	//make an observation
 	void observe(std::size_t state_in, size_t state_out); //may need to auto-adjust the k parameter if a new outcome is suddenly observed
-	//recalculate all of the frequencies and confidence interval
+	//mark the confidence interval for recalculation (the score is already kept up to date by observe)
 	void recalculate(double alpha); //success confidence interval alpha value (e.g. 0.01 for a 99% confidence interval)
 	//
 	size_t predict(std::size_t state_in) const; //return the max-likelihood outcome for the given input state
 	double confidence(std::size_t state_in) const; //return the probability of the max-likelihood outcome for the given input state (1 = it is the only observed outcome, 0 = never observed, 0<x<1 -> multiple outcomes observed)
 	//
+	size_t getMemoryUsage() const; //approximate number of bytes used by this table, including its heap storage
+	//
 	void print(FILE* f) const;
 	//
 	bool operator>(const FrequencyTable& b) const; //to keep them in sorted order, based on success interval
@@ -62,4 +88,6 @@ public:
 	//
 	void to_json(json& j) const;
 	void from_json(const json& j);
+	void to_binary(BinaryWriter& out) const;
+	void from_binary(BinaryReader& in);
 };
\ No newline at end of file
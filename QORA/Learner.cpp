@@ -10,6 +10,56 @@ const std::string& Learner::getName() const
 	return name;
 }
 
+void Learner::setArena(Arena* arena)
+{
+	this->arena = arena;
+}
+
+Arena* Learner::getArena() const
+{
+	return arena;
+}
+
+std::vector<StateDistribution> Learner::predictTransitions(const std::vector<Transition>& transitions, Random& random) const
+{
+	std::vector<StateDistribution> predictions;
+	predictions.reserve(transitions.size());
+	for (const Transition& transition : transitions) {
+		predictions.push_back(predictTransition(*transition.prevState, transition.action, random));
+	}
+	return predictions;
+}
+
+void Learner::observeTransitions(const std::vector<Transition>& transitions)
+{
+	for (const Transition& transition : transitions) {
+		observeTransition(*transition.prevState, transition.action, *transition.nextState);
+	}
+}
+
+void Learner::to_binary(BinaryWriter& out) const
+{
+	std::vector<std::uint8_t> packed = json::to_msgpack(to_json());
+	out.writeVarint(packed.size());
+	out.writeBytes(reinterpret_cast<const char*>(packed.data()), packed.size());
+}
+
+void Learner::from_binary(BinaryReader& in)
+{
+	std::string packed = in.readString();
+	if (!in.ok()) return;
+	from_json(json::from_msgpack(packed));
+}
+
+void Learner::setPredictOnly(bool)
+{
+}
+
+json Learner::getStats() const
+{
+	return nullptr;
+}
+
 Oracle::Oracle(const Environment* env) : Learner("oracle", env->getTypes()), env(env)
 {
 }
@@ -29,12 +79,12 @@ StateDistribution Oracle::predictTransition(const State& state, ActionId action,
 	return env->act(state, action, random);
 }
 
-void Oracle::observeTransition(const State& prevState, ActionId action, const State& nextState)
+void Oracle::observeTransition(const State&, ActionId, const State&)
 {
 	//noop
 }
 
-void Oracle::print(FILE* f) const
+void Oracle::print(FILE*) const
 {
 	//noop
 }
@@ -45,7 +95,7 @@ json Oracle::to_json() const
 	return json();
 }
 
-void Oracle::from_json(const json& j)
+void Oracle::from_json(const json&)
 {
 	//noop
 }
@@ -4,6 +4,13 @@
 #include "ProbabilityDistribution.h"
 
 
+//a single (s, a, s') for the batch functions below; the states are owned by the caller
+struct Transition {
+	const State* prevState;
+	ActionId action;
+	const State* nextState; //not used for prediction, so it may be null there
+};
+
 //superclass for learning algorithms
 class Learner
 {
@@ -13,6 +20,8 @@ class Learner
 protected:
 	//the types in the environment this learner is working in
 	Types types;
+	//optional; if set, predictions (and anything else the learner only needs for one call) are allocated in it, see setArena
+	Arena* arena = nullptr;
 
 public:
 
@@ -34,12 +43,37 @@ public:
 	//observe (s, a, s')
 	virtual void observeTransition(const State& prevState, ActionId action, const State& nextState) = 0;
 
+	//batch versions of the above, which give the same results as calling them once per transition (in order)
+	//default: just loop; learners with expensive per-call setup can override these to share it across the batch
+	virtual std::vector<StateDistribution> predictTransitions(const std::vector<Transition>& transitions, Random& random) const;
+	virtual void observeTransitions(const std::vector<Transition>& transitions);
+
 	//print some info about current observations and rules
 	virtual void print(FILE* f) const = 0;
 
 	//save/load model (json)
 	virtual json to_json() const = 0;
 	virtual void from_json(const json& j) = 0;
+
+	//save/load model (compact binary, for the binary model files)
+	//default: the json model, packed as MessagePack; learners with large models can override these with their own format
+	virtual void to_binary(BinaryWriter& out) const;
+	virtual void from_binary(BinaryReader& in);
+
+	//called before loading a model that will only be used for prediction (e.g. predict_pt without learning)
+	//default: ignored; learners with large models can use it to skip loading whatever only learning needs
+	virtual void setPredictOnly(bool predict_only);
+
+	//per-transition allocation, opted into by the caller: the StateDistributions returned by predictTransition(s) are put in this arena,
+	//along with whatever else the learner only needs during a call, so they're only valid until the caller rewinds it
+	//(learners that don't support it keep using the heap); null (the default) puts everything on the heap again
+	//the arena isn't thread-safe, so only the calling thread allocates from it (worker threads keep using the heap)
+	void setArena(Arena* arena);
+	Arena* getArena() const;
+
+	//instrumentation (memory use, time, ...) for finding where a model's resources go; not part of the model
+	//default: null, for learners that don't keep any
+	virtual json getStats() const;
 };
 
 //uses the environment to produce ground-truth predictions
@@ -1,8 +1,14 @@
 #include "pch.h"
 #include "LearnerQORA.h"
+#include "LearnerQORAFrozen.h"
 
 namespace l_qora {
 
+	static inline std::size_t hash_combine(std::size_t h, std::size_t value)
+	{
+		return h ^ (value + 0x9E3779B97F4A7C15ull + (h << 6) + (h >> 2));
+	}
+
 	bool EffectType::operator<(const EffectType& e) const
 	{
 		if (object_type < e.object_type) return true;
@@ -101,6 +107,45 @@ namespace l_qora {
 		j.at("value").get_to(p.value);
 	}
 
+	std::size_t SpatialIndex::hash(int object_type, const int* base, const int* offset, int size)
+	{
+		std::size_t h = hash_combine(std::size_t(object_type + 1), std::size_t(size));
+		for (int i = 0; i < size; i++) {
+			h = hash_combine(h, std::size_t(offset ? base[i] + offset[i] : base[i]));
+		}
+		return h;
+	}
+
+	void SpatialIndex::build(int attribute_type, const ObjectsByType& objects_by_type)
+	{
+		this->attribute_type = attribute_type;
+		cells.clear();
+		for (int type = 0; type < objects_by_type.getTypeCount(); type++) {
+			for (const Object* obj : objects_by_type.at(type)) {
+				if (!obj->hasAttribute(attribute_type)) continue;
+				const AttributeValue& value = obj->getAttribute(attribute_type);
+				cells.push_back(Cell{ hash(type, value.ptr(), nullptr, value.size()), obj });
+			}
+		}
+		std::sort(cells.begin(), cells.end());
+	}
+
+	int SpatialIndex::getAttributeType() const
+	{
+		return attribute_type;
+	}
+
+	std::pair<const SpatialIndex::Cell*, const SpatialIndex::Cell*> SpatialIndex::find(int object_type, const int* base, const int* offset, int size) const
+	{
+		std::size_t h = hash(object_type, base, offset, size);
+		const Cell* first = cells.data();
+		const Cell* last = cells.data() + cells.size();
+		first = std::lower_bound(first, last, h, [](const Cell& cell, std::size_t h) { return cell.first < h; });
+		const Cell* end = first;
+		while (end != last && end->first == h) end++;
+		return { first, end };
+	}
+
 	std::size_t RelationGroup::size() const
 	{
 		return predicates.size();
@@ -138,14 +183,50 @@ namespace l_qora {
 		return value;
 	}
 
-	std::size_t RelationGroup::evaluate_all(const Object& target, const std::map<int, std::set<const Object*>>& objects_by_type) const
+	std::size_t RelationGroup::evaluate_all(const Object& target, const ObjectsByType& objects_by_type, const SpatialIndex* index) const
 	{
+		//the index can be used if every predicate that looks at the "other" is on the indexed attribute
+		bool indexed = (index != nullptr && other_object_type != -1 && predicates.size() <= CompiledCondition::MAX_GROUP_SIZE);
+		for (auto it = predicates.begin(); indexed && it != predicates.end(); ++it) {
+			if (!it->is_relative && it->is_target) continue;
+			indexed = (it->attribute_type == index->getAttributeType()) && (!it->is_relative || target.getAttribute(it->attribute_type).size() == it->value.size());
+		}
 		std::size_t result = 0;
 		//go over all possible pairs, evaluate, and union into result
 		if (other_object_type == -1) {
 			//actually syke, no pairs lol
 			result = (std::size_t(1) << evaluate_single(target));
 		}
+		else if (indexed) {
+			//only objects in the cells named by the predicates can make any of them true; every other object gets the target-only case
+			std::pair<const SpatialIndex::Cell*, const SpatialIndex::Cell*> ranges[CompiledCondition::MAX_GROUP_SIZE];
+			std::size_t n_ranges = 0;
+			for (const Predicate& p : predicates) {
+				if (!p.is_relative && p.is_target) continue;
+				const int* base = p.is_relative ? target.getAttribute(p.attribute_type).ptr() : p.value.ptr();
+				ranges[n_ranges++] = index->find(other_object_type, base, p.is_relative ? p.value.ptr() : nullptr, p.value.size());
+			}
+			std::size_t near = 0;
+			for (std::size_t r = 0; r < n_ranges; r++) {
+				for (const SpatialIndex::Cell* cell = ranges[r].first; cell != ranges[r].second; cell++) {
+					const Object* other = cell->second;
+					if (other->getTypeId() != other_object_type) continue;
+					//several predicates can name the same cell, so skip objects that were already counted (same as CompiledCondition::evaluate_indexed)
+					bool seen = false;
+					for (std::size_t q = 0; q < r && !seen; q++) {
+						for (const SpatialIndex::Cell* c = ranges[q].first; c != ranges[q].second && !seen; c++) {
+							seen = (c->second == other);
+						}
+					}
+					if (seen) continue;
+					near++;
+					result |= (std::size_t(1) << evaluate_single(target, *other));
+				}
+			}
+			if (objects_by_type.at(other_object_type).size() > near) {
+				result |= (std::size_t(1) << evaluate_single(target));
+			}
+		}
 		else {
 			//ok, pairs
 			for (const Object* other : objects_by_type.at(other_object_type)) {
@@ -241,6 +322,184 @@ namespace l_qora {
 		}
 	}
 
+	constexpr std::size_t PredicateCache::NOT_EVALUATED;
+
+	int PredicateCache::getId(int other_object_type, const Predicate& predicate)
+	{
+		auto key = std::make_pair(other_object_type, predicate);
+		auto it = ids.find(key);
+		if (it != ids.end()) {
+			refs[it->second]++;
+			return it->second;
+		}
+		int id;
+		if (!free_ids.empty()) {
+			id = free_ids.back();
+			free_ids.pop_back();
+			entries[id] = key;
+		}
+		else {
+			id = int(entries.size());
+			entries.push_back(key);
+			refs.push_back(0);
+		}
+		ids[key] = id;
+		refs[id] = 1;
+		return id;
+	}
+
+	void PredicateCache::release(const CompiledCondition& condition)
+	{
+		for (const CompiledCondition::Instruction& instruction : condition.program) {
+			int id = instruction.predicate;
+			assert(id >= 0 && std::size_t(id) < refs.size() && refs[id] > 0);
+			if (--refs[id] > 0) continue;
+			ids.erase(entries[id]);
+			free_ids.push_back(id);
+		}
+	}
+
+	std::size_t PredicateCache::size() const
+	{
+		return entries.size() - free_ids.size();
+	}
+
+	std::size_t PredicateCache::getMemoryUsage() const
+	{
+		return sizeof(PredicateCache)
+			+ ids.size() * (sizeof(std::pair<const std::pair<int, Predicate>, int>) + 4 * sizeof(void*))
+			+ entries.capacity() * sizeof(std::pair<int, Predicate>)
+			+ refs.capacity() * sizeof(std::size_t)
+			+ free_ids.capacity() * sizeof(int)
+			+ others.capacity() * sizeof(Others)
+			+ offsets.capacity() * sizeof(std::size_t)
+			+ bits.capacity() * sizeof(std::uint64_t);
+	}
+
+	void PredicateCache::begin(const Object& target, const ObjectsByType& objects_by_type, const SpatialIndex* index)
+	{
+		this->target = &target;
+		this->objects_by_type = &objects_by_type;
+		this->index = index;
+		std::size_t n_types = std::size_t(objects_by_type.getTypeCount());
+		others.resize(n_types + 1);
+		for (Others& list : others) list.built = false;
+		offsets.assign(entries.size(), NOT_EVALUATED);
+		bits.clear();
+	}
+
+	const PredicateCache::Others& PredicateCache::getOthers(int other_object_type)
+	{
+		Others& list = others[other_object_type + 1];
+		if (!list.built) {
+			if (other_object_type == -1) {
+				//the target on its own, for groups without an "other"
+				list.objects = ObjectSpan(&target, &target + 1);
+			}
+			else {
+				list.objects = objects_by_type->at(other_object_type);
+			}
+			std::size_t n = list.objects.size();
+			list.words = (n + 63) / 64;
+			list.last_word_mask = (n % 64 == 0) ? ~std::uint64_t(0) : ((std::uint64_t(1) << (n % 64)) - 1);
+			list.built = true;
+		}
+		return list;
+	}
+
+	void PredicateCache::update()
+	{
+		offsets.resize(entries.size(), NOT_EVALUATED);
+		for (std::size_t id = 0; id < entries.size(); id++) {
+			if (refs[id] > 0 && offsets[id] == NOT_EVALUATED) evaluate(int(id));
+		}
+	}
+
+	void PredicateCache::update(const CompiledCondition& condition)
+	{
+		offsets.resize(entries.size(), NOT_EVALUATED);
+		for (const CompiledCondition::Instruction& instruction : condition.program) {
+			if (offsets[instruction.predicate] == NOT_EVALUATED) evaluate(instruction.predicate);
+		}
+	}
+
+	void PredicateCache::evaluate(int id)
+	{
+		int other_object_type = entries[id].first;
+		const Predicate& p = entries[id].second;
+		offsets[id] = bits.size();
+		if (std::size_t(other_object_type + 1) >= others.size()) return; //no objects of that type, so there's nothing to store
+		const Others& list = getOthers(other_object_type);
+		bits.resize(bits.size() + list.words, 0);
+		std::uint64_t* word = bits.data() + offsets[id];
+		if (other_object_type == -1) {
+			if (p.evaluate(*target)) word[0] = 1;
+		}
+		else if (!p.is_relative && p.is_target) {
+			//doesn't depend on the other object at all
+			if (target->getAttribute(p.attribute_type) == p.value) {
+				for (std::size_t w = 0; w < list.words; w++) word[w] = ~std::uint64_t(0);
+			}
+		}
+		else {
+			const int* t_data = p.is_relative ? target->getAttribute(p.attribute_type).ptr() : nullptr;
+			const int* v_data = p.value.ptr();
+			int sz = p.value.size();
+			auto match = [&](const Object* other) {
+				const AttributeValue& o = other->getAttribute(p.attribute_type);
+				if (o.size() != sz) return false;
+				const int* o_data = o.ptr();
+				for (int j = 0; j < sz; j++) {
+					if ((p.is_relative ? o_data[j] - t_data[j] : o_data[j]) != v_data[j]) return false;
+				}
+				return true;
+			};
+			if (index != nullptr && p.attribute_type == index->getAttributeType() && (!p.is_relative || target->getAttribute(p.attribute_type).size() == sz)) {
+				//only the objects in the named cell can match; the list is in order of id, so each one's bit can be found by searching
+				auto order = [](const Object* a, const Object* b) { return a->getObjectId() < b->getObjectId(); };
+				auto range = index->find(other_object_type, p.is_relative ? t_data : v_data, p.is_relative ? v_data : nullptr, sz);
+				for (const SpatialIndex::Cell* cell = range.first; cell != range.second; cell++) {
+					const Object* other = cell->second;
+					if (other->getTypeId() != other_object_type || !match(other)) continue;
+					std::size_t i = std::lower_bound(list.objects.begin(), list.objects.end(), other, order) - list.objects.begin();
+					assert(i < list.objects.size() && list.objects[i] == other);
+					word[i / 64] |= (std::uint64_t(1) << (i % 64));
+				}
+			}
+			else {
+				for (std::size_t i = 0; i < list.objects.size(); i++) {
+					if (match(list.objects[i])) word[i / 64] |= (std::uint64_t(1) << (i % 64));
+				}
+			}
+		}
+	}
+
+	std::size_t PredicateCache::evaluate_all(int other_object_type, const int* predicate_ids, std::size_t count) const
+	{
+		if (std::size_t(other_object_type + 1) >= others.size()) return 0;
+		const Others& list = others[other_object_type + 1];
+		std::size_t n_cases = std::size_t(1) << count;
+		std::size_t all_cases = (n_cases >= 64) ? ~std::size_t(0) : ((std::size_t(1) << n_cases) - 1);
+		std::size_t result = 0;
+		//for each word of others, a single-pair case occurs if some other has exactly that combination of predicate results
+		for (std::size_t w = 0; w < list.words && result != all_cases; w++) {
+			std::uint64_t valid = (w + 1 == list.words) ? list.last_word_mask : ~std::uint64_t(0);
+			std::uint64_t words[CompiledCondition::MAX_GROUP_SIZE];
+			for (std::size_t i = 0; i < count; i++) {
+				words[i] = bits[offsets[predicate_ids[i]] + w];
+			}
+			for (std::size_t c = 0; c < n_cases; c++) {
+				if (result & (std::size_t(1) << c)) continue;
+				std::uint64_t mask = valid;
+				for (std::size_t i = 0; i < count; i++) {
+					mask &= ((c >> i) & 1) ? words[i] : ~words[i];
+				}
+				if (mask != 0) result |= (std::size_t(1) << c);
+			}
+		}
+		return result;
+	}
+
 	std::size_t Condition::stateSize() const
 	{
 		std::size_t sz = 1;
@@ -248,12 +507,12 @@ namespace l_qora {
 		return sz;
 	}
 
-	std::size_t Condition::evaluate(const Object& target, const std::map<int, std::set<const Object*>>& objects_by_type) const
+	std::size_t Condition::evaluate(const Object& target, const ObjectsByType& objects_by_type, const SpatialIndex* index) const
 	{
 		std::size_t value = 0;
 		std::size_t multiplier = 1;
 		for (const RelationGroup& group : groups) {
-			value += group.evaluate_all(target, objects_by_type) * multiplier;
+			value += group.evaluate_all(target, objects_by_type, index) * multiplier;
 			multiplier *= group.completeStateSize();
 		}
 		return value;
@@ -357,256 +616,798 @@ namespace l_qora {
 		}
 	}
 
-	void Candidate::observe(const Object& target, const std::map<int, std::set<const Object*>>& objects_by_type, int effect)
+	constexpr ConditionRegistry::Id ConditionRegistry::SLOT_EMPTY;
+
+	//fibonacci hashing, to spread the combined hashes over the slots
+	static inline std::size_t slot_hash(std::size_t hash, std::size_t mask)
 	{
-		std::size_t state_in = condition.evaluate(target, objects_by_type);
-		table.observe(state_in, effect);
+		return std::size_t((std::uint64_t(hash) * 0x9E3779B97F4A7C15ull) >> 32) & mask;
 	}
 
-	void Candidate::print(FILE* f, const Types& types, EffectType type, const std::vector<Effect>& effects) const
+	//approximate heap usage of a condition's nested sets
+	static std::size_t condition_heap_bytes(const Condition& condition)
 	{
-		fprintf(f, "     ");
-		condition.print(f, types, type.object_type);
-		fprintf(f, "\n     ");
-		table.print(f);
-		fprintf(f, "\n");
-		//pretty-print observed cases
-		for (int input : table.getObservedInputStates()) {
-			fprintf(f, "      ");
-			condition.printCaseInfo(f, types, type.object_type, input);
-			fprintf(f, "\n       ");
-			//print distribution from counter, using actual effect values
-			std::size_t n_effects = effects.size();
-			bool needs_comma = false;
-			for (std::size_t i = 0; i < n_effects; i++) {
-				double p = table.getFrequencyConditional(input, i);
-				if (p > 0) {
-					if (needs_comma) fprintf(f, "; ");
-					fprintf(f, "%s %.2f%%", effects.at(i).to_string().c_str(), p * 100);
-					needs_comma = true;
-				}
+		const std::size_t NODE = 4 * sizeof(void*); //red-black tree node header (color + 3 links)
+		std::size_t bytes = 0;
+		for (const RelationGroup& group : condition.groups) {
+			bytes += NODE + sizeof(RelationGroup);
+			for (const Predicate& p : group.predicates) {
+				bytes += NODE + sizeof(Predicate) + p.value.getHeapUsage();
 			}
-			fprintf(f, "\n");
 		}
+		return bytes;
 	}
 
-	bool Candidate::operator>(const Candidate& b) const
+	std::size_t ConditionRegistry::hash(const Condition& condition)
 	{
-		return table > b.table;
+		std::size_t h = condition.groups.size();
+		for (const RelationGroup& group : condition.groups) {
+			h = hash_combine(h, std::size_t(group.other_object_type + 1));
+			h = hash_combine(h, group.predicates.size());
+			for (const Predicate& p : group.predicates) {
+				h = hash_combine(h, std::size_t(p.attribute_type) * 4 + std::size_t(p.is_relative) * 2 + std::size_t(p.is_target));
+				h = hash_combine(h, std::size_t(p.value.size()));
+				for (int i = 0; i < p.value.size(); i++) {
+					h = hash_combine(h, std::size_t(std::uint32_t(p.value[i])));
+				}
+			}
+		}
+		return h;
 	}
 
-	bool Candidate::operator<(const Candidate& b) const
+	void ConditionRegistry::rehash(std::size_t slot_count)
 	{
-		return table < b.table;
+		while (slot_count < hashes.size() * 2) slot_count *= 2;
+		slots.assign(slot_count, SLOT_EMPTY);
+		std::size_t mask = slot_count - 1;
+		for (std::size_t id = 0; id < hashes.size(); id++) {
+			std::size_t i = slot_hash(hashes[id], mask);
+			while (slots[i] != SLOT_EMPTY) i = (i + 1) & mask;
+			slots[i] = Id(id);
+		}
 	}
 
-	void to_json(json& j, const Candidate& p, const Types& types)
+	std::pair<ConditionRegistry::Id, const Condition*> ConditionRegistry::intern(const Condition& condition)
 	{
-		j = json{};
-		to_json(j["predicates"], p.condition, types);
-		p.table.to_json(j["counter"]);
+		std::size_t h = hash(condition);
+		std::lock_guard<std::mutex> lock(mutex);
+		if ((hashes.size() + 1) * 2 > slots.size()) rehash(std::max<std::size_t>(64, slots.size() * 2));
+		std::size_t mask = slots.size() - 1;
+		std::size_t i = slot_hash(h, mask);
+		for (; slots[i] != SLOT_EMPTY; i = (i + 1) & mask) {
+			Id id = slots[i];
+			if (hashes[id] == h && conditions[id] == condition) return { id, &conditions[id] };
+		}
+		Id id = Id(conditions.size());
+		assert(id != SLOT_EMPTY);
+		conditions.push_back(condition);
+		hashes.push_back(h);
+		slots[i] = id;
+		condition_bytes += condition_heap_bytes(condition);
+		return { id, &conditions.back() };
 	}
 
-	void from_json(const json& j, Candidate& p, const Types& types)
+	const Condition& ConditionRegistry::get(Id id) const
 	{
-		from_json(j.at("predicates"), p.condition, types);
-		p.table.from_json(j.at("counter"));
+		return conditions.at(id);
 	}
 
-	void StochasticEffectPredictor::test_add_pairs(const Types& types, int target_object_type, const Condition& a, const Condition& b)
+	std::size_t ConditionRegistry::size() const
 	{
-		test_add(types, target_object_type, a + b);
+		return conditions.size();
 	}
 
-	void StochasticEffectPredictor::test_add(const Types& types, int target_object_type, const Condition& cp)
+	std::vector<ConditionRegistry::Id> ConditionRegistry::sortedIds() const
 	{
-		if (observed.find(cp) == observed.end()) {
-			observed.insert(cp);
-			working.push_back(Candidate{ cp, FrequencyTable(cp.stateSize()) });
-		}
+		std::vector<Id> ids(conditions.size());
+		for (std::size_t id = 0; id < ids.size(); id++) ids[id] = Id(id);
+		std::sort(ids.begin(), ids.end(), [this](Id a, Id b) { return conditions[a] < conditions[b]; });
+		return ids;
 	}
 
-	StochasticEffectPredictor::StochasticEffectPredictor(double alpha) : alpha(alpha), baseline(1)
+	std::size_t ConditionRegistry::getMemoryUsage() const
 	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return sizeof(ConditionRegistry)
+			+ conditions.size() * sizeof(Condition)
+			+ condition_bytes
+			+ hashes.capacity() * sizeof(std::size_t)
+			+ slots.capacity() * sizeof(Id);
 	}
 
-	void StochasticEffectPredictor::observe(const Types& types, const Object& target, const std::map<int, std::set<const Object*>>& objects_by_type, const Effect& effect)
+	CompiledCondition::CompiledCondition(const Condition& condition, PredicateCache* cache)
 	{
-		int target_object_type = target.getTypeId();
-		auto target_type_obj = types.getObjectType(target_object_type);
-
-		//convert Effect to int
-		size_t effect_index = -1;
-		{
-			auto it = effect_indices.find(effect);
-			if (it != effect_indices.end()) {
-				effect_index = it->second;
+		std::size_t multiplier = 1;
+		for (const RelationGroup& group : condition.groups) {
+			assert(group.predicates.size() <= MAX_GROUP_SIZE);
+			std::size_t cases = group.stateSize();
+			std::size_t all_cases = (cases >= 64) ? ~std::size_t(0) : ((std::size_t(1) << cases) - 1);
+			int index_attribute = -1;
+			if (group.other_object_type != -1) {
+				for (const Predicate& p : group.predicates) {
+					if (!p.is_relative && p.is_target) continue;
+					if (index_attribute == -1) {
+						index_attribute = p.attribute_type;
+					}
+					else if (index_attribute != p.attribute_type) {
+						index_attribute = -1;
+						break;
+					}
+				}
 			}
-			else {
-				effect_index = effect_count++;
-				effect_indices[effect] = effect_index;
-				effects.push_back(effect);
+			groups.push_back(Group{ group.other_object_type, program.size(), group.predicates.size(), multiplier, all_cases, index_attribute });
+			for (const Predicate& p : group.predicates) {
+				Mode mode = p.is_relative ? RELATIVE : (p.is_target ? TARGET : OTHER);
+				//without an "other", only the target predicates can ever be true (see Predicate::evaluate(target))
+				if (group.other_object_type == -1 && mode != TARGET) mode = NEVER;
+				program.push_back(Instruction{ p.attribute_type, mode, p.value.size(), int(constants.size()), cache ? cache->getId(group.other_object_type, p) : -1 });
+				constants.insert(constants.end(), p.value.ptr(), p.value.ptr() + p.value.size());
 			}
+			multiplier *= group.completeStateSize();
 		}
+	}
 
-		//call observe() on baseline
-		baseline.observe(0, effect_index);
-		baseline.recalculate(alpha);
-
-		//update all hypotheses
-		for (Candidate& pc : hypotheses) {
-			Condition& predicates = pc.condition;
-			FrequencyTable& counter = pc.table;
-			//
-			std::size_t state_in = predicates.evaluate(target, objects_by_type);
-			counter.observe(state_in, effect_index);
-			counter.recalculate(alpha);
-		}
-		//'bubble up' the best counters in 'hypotheses'
-		for (int i = hypotheses.size() - 2; i > 0; i--) {
-			Candidate& a = hypotheses[i];
-			Candidate& b = hypotheses[i + 1];
-			if (b > a) std::swap(a, b); //swap the larger one up the list (larger = higher score confidence interval estimate)
+	bool CompiledCondition::matches(const Instruction& instruction, const int* values) const
+	{
+		const int* constant = constants.data() + instruction.constant;
+		for (int i = 0; i < instruction.size; i++) {
+			if (values[i] != constant[i]) return false;
 		}
-		//swap the last (first) pair
-		//if the top hypothesis is new, add pairs with it + every other hypothesis to 'current' (if they are not in 'observed')
-		if (hypotheses.size() > 1) {
-			Candidate& a = hypotheses[0];
-			Candidate& b = hypotheses[1];
-			if (b > a) {
-				//swap
-				std::swap(a, b);
-				//reset all non-hypothesis counters, including baseline, so they will be conditional on the new best
-				baseline.reset();
-				for (Candidate& pc : working) {
-					pc.table.reset();
+		return true;
+	}
+
+	inline std::size_t CompiledCondition::evaluate_other(const Group& group, std::size_t target_bits, const int* const* target_values, const Object& other) const
+	{
+		std::size_t bits = target_bits;
+		for (std::size_t i = 0; i < group.count; i++) {
+			const Instruction& instruction = program[group.first + i];
+			if (instruction.mode == OTHER) {
+				const AttributeValue& o = other.getAttribute(instruction.attribute_type);
+				if (o.size() == instruction.size && matches(instruction, o.ptr())) {
+					bits |= (std::size_t(1) << i);
 				}
-				//clear all current tracked
-				//create all pairs with other hypotheses
-				//we can skip the first, ofc
-				for (int i = 2; i < hypotheses.size(); i++) {
-					test_add_pairs(types, target_object_type, a.condition, hypotheses.at(i).condition);
+			}
+			else if (instruction.mode == RELATIVE) {
+				//other - target == constant, without building the difference
+				const AttributeValue& o = other.getAttribute(instruction.attribute_type);
+				if (o.size() != instruction.size) continue; //the difference has the size of the "other" value
+				const int* o_data = o.ptr();
+				const int* t_data = target_values[i];
+				const int* constant = constants.data() + instruction.constant;
+				bool match = true;
+				for (int j = 0; j < instruction.size && match; j++) {
+					match = (o_data[j] - t_data[j] == constant[j]);
 				}
+				if (match) bits |= (std::size_t(1) << i);
 			}
 		}
+		return bits;
+	}
 
-		//discard observations that are explained by the current best hypothesis to magnify the effect of secondary rules
-		if (hypotheses.size() > 0) {
-			Candidate& pc = hypotheses.at(0);
-			Condition& predicates = pc.condition;
-			FrequencyTable& counter = pc.table;
-			//
-			std::size_t state_in = predicates.evaluate(target, objects_by_type);
-			if (counter.confidence(state_in) == 1 && counter.predict(state_in) == effect_index) {
-				return;
+	bool CompiledCondition::evaluate_indexed(const Group& group, const Object& target, std::size_t target_bits, const int* const* target_values, ObjectSpan others, const SpatialIndex& index, std::size_t& result) const
+	{
+		//the cell named by each OTHER/RELATIVE instruction
+		std::pair<const SpatialIndex::Cell*, const SpatialIndex::Cell*> ranges[MAX_GROUP_SIZE];
+		std::size_t n_ranges = 0;
+		for (std::size_t i = 0; i < group.count; i++) {
+			const Instruction& instruction = program[group.first + i];
+			const int* constant = constants.data() + instruction.constant;
+			if (instruction.mode == RELATIVE) {
+				if (target.getAttribute(instruction.attribute_type).size() != instruction.size) return false;
+				ranges[n_ranges++] = index.find(group.other_object_type, target_values[i], constant, instruction.size);
+			}
+			else if (instruction.mode == OTHER) {
+				ranges[n_ranges++] = index.find(group.other_object_type, constant, nullptr, instruction.size);
 			}
 		}
-
-		//create a list of singleton PredicateTerms in this state; if they are not in 'observed', add them to 'observed' and create a new corresponding Candidate in 'current'
-		//add the non-paired (target-only) predicates
-		for (int attribute : target_type_obj.attribute_types) {
-			test_add(types, target_object_type, Condition{ {RelationGroup{-1, {Predicate{attribute, false, true, target.getAttribute(attribute)}} }} });
-		}
-		//for each valid pair of (target type, any other type), construct pairs
-		for (const auto& pair : objects_by_type) {
-			int other_object_type = pair.first;
-			auto& other_type_obj = types.getObjectType(other_object_type);
-			for (const Object* other : pair.second) {
-				if (other->getObjectId() == target.getObjectId()) continue; //none of that!!
-				//the pair is now (target, other)
-				for (int attribute : target_type_obj.attribute_types) {
-					if (other_type_obj.attribute_types.find(attribute) != other_type_obj.attribute_types.end()) {
-						test_add(types, target_object_type, Condition{ {RelationGroup{other_object_type, {Predicate{attribute, true, false, other->getAttribute(attribute) - target.getAttribute(attribute)}} }} });
+		//only objects in those cells can make any instruction true; every other object gets the target-only case
+		result = 0;
+		std::size_t near = 0;
+		for (std::size_t r = 0; r < n_ranges; r++) {
+			for (const SpatialIndex::Cell* cell = ranges[r].first; cell != ranges[r].second; cell++) {
+				const Object* other = cell->second;
+				if (other->getTypeId() != group.other_object_type) continue;
+				//several instructions can name the same cell, so skip objects that were already counted
+				bool seen = false;
+				for (std::size_t q = 0; q < r && !seen; q++) {
+					for (const SpatialIndex::Cell* c = ranges[q].first; c != ranges[q].second && !seen; c++) {
+						seen = (c->second == other);
 					}
 				}
-				for (int attribute : other_type_obj.attribute_types) {
-					test_add(types, target_object_type, Condition{ {RelationGroup{other_object_type, {Predicate{attribute, false, false, other->getAttribute(attribute)}} }} });
-				}
+				if (seen) continue;
+				near++;
+				result |= (std::size_t(1) << evaluate_other(group, target_bits, target_values, *other));
 			}
 		}
+		if (others.size() > near) result |= (std::size_t(1) << target_bits);
+		return true;
+	}
 
-		//go through each Candidate in 'current' and 'hypotheses' and call observe() and recalculate()
-		//if any counter in 'current' is now > baseline, move it to 'hypotheses'
-		//and generate a new compound predicate based on it + the current hypothesis, if there is one (and it isn't already in 'observed')
-		{
-			ConfidenceInterval baseline_score = baseline.getSuccessInterval();
-			auto it = working.begin();
-			auto end = working.end();
-			while (it != end) {
-				Condition& predicates = it->condition;
-				FrequencyTable& counter = it->table;
-				//
-				std::size_t state_in = predicates.evaluate(target, objects_by_type);
-				counter.observe(state_in, effect_index);
-				counter.recalculate(alpha);
-				ConfidenceInterval interval = counter.getSuccessInterval();
-				//
-				if (interval > baseline_score) {
-					//move to hypotheses
-					Candidate pc = *it;
-
-					pc.table.reset(); //since it'll now be getting more data
-					hypotheses.push_back(pc);
-					it = working.erase(it);
-					//create pair of this + best hypothesis
-					if (hypotheses.size() > 1) {
-						test_add_pairs(types, target_object_type, hypotheses.at(0).condition, pc.condition);
-					}
-					else {
-						//first hypothesis
-						//reset all non-hypothesis counters, including baseline
-						baseline.reset();
-						baseline_score = baseline.getSuccessInterval();
-						for (Candidate& pc : working) {
-							pc.table.reset();
-						}
+	std::size_t CompiledCondition::evaluate(const Object& target, const ObjectsByType& objects_by_type, const SpatialIndex* index) const
+	{
+		std::size_t value = 0;
+		for (const Group& group : groups) {
+			//the target's part of each evaluation is the same for every "other", so do it once up front
+			std::size_t target_bits = 0;
+			const int* target_values[MAX_GROUP_SIZE];
+			for (std::size_t i = 0; i < group.count; i++) {
+				const Instruction& instruction = program[group.first + i];
+				if (instruction.mode == TARGET || instruction.mode == RELATIVE) {
+					const AttributeValue& t = target.getAttribute(instruction.attribute_type);
+					target_values[i] = t.ptr();
+					if (instruction.mode == TARGET && t.size() == instruction.size && matches(instruction, t.ptr())) {
+						target_bits |= (std::size_t(1) << i);
 					}
 				}
-				else {
-					//no change, keep observing
-					++it;
+			}
+			//
+			std::size_t result = 0;
+			if (group.other_object_type == -1) {
+				result = (std::size_t(1) << target_bits);
+			}
+			else {
+				ObjectSpan others = objects_by_type.at(group.other_object_type);
+				bool indexed = index != nullptr && group.index_attribute != -1 && group.index_attribute == index->getAttributeType()
+					&& evaluate_indexed(group, target, target_bits, target_values, others, *index, result);
+				if (!indexed) {
+					for (const Object* other : others) {
+						result |= (std::size_t(1) << evaluate_other(group, target_bits, target_values, *other));
+						if (result == group.all_cases) break; //every case has been seen, so the rest can't change anything
+					}
 				}
 			}
+			value += result * group.multiplier;
 		}
+		return value;
 	}
 
-	ProbabilityDistribution<Effect> StochasticEffectPredictor::predict(const Object& target, const std::map<int, std::set<const Object*>>& objects_by_type) const
+	std::size_t CompiledCondition::evaluate(const PredicateCache& cache) const
 	{
-		ProbabilityDistribution<size_t> prediction;
-		//if there is no good hypothesis, use the baseline:
-		if (hypotheses.empty()) {
-			prediction = baseline.getConditionalDistribution(0);
-		}
-		//if there is a hypothesis, evaluate its predicates and use the counter to predict the outcome
-		else {
-			const Candidate& hypothesis = hypotheses[0];
-			prediction = hypothesis.table.getConditionalDistribution(hypothesis.condition.evaluate(target, objects_by_type));
-		}
-		//if the hypotheses were just reset, they'll all be empty, so we need to guess something
-		if (prediction.size() == 0) {
-			prediction.addProbability(0, 1.0);
-		}
-		//
-		ProbabilityDistribution<Effect> predicted_effects;
-		for (const auto& pair : prediction.getProbabilities()) {
-			predicted_effects.setProbability(effects[pair.first], pair.second);
+		std::size_t value = 0;
+		for (const Group& group : groups) {
+			int ids[MAX_GROUP_SIZE];
+			for (std::size_t i = 0; i < group.count; i++) {
+				ids[i] = program[group.first + i].predicate;
+				assert(ids[i] >= 0);
+			}
+			value += cache.evaluate_all(group.other_object_type, ids, group.count) * group.multiplier;
 		}
-		return predicted_effects;
+		return value;
 	}
 
-	const std::set<Condition>& StochasticEffectPredictor::getPredicatesObserved() const
+	std::size_t CompiledCondition::getMemoryUsage() const
 	{
-		return observed;
+		return sizeof(CompiledCondition)
+			+ groups.capacity() * sizeof(Group)
+			+ program.capacity() * sizeof(Instruction)
+			+ constants.capacity() * sizeof(int);
 	}
 
-	size_t StochasticEffectPredictor::getCountPredicatesObserved() const
+	void Candidate::observe(const Object& target, const ObjectsByType& objects_by_type, int effect, const SpatialIndex* index)
 	{
-		return observed.size();
+		std::size_t state_in = compiled->evaluate(target, objects_by_type, index);
+		table.observe(state_in, effect);
 	}
 
-	size_t StochasticEffectPredictor::getCountPredicatesTracked() const
+	void Candidate::reset(std::size_t now)
 	{
-		return working.size();
+		table.reset();
+		since = now;
+	}
+
+	std::size_t Candidate::getMemoryUsage() const
+	{
+		return sizeof(Candidate) - sizeof(FrequencyTable) + table.getMemoryUsage() + (compiled ? compiled->getMemoryUsage() : 0);
+	}
+
+	void Candidate::print(FILE* f, const Types& types, EffectType type, const std::vector<Effect>& effects) const
+	{
+		fprintf(f, "     ");
+		condition->print(f, types, type.object_type);
+		fprintf(f, "\n     ");
+		table.print(f);
+		fprintf(f, "\n");
+		//pretty-print observed cases
+		for (int input : table.getObservedInputStates()) {
+			fprintf(f, "      ");
+			condition->printCaseInfo(f, types, type.object_type, input);
+			fprintf(f, "\n       ");
+			//print distribution from counter, using actual effect values
+			std::size_t n_effects = effects.size();
+			bool needs_comma = false;
+			for (std::size_t i = 0; i < n_effects; i++) {
+				double p = table.getFrequencyConditional(input, i);
+				if (p > 0) {
+					if (needs_comma) fprintf(f, "; ");
+					fprintf(f, "%s %.2f%%", effects.at(i).to_string().c_str(), p * 100);
+					needs_comma = true;
+				}
+			}
+			fprintf(f, "\n");
+		}
+	}
+
+	bool Candidate::operator>(const Candidate& b) const
+	{
+		return table > b.table;
+	}
+
+	bool Candidate::operator<(const Candidate& b) const
+	{
+		return table < b.table;
+	}
+
+	void to_json(json& j, const Candidate& p, const Types& types)
+	{
+		j = json{};
+		to_json(j["predicates"], *p.condition, types);
+		p.table.to_json(j["counter"]);
+	}
+
+	void from_json(const json& j, Candidate& p, const Types& types, ConditionRegistry& conditions, PredicateCache& cache)
+	{
+		Condition condition;
+		from_json(j.at("predicates"), condition, types);
+		auto interned = conditions.intern(condition);
+		p.id = interned.first;
+		p.condition = interned.second;
+		p.compiled = std::make_shared<const CompiledCondition>(*p.condition, &cache);
+		p.table.from_json(j.at("counter"));
+	}
+
+	std::shared_ptr<const EvictionPolicy> EvictionPolicy::create(const std::string& name, std::size_t stale_after)
+	{
+		if (name == "none") return std::make_shared<EvictionNone>();
+		if (name == "hopeless") return std::make_shared<EvictionHopeless>();
+		if (name == "stale") return std::make_shared<EvictionStale>(stale_after);
+		return nullptr;
+	}
+
+	std::string EvictionNone::getName() const
+	{
+		return "none";
+	}
+
+	bool EvictionNone::shouldEvict(const Candidate&, const ConfidenceInterval&, std::size_t) const
+	{
+		return false;
+	}
+
+	bool EvictionNone::canEvict() const
+	{
+		return false;
+	}
+
+	double EvictionNone::priority(const Candidate& candidate, const ConfidenceInterval&, std::size_t) const
+	{
+		return candidate.table.getSuccessInterval().upper;
+	}
+
+	std::string EvictionHopeless::getName() const
+	{
+		return "hopeless";
+	}
+
+	bool EvictionHopeless::shouldEvict(const Candidate& candidate, const ConfidenceInterval& baseline, std::size_t) const
+	{
+		return candidate.table.getSuccessInterval() < baseline.lower;
+	}
+
+	bool EvictionHopeless::canEvict() const
+	{
+		return true;
+	}
+
+	EvictionStale::EvictionStale(std::size_t stale_after) : stale_after(stale_after)
+	{
+	}
+
+	std::string EvictionStale::getName() const
+	{
+		return "stale";
+	}
+
+	bool EvictionStale::shouldEvict(const Candidate& candidate, const ConfidenceInterval&, std::size_t now) const
+	{
+		return now - candidate.since >= stale_after;
+	}
+
+	bool EvictionStale::canEvict() const
+	{
+		return true;
+	}
+
+	double EvictionStale::priority(const Candidate& candidate, const ConfidenceInterval&, std::size_t now) const
+	{
+		return -double(now - candidate.since);
+	}
+
+	constexpr std::uint32_t SingletonFilter::SLOT_EMPTY;
+
+	//same component order as the Predicate the key stands for
+	static inline int singleton_component(const int* a, const int* b, int i)
+	{
+		return b ? a[i] - b[i] : a[i];
+	}
+
+	std::size_t SingletonFilter::hash(int other_object_type, int attribute_type, CompiledCondition::Mode mode, const int* a, const int* b, int size)
+	{
+		std::size_t h = hash_combine(std::size_t(other_object_type + 1), std::size_t(attribute_type) * 4 + std::size_t(mode));
+		h = hash_combine(h, std::size_t(size));
+		for (int i = 0; i < size; i++) {
+			h = hash_combine(h, std::size_t(std::uint32_t(singleton_component(a, b, i))));
+		}
+		return h;
+	}
+
+	bool SingletonFilter::equals(std::size_t key, int other_object_type, int attribute_type, CompiledCondition::Mode mode, const int* a, const int* b, int size) const
+	{
+		const int* k = keys.data() + offsets[key];
+		if (k[0] != other_object_type || k[1] != attribute_type || k[2] != int(mode) || k[3] != size) return false;
+		for (int i = 0; i < size; i++) {
+			if (k[4 + i] != singleton_component(a, b, i)) return false;
+		}
+		return true;
+	}
+
+	void SingletonFilter::rehash(std::size_t slot_count)
+	{
+		while (slot_count < hashes.size() * 2) slot_count *= 2;
+		slots.assign(slot_count, SLOT_EMPTY);
+		std::size_t mask = slot_count - 1;
+		for (std::size_t key = 0; key < hashes.size(); key++) {
+			std::size_t i = slot_hash(hashes[key], mask);
+			while (slots[i] != SLOT_EMPTY) i = (i + 1) & mask;
+			slots[i] = std::uint32_t(key);
+		}
+	}
+
+	bool SingletonFilter::insert(int other_object_type, int attribute_type, CompiledCondition::Mode mode, const int* a, const int* b, int size)
+	{
+		std::size_t h = hash(other_object_type, attribute_type, mode, a, b, size);
+		if ((hashes.size() + 1) * 2 > slots.size()) rehash(std::max<std::size_t>(64, slots.size() * 2));
+		std::size_t mask = slots.size() - 1;
+		std::size_t i = slot_hash(h, mask);
+		for (; slots[i] != SLOT_EMPTY; i = (i + 1) & mask) {
+			std::uint32_t key = slots[i];
+			if (hashes[key] == h && equals(key, other_object_type, attribute_type, mode, a, b, size)) return false;
+		}
+		slots[i] = std::uint32_t(hashes.size());
+		hashes.push_back(h);
+		offsets.push_back(keys.size());
+		keys.push_back(other_object_type);
+		keys.push_back(attribute_type);
+		keys.push_back(int(mode));
+		keys.push_back(size);
+		for (int c = 0; c < size; c++) keys.push_back(singleton_component(a, b, c));
+		return true;
+	}
+
+	void SingletonFilter::clear()
+	{
+		keys.clear();
+		offsets.clear();
+		hashes.clear();
+		slots.clear();
+	}
+
+	std::size_t SingletonFilter::size() const
+	{
+		return hashes.size();
+	}
+
+	std::size_t SingletonFilter::getMemoryUsage() const
+	{
+		return sizeof(SingletonFilter)
+			+ keys.capacity() * sizeof(int)
+			+ offsets.capacity() * sizeof(std::size_t)
+			+ hashes.capacity() * sizeof(std::size_t)
+			+ slots.capacity() * sizeof(std::uint32_t);
+	}
+
+	void StochasticEffectPredictor::test_add_pairs(const Types& types, int target_object_type, const Condition& a, const Condition& b)
+	{
+		test_add(types, target_object_type, a + b);
+	}
+
+	void StochasticEffectPredictor::test_add(const Types& types, int target_object_type, const Condition& cp)
+	{
+		auto interned = conditions->intern(cp);
+		ConditionRegistry::Id id = interned.first;
+		if (id >= observed.size()) observed.resize(id + 1, false);
+		if (!observed[id]) {
+			observed[id] = true;
+			observed_count++;
+			working.push_back(Candidate{ id, interned.second, std::make_shared<const CompiledCondition>(*interned.second, &cache), FrequencyTable(cp.stateSize()) });
+			working.back().since = observation_count;
+			working_changed = true;
+			added_count++;
+		}
+	}
+
+	StochasticEffectPredictor::StochasticEffectPredictor(double alpha, std::shared_ptr<ConditionRegistry> conditions) : alpha(alpha), conditions(conditions), baseline(1)
+	{
+		if (!this->conditions) this->conditions = std::make_shared<ConditionRegistry>();
+		eviction = EvictionPolicy::create("none");
+	}
+
+	void StochasticEffectPredictor::evict()
+	{
+		if (!eviction->canEvict() && memory_budget == 0) return;
+		ConfidenceInterval baseline_score = baseline.getSuccessInterval();
+		std::size_t kept = 0;
+		for (std::size_t i = 0; i < working.size(); i++) {
+			if (eviction->shouldEvict(working[i], baseline_score, observation_count)) {
+				cache.release(*working[i].compiled);
+				evicted++;
+				continue;
+			}
+			if (kept != i) working[kept] = std::move(working[i]);
+			kept++;
+		}
+		if (kept != working.size()) working_changed = true;
+		working.erase(working.begin() + kept, working.end());
+		//
+		if (memory_budget > 0) shrink(memory_budget);
+	}
+
+	void StochasticEffectPredictor::observe(const Types& types, const Object& target, const ObjectsByType& objects_by_type, const Effect& effect, ThreadPool* pool, const SpatialIndex* index)
+	{
+		int target_object_type = target.getTypeId();
+		const ObjectType& target_type_obj = types.getObjectType(target_object_type);
+
+		//convert Effect to int
+		size_t effect_index = -1;
+		{
+			auto it = effect_indices.find(effect);
+			if (it != effect_indices.end()) {
+				effect_index = it->second;
+			}
+			else {
+				effect_index = effect_count++;
+				effect_indices[effect] = effect_index;
+				effects.push_back(effect);
+			}
+		}
+
+		//the candidates read their predicates' results from the cache, which evaluates each one at most once for this target
+		cache.begin(target, objects_by_type, index);
+
+		//call observe() on baseline
+		baseline.observe(0, effect_index);
+		baseline.recalculate(alpha);
+
+		//update all hypotheses
+		for (Candidate& pc : hypotheses) {
+			const CompiledCondition& predicates = *pc.compiled;
+			FrequencyTable& counter = pc.table;
+			//
+			cache.update(predicates);
+			std::size_t state_in = predicates.evaluate(cache);
+			counter.observe(state_in, effect_index);
+			counter.recalculate(alpha);
+		}
+		//'bubble up' the best counters in 'hypotheses'
+		for (int i = hypotheses.size() - 2; i > 0; i--) {
+			Candidate& a = hypotheses[i];
+			Candidate& b = hypotheses[i + 1];
+			if (b > a) std::swap(a, b); //swap the larger one up the list (larger = higher score confidence interval estimate)
+		}
+		//swap the last (first) pair
+		//if the top hypothesis is new, add pairs with it + every other hypothesis to 'current' (if they are not in 'observed')
+		bool new_best = false;
+		if (hypotheses.size() > 1) {
+			Candidate& a = hypotheses[0];
+			Candidate& b = hypotheses[1];
+			if (b > a) {
+				//swap
+				std::swap(a, b);
+				new_best = true;
+				//reset all non-hypothesis counters, including baseline, so they will be conditional on the new best
+				baseline.reset();
+				for (Candidate& pc : working) {
+					pc.reset(observation_count);
+				}
+				working_changed = true;
+				//clear all current tracked
+				//create all pairs with other hypotheses
+				//we can skip the first, ofc
+				for (int i = 2; i < hypotheses.size(); i++) {
+					test_add_pairs(types, target_object_type, *a.condition, *hypotheses.at(i).condition);
+				}
+			}
+		}
+
+		//discard observations that are explained by the current best hypothesis to magnify the effect of secondary rules
+		if (hypotheses.size() > 0) {
+			Candidate& pc = hypotheses.at(0);
+			const CompiledCondition& predicates = *pc.compiled;
+			FrequencyTable& counter = pc.table;
+			//
+			cache.update(predicates);
+			std::size_t state_in = predicates.evaluate(cache);
+			if (counter.confidence(state_in) == 1 && counter.predict(state_in) == effect_index) {
+				//the working set isn't observed, so it only needs checking if a new best hypothesis just reset it and added pairs to it
+				if (new_best) evict();
+				return;
+			}
+		}
+
+		//create a list of singleton PredicateTerms in this state; if they are not in 'observed', add them to 'observed' and create a new corresponding Candidate in 'current'
+		//the filter skips the ones this predictor has generated before straight from the attribute values, so a Condition is only built for new ones
+		//add the non-paired (target-only) predicates
+		for (int attribute : target_type_obj.attribute_types) {
+			const AttributeValue& t = target.getAttribute(attribute);
+			if (!singletons.insert(-1, attribute, CompiledCondition::TARGET, t.ptr(), nullptr, t.size())) continue;
+			test_add(types, target_object_type, Condition{ {RelationGroup{-1, {Predicate{attribute, false, true, t}} }} });
+		}
+		//for each valid pair of (target type, any other type), construct pairs
+		for (int other_object_type = 0; other_object_type < objects_by_type.getTypeCount(); other_object_type++) {
+			ObjectSpan others = objects_by_type.at(other_object_type);
+			if (others.empty()) continue;
+			auto& other_type_obj = types.getObjectType(other_object_type);
+			for (const Object* other : others) {
+				if (other->getObjectId() == target.getObjectId()) continue; //none of that!!
+				//the pair is now (target, other)
+				for (int attribute : target_type_obj.attribute_types) {
+					if (other_type_obj.attribute_types.find(attribute) != other_type_obj.attribute_types.end()) {
+						const AttributeValue& o = other->getAttribute(attribute);
+						const AttributeValue& t = target.getAttribute(attribute);
+						if (!singletons.insert(other_object_type, attribute, CompiledCondition::RELATIVE, o.ptr(), t.ptr(), o.size())) continue;
+						test_add(types, target_object_type, Condition{ {RelationGroup{other_object_type, {Predicate{attribute, true, false, o - t}} }} });
+					}
+				}
+				for (int attribute : other_type_obj.attribute_types) {
+					const AttributeValue& o = other->getAttribute(attribute);
+					if (!singletons.insert(other_object_type, attribute, CompiledCondition::OTHER, o.ptr(), nullptr, o.size())) continue;
+					test_add(types, target_object_type, Condition{ {RelationGroup{other_object_type, {Predicate{attribute, false, false, o}} }} });
+				}
+			}
+		}
+
+		observation_count++; //only observations that reach the working set count towards staleness
+
+		//go through each Candidate in 'current' and 'hypotheses' and call observe() and recalculate()
+		//if any counter in 'current' is now > baseline, move it to 'hypotheses'
+		//and generate a new compound predicate based on it + the current hypothesis, if there is one (and it isn't already in 'observed')
+		//the candidates don't depend on each other, so they are observed in parallel (if there is a pool);
+		//the promotions are then applied serially, in working set order, so the result is the same as a single pass over the list
+		{
+			ConfidenceInterval baseline_score = baseline.getSuccessInterval();
+			std::vector<std::size_t> states_in(working.size()); //input state of each candidate for this observation
+			std::vector<char> promoted(working.size(), 0); //char, not bool, so the threads can write to neighboring elements
+			std::size_t begin = 0;
+			bool finished = false;
+			//pairs added by promotions are observed in the next round, the same as if they had been appended to the list mid-pass
+			while (!finished && begin < working.size()) {
+				std::size_t end = working.size();
+				states_in.resize(end);
+				promoted.resize(end, 0);
+				cache.update(); //everything the working set needs, so the candidates only read from it
+				auto observe_range = [&](std::size_t range_begin, std::size_t range_end) {
+					for (std::size_t i = begin + range_begin; i < begin + range_end; i++) {
+						const CompiledCondition& predicates = *working[i].compiled;
+						FrequencyTable& counter = working[i].table;
+						//
+						std::size_t state_in = predicates.evaluate(cache);
+						counter.observe(state_in, effect_index);
+						counter.recalculate(alpha);
+						states_in[i] = state_in;
+						promoted[i] = counter.getSuccessInterval() > baseline_score;
+					}
+				};
+				if (pool) {
+					pool->parallel_for(end - begin, OBSERVE_GRAIN, observe_range);
+				}
+				else {
+					observe_range(0, end - begin);
+				}
+				//apply the promotions in order
+				bool reset = false;
+				for (std::size_t i = begin; i < end; i++) {
+					if (reset) {
+						//the first hypothesis reset every counter, so the rest of this round needs to see this observation again, on its fresh table
+						FrequencyTable& counter = working[i].table;
+						counter.observe(states_in[i], effect_index);
+						counter.recalculate(alpha);
+						promoted[i] = counter.getSuccessInterval() > baseline_score;
+					}
+					if (!promoted[i]) continue;
+					//when the last candidate in the list gets promoted, the pass is over, so the pair it adds below waits until the next observation
+					if (i + 1 == working.size()) finished = true;
+					//move to hypotheses
+					Candidate pc = std::move(working[i]);
+
+					pc.reset(observation_count); //since it'll now be getting more data
+					hypotheses.push_back(pc);
+					promoted_count++;
+					//create pair of this + best hypothesis
+					if (hypotheses.size() > 1) {
+						test_add_pairs(types, target_object_type, *hypotheses.at(0).condition, *pc.condition);
+					}
+					else {
+						//first hypothesis
+						//reset all non-hypothesis counters, including baseline
+						baseline.reset();
+						baseline_score = baseline.getSuccessInterval();
+						for (Candidate& pc : working) {
+							pc.reset(observation_count);
+						}
+						reset = true;
+					}
+				}
+				begin = end;
+			}
+			//remove the promoted candidates from the working set, keeping the rest in order
+			promoted.resize(working.size(), 0);
+			std::size_t kept = 0;
+			for (std::size_t i = 0; i < working.size(); i++) {
+				if (promoted[i]) continue;
+				if (kept != i) working[kept] = std::move(working[i]);
+				kept++;
+			}
+			working.erase(working.begin() + kept, working.end());
+			working_changed = true;
+		}
+
+		evict();
+	}
+
+	ProbabilityDistribution<Effect> predict_effects(const FrequencyTable& table, std::size_t state_in, const std::vector<Effect>& effects)
+	{
+		ProbabilityDistribution<size_t> prediction = table.getConditionalDistribution(state_in);
+		//if the hypotheses were just reset, they'll all be empty, so we need to guess something
+		if (prediction.size() == 0) {
+			prediction.addProbability(0, 1.0);
+		}
+		//
+		ProbabilityDistribution<Effect> predicted_effects;
+		for (const auto& pair : prediction.getProbabilities()) {
+			predicted_effects.setProbability(effects[pair.first], pair.second);
+		}
+		return predicted_effects;
+	}
+
+	ProbabilityDistribution<Effect> StochasticEffectPredictor::predict(const Object& target, const ObjectsByType& objects_by_type, const SpatialIndex* index) const
+	{
+		//if there is no good hypothesis, use the baseline:
+		if (hypotheses.empty()) {
+			return predict_effects(baseline, 0, effects);
+		}
+		//if there is a hypothesis, evaluate its predicates and use the counter to predict the outcome
+		const Candidate& hypothesis = hypotheses[0];
+		return predict_effects(hypothesis.table, hypothesis.compiled->evaluate(target, objects_by_type, index), effects);
+	}
+
+	std::shared_ptr<const PredictorSnapshot> StochasticEffectPredictor::snapshot() const
+	{
+		if (hypotheses.empty()) {
+			return std::make_shared<const PredictorSnapshot>(PredictorSnapshot{ nullptr, baseline, effects });
+		}
+		return std::make_shared<const PredictorSnapshot>(PredictorSnapshot{ hypotheses[0].compiled, hypotheses[0].table, effects });
+	}
+
+	FrozenPredictor StochasticEffectPredictor::freeze() const
+	{
+		if (hypotheses.empty()) {
+			return FrozenPredictor(nullptr, baseline, effects);
+		}
+		return FrozenPredictor(hypotheses[0].condition, hypotheses[0].table, effects);
+	}
+
+	ProbabilityDistribution<Effect> PredictorSnapshot::predict(const Object& target, const ObjectsByType& objects_by_type, const SpatialIndex* index) const
+	{
+		return predict_effects(table, condition ? condition->evaluate(target, objects_by_type, index) : 0, effects);
+	}
+
+	size_t StochasticEffectPredictor::getCountPredicatesObserved() const
+	{
+		return observed_count;
+	}
+
+	size_t StochasticEffectPredictor::getCountPredicatesTracked() const
+	{
+		return working.size();
 	}
 
 	size_t StochasticEffectPredictor::getCountHypothesesTracked() const
@@ -614,59 +1415,333 @@ namespace l_qora {
 		return hypotheses.size();
 	}
 
+	void StochasticEffectPredictor::setEviction(std::shared_ptr<const EvictionPolicy> policy, std::size_t memory_budget)
+	{
+		eviction = policy ? policy : EvictionPolicy::create("none");
+		this->memory_budget = memory_budget;
+	}
+
+	std::size_t StochasticEffectPredictor::getCountEvicted() const
+	{
+		return evicted;
+	}
+
+	std::size_t StochasticEffectPredictor::getMemoryUsage() const
+	{
+		std::size_t usage = sizeof(StochasticEffectPredictor) + observed.capacity() / 8 + baseline.getMemoryUsage() - sizeof(FrequencyTable);
+		usage += getWorkingMemoryUsage();
+		for (const Candidate& pc : hypotheses) usage += pc.getMemoryUsage();
+		usage += (hypotheses.capacity() - hypotheses.size()) * sizeof(Candidate);
+		usage += effects.size() * (sizeof(Effect) + 4 * sizeof(void*) + sizeof(std::pair<Effect, size_t>)); //'effects' + 'effect_indices'
+		usage += singletons.getMemoryUsage() - sizeof(SingletonFilter);
+		usage += cache.getMemoryUsage() - sizeof(PredicateCache);
+		return usage;
+	}
+
+	std::size_t StochasticEffectPredictor::getWorkingMemoryUsage() const
+	{
+		if (working_changed) {
+			working_bytes = (working.capacity() - working.size()) * sizeof(Candidate);
+			for (const Candidate& pc : working) working_bytes += pc.getMemoryUsage();
+			working_changed = false;
+		}
+		return working_bytes;
+	}
+
+	std::size_t StochasticEffectPredictor::shrink(std::size_t budget)
+	{
+		std::size_t usage = getWorkingMemoryUsage();
+		if (usage <= budget) return 0;
+		//drop the lowest priority candidates first, keeping the rest in order
+		ConfidenceInterval baseline_score = baseline.getSuccessInterval();
+		std::vector<std::pair<double, std::size_t>> order; //priority, index
+		order.reserve(working.size());
+		for (std::size_t i = 0; i < working.size(); i++) {
+			order.push_back({ eviction->priority(working[i], baseline_score, observation_count), i });
+		}
+		std::sort(order.begin(), order.end());
+		std::vector<char> dropped(working.size(), 0);
+		std::size_t count = 0;
+		for (const auto& pair : order) {
+			if (usage <= budget) break;
+			std::size_t candidate_usage = working[pair.second].getMemoryUsage();
+			usage -= std::min(usage, candidate_usage);
+			dropped[pair.second] = 1;
+			count++;
+		}
+		std::size_t kept = 0;
+		for (std::size_t i = 0; i < working.size(); i++) {
+			if (dropped[i]) {
+				cache.release(*working[i].compiled);
+				continue;
+			}
+			if (kept != i) working[kept] = std::move(working[i]);
+			kept++;
+		}
+		working.erase(working.begin() + kept, working.end());
+		working.shrink_to_fit();
+		working_changed = true;
+		evicted += count;
+		return count;
+	}
+
+	void StochasticEffectPredictor::addObserveTime(std::size_t observations, INT64 time)
+	{
+		observe_count += observations;
+		observe_time += time;
+	}
+
+	void StochasticEffectPredictor::addPredictTime(std::size_t predictions, INT64 time)
+	{
+		predict_count += predictions;
+		predict_time += time;
+	}
+
+	PredictorStats StochasticEffectPredictor::getStats() const
+	{
+		PredictorStats stats;
+		stats.bytes = getMemoryUsage();
+		stats.bytes_observed = observed.capacity() / 8 + singletons.getMemoryUsage() - sizeof(SingletonFilter);
+		stats.bytes_working = (working.capacity() - working.size()) * sizeof(Candidate);
+		stats.bytes_hypotheses = (hypotheses.capacity() - hypotheses.size()) * sizeof(Candidate);
+		stats.bytes_tables = baseline.getMemoryUsage();
+		for (const Candidate& pc : working) {
+			stats.bytes_working += pc.getMemoryUsage();
+			stats.bytes_tables += pc.table.getMemoryUsage();
+		}
+		for (const Candidate& pc : hypotheses) {
+			stats.bytes_hypotheses += pc.getMemoryUsage();
+			stats.bytes_tables += pc.table.getMemoryUsage();
+		}
+		stats.observed = observed_count;
+		stats.working = working.size();
+		stats.hypotheses = hypotheses.size();
+		stats.observations = observe_count;
+		stats.observe_time = observe_time;
+		stats.predictions = predict_count;
+		stats.predict_time = predict_time;
+		stats.added = added_count;
+		stats.promoted = promoted_count;
+		stats.evicted = evicted;
+		return stats;
+	}
+
+	void to_json(json& j, const PredictorStats& p)
+	{
+		j = json{
+			{"bytes", {
+				{"total", p.bytes},
+				{"observed", p.bytes_observed},
+				{"working", p.bytes_working},
+				{"hypotheses", p.bytes_hypotheses},
+				{"tables", p.bytes_tables}
+			}},
+			{"observed", p.observed},
+			{"working", p.working},
+			{"hypotheses", p.hypotheses},
+			{"observations", p.observations},
+			{"observe_ms", QPC_TO_MS(p.observe_time)},
+			{"predictions", p.predictions},
+			{"predict_ms", QPC_TO_MS(p.predict_time)},
+			{"added", p.added},
+			{"promoted", p.promoted},
+			{"evicted", p.evicted}
+		};
+	}
+
 	void StochasticEffectPredictor::print(FILE* f, const Types& types, EffectType type) const
 	{
 
 		//print out the effect list
 		fprintf(f, "   Effects:\n");
-		for (int i = 0; i < effects.size(); i++) {
-			fprintf(f, "    [%d] %s\n", i, effects.at(i).to_string().c_str());
+		for (std::size_t i = 0; i < effects.size(); i++) {
+			fprintf(f, "    [%zu] %s\n", i, effects.at(i).to_string().c_str());
 		}
 
 		//print out the hypotheses' predicate sets
 		if (hypotheses.size() > 0) {
 			fprintf(f, "   Hypotheses: %zu\n", hypotheses.size());
-			for (int i = 0; i < std::min(hypotheses.size(), 3LLU); i++) {
-				fprintf(f, "    [%d]\n", i);
+			for (std::size_t i = 0; i < std::min<std::size_t>(hypotheses.size(), 3); i++) {
+				fprintf(f, "    [%zu]\n", i);
 				hypotheses.at(i).print(f, types, type, effects);
 			}
 		}
-		else {
-			fprintf(f, "   Hypotheses: none\n");
-		}
+		else {
+			fprintf(f, "   Hypotheses: none\n");
+		}
+
+		fprintf(f, "   Observed: %zu\n", observed_count);
+		fprintf(f, "   Working set: %zu\n", working.size());
+		fprintf(f, "   Evicted: %zu\n", evicted);
+		fprintf(f, "   Memory: %zu bytes\n", getMemoryUsage());
+
+		//print out the baseline
+		fprintf(f, "   Baseline:\n");
+		fprintf(f, "    ");
+		baseline.print(f);
+		fprintf(f, "\n     ");
+		//print distribution from counter, using actual effect values
+		{
+			std::size_t n_effects = effects.size();
+			bool needs_comma = false;
+			for (std::size_t i = 0; i < n_effects; i++) {
+				double p = baseline.getFrequencyConditional(0, i);
+				//if (p > 0) {
+					if (needs_comma) fprintf(f, "; ");
+					fprintf(f, "%s %.2f%%", effects.at(i).to_string().c_str(), p * 100);
+					needs_comma = true;
+				//}
+			}
+		}
+		fprintf(f, "\n");
+	}
+
+	//binary model helpers
+	void write_binary_types(BinaryWriter& out, const Types& types)
+	{
+		//object type, attribute type and action names, in id order
+		out.writeVarint(types.getObjectTypes().size());
+		for (const ObjectType& type : types.getObjectTypes()) out.writeString(type.name);
+		out.writeVarint(types.getAttributeTypes().size());
+		for (const AttributeType& type : types.getAttributeTypes()) out.writeString(type.name);
+		out.writeVarint(types.getActions().size());
+		for (const Action& action : types.getActions()) out.writeString(action.name);
+	}
+
+	BinaryTypes read_binary_types(BinaryReader& in, const Types& types)
+	{
+		BinaryTypes ids;
+		std::uint64_t n = in.readVarint();
+		for (std::uint64_t i = 0; i < n && in.ok(); i++) ids.object_types.push_back(types.getObjectType(in.readString()).id);
+		n = in.readVarint();
+		for (std::uint64_t i = 0; i < n && in.ok(); i++) ids.attribute_types.push_back(types.getAttributeType(in.readString()).id);
+		n = in.readVarint();
+		for (std::uint64_t i = 0; i < n && in.ok(); i++) ids.actions.push_back(types.getActionByName(in.readString()));
+		return ids;
+	}
+
+	void write_key(BinaryWriter& out, const std::pair<EffectType, ActionId>& key)
+	{
+		out.writeVarint(key.first.object_type);
+		out.writeVarint(key.first.attribute_type);
+		out.writeVarint(key.second);
+	}
+
+	std::pair<EffectType, ActionId> read_key(BinaryReader& in, const BinaryTypes& ids)
+	{
+		EffectType e_type;
+		e_type.object_type = binary_lookup(in, ids.object_types);
+		e_type.attribute_type = binary_lookup(in, ids.attribute_types);
+		ActionId action = binary_lookup(in, ids.actions);
+		return { e_type, action };
+	}
+
+	void write_value(BinaryWriter& out, const AttributeValue& value)
+	{
+		out.writeVarint(value.size());
+		for (int i = 0; i < value.size(); i++) out.writeSigned(value[i]);
+	}
+
+	AttributeValue read_value(BinaryReader& in)
+	{
+		std::uint64_t size = in.readVarint();
+		if (size > in.remaining()) { //every component takes at least a byte
+			in.fail();
+			return AttributeValue();
+		}
+		AttributeValue value(static_cast<int>(size));
+		for (int i = 0; i < value.size(); i++) value[i] = int(in.readSigned());
+		return value;
+	}
+
+	void write_condition(BinaryWriter& out, const Condition& condition)
+	{
+		out.writeVarint(condition.groups.size());
+		for (const RelationGroup& group : condition.groups) {
+			out.writeVarint(group.other_object_type + 1); //0 = target only
+			out.writeVarint(group.predicates.size());
+			for (const Predicate& p : group.predicates) {
+				out.writeVarint(p.attribute_type);
+				out.writeVarint((p.is_relative ? 1 : 0) | (p.is_target ? 2 : 0));
+				write_value(out, p.value);
+			}
+		}
+	}
+
+	Condition read_condition(BinaryReader& in, const BinaryTypes& ids)
+	{
+		Condition condition;
+		std::uint64_t groups = in.readVarint();
+		for (std::uint64_t g = 0; g < groups && in.ok(); g++) {
+			RelationGroup group;
+			std::uint64_t other = in.readVarint();
+			if (other > ids.object_types.size()) in.fail();
+			group.other_object_type = (other == 0 || !in.ok()) ? -1 : ids.object_types[std::size_t(other - 1)];
+			std::uint64_t predicates = in.readVarint();
+			for (std::uint64_t i = 0; i < predicates && in.ok(); i++) {
+				Predicate p;
+				p.attribute_type = binary_lookup(in, ids.attribute_types);
+				std::uint64_t flags = in.readVarint();
+				p.is_relative = (flags & 1) != 0;
+				p.is_target = (flags & 2) != 0;
+				p.value = read_value(in);
+				group.predicates.insert(p);
+			}
+			condition.groups.insert(group);
+		}
+		return condition;
+	}
 
-		fprintf(f, "   Observed: %zu\n", observed.size());
-		fprintf(f, "   Working set: %zu\n", working.size());
+	//what from_binary keeps of a binary model, so each predictor can be read from it on first use
+	//data, ids and condition_offsets never change once from_binary has filled them in, so snapshots read the predictors they need from them too
+	struct LazyModel {
+		struct Pending {
+			std::size_t offset; //in data
+			std::size_t size;
+			bool partial; //loaded for prediction only; still needed if the predictor is used for learning
+		};
+		std::string data; //everything after the observed effects
+		BinaryTypes ids;
+		std::vector<std::size_t> condition_offsets; //where each condition starts in data, plus where the last one ends
+		std::vector<ConditionRegistry::Id> condition_ids; //id in the file -> id in the registry, or NOT_LOADED
+		std::map<std::pair<EffectType, ActionId>, Pending> pending; //predictors that haven't been fully loaded yet
+		//
+		constexpr static ConditionRegistry::Id NOT_LOADED = ~ConditionRegistry::Id(0);
+	};
 
-		//print out the baseline
-		fprintf(f, "   Baseline:\n");
-		fprintf(f, "    ");
-		baseline.print(f);
-		fprintf(f, "\n     ");
-		//print distribution from counter, using actual effect values
-		{
-			std::size_t n_effects = effects.size();
-			bool needs_comma = false;
-			for (std::size_t i = 0; i < n_effects; i++) {
-				double p = baseline.getFrequencyConditional(0, i);
-				//if (p > 0) {
-					if (needs_comma) fprintf(f, "; ");
-					fprintf(f, "%s %.2f%%", effects.at(i).to_string().c_str(), p * 100);
-					needs_comma = true;
-				//}
-			}
+	constexpr ConditionRegistry::Id LazyModel::NOT_LOADED;
+
+	//the registry id of a condition in a lazy model, interning it the first time it's asked for; false if the id or the condition is invalid
+	static bool lazy_condition(LazyModel& model, ConditionRegistry& conditions, std::uint64_t file_id, ConditionRegistry::Id& id)
+	{
+		if (file_id >= model.condition_ids.size()) return false;
+		ConditionRegistry::Id& loaded = model.condition_ids[std::size_t(file_id)];
+		if (loaded == LazyModel::NOT_LOADED) {
+			std::size_t offset = model.condition_offsets[std::size_t(file_id)];
+			BinaryReader in(model.data.data() + offset, model.condition_offsets[std::size_t(file_id) + 1] - offset);
+			Condition condition = read_condition(in, model.ids);
+			if (!in.ok()) return false;
+			loaded = conditions.intern(condition).first;
 		}
-		fprintf(f, "\n");
+		id = loaded;
+		return true;
 	}
 
 	json StochasticEffectPredictor::to_json(const Types& types) const
 	{
 		json j;
 		//std::set<CompoundPredicate> observed; //all CompoundPredicates ever used, so they don't get repeated
+		//written in sorted order, the same as the set it used to be
+		std::vector<const Condition*> observed_conditions;
+		observed_conditions.reserve(observed_count);
+		for (std::size_t id = 0; id < observed.size(); id++) {
+			if (observed[id]) observed_conditions.push_back(&conditions->get(ConditionRegistry::Id(id)));
+		}
+		std::sort(observed_conditions.begin(), observed_conditions.end(), [](const Condition* a, const Condition* b) { return *a < *b; });
 		json& j_observed = j["observed"];
-		for (const Condition& cp : observed) {
+		for (const Condition* cp : observed_conditions) {
 			j_observed.push_back(json{});
-			l_qora::to_json(j_observed.back(), cp, types);
+			l_qora::to_json(j_observed.back(), *cp, types);
 		}
 		//std::list<PredicateCounter> current; //current list of predicates that are being tested (some will eventually go to hypotheses)
 		json& j_current = j["current"];
@@ -686,32 +1761,44 @@ namespace l_qora {
 		//std::map<Effect, int> effect_indices; //Effect -> int mapping
 		//std::vector<Effect> effects; //int -> Effect mapping
 		j["effects"] = effects;
+		//eviction stats (informational)
+		j["evicted"] = evicted;
+		j["memory"] = getMemoryUsage();
 		//
 		return j;
 	}
 
 	void StochasticEffectPredictor::from_json(const Types& types, const json& j)
 	{
+		cache = PredicateCache();
+		working_changed = true;
+		singletons.clear(); //refilled as the loaded conditions come up again
 		//std::set<CompoundPredicate> observed; //all CompoundPredicates ever used, so they don't get repeated
 		observed.clear();
+		observed_count = 0;
 		for (const json& j_ : j.at("observed")) {
 			Condition cp;
 			l_qora::from_json(j_, cp, types);
-			observed.insert(cp);
+			ConditionRegistry::Id id = conditions->intern(cp).first;
+			if (id >= observed.size()) observed.resize(id + 1, false);
+			if (!observed[id]) {
+				observed[id] = true;
+				observed_count++;
+			}
 		}
 		//std::list<PredicateCounter> current; //current list of predicates that are being tested (some will eventually go to hypotheses)
 		working.clear();
 		for (const json& j_ : j.at("current")) {
-			Candidate cp{Condition(), FrequencyTable(1)};
-			l_qora::from_json(j_, cp, types);
+			Candidate cp{ 0, nullptr, nullptr, FrequencyTable(1) };
+			l_qora::from_json(j_, cp, types, *conditions, cache);
 			cp.table.recalculate(alpha);
 			working.push_back(cp);
 		}
 		//std::vector<PredicateCounter> hypotheses; //list of predicates that given more information than baseline/random guess, kept in approximately sorted order (s.t. the first element is always the "best")
 		hypotheses.clear();
 		for (const json& j_ : j.at("hypotheses")) {
-			Candidate cp{ Condition(), FrequencyTable(1) };
-			l_qora::from_json(j_, cp, types);
+			Candidate cp{ 0, nullptr, nullptr, FrequencyTable(1) };
+			l_qora::from_json(j_, cp, types, *conditions, cache);
 			cp.table.recalculate(alpha);
 			hypotheses.push_back(cp);
 		}
@@ -722,15 +1809,192 @@ namespace l_qora {
 		//std::map<Effect, int> effect_indices; //Effect -> int mapping
 		//std::vector<Effect> effects; //int -> Effect mapping
 		effects = j.at("effects").get<std::vector<Effect>>();
+		evicted = j.contains("evicted") ? j.at("evicted").get<std::size_t>() : 0;
+		added_count = 0;
+		promoted_count = 0;
+		observation_count = 0;
 		effect_count = effects.size();
 		for (int i = 0; i < effect_count; i++) {
 			effect_indices[effects[i]] = i;
 		}
 	}
 
-	LearnerQORA::LearnerQORA(const Types& types, double alpha) :
-		Learner("qora", types), alpha(alpha)
+	void StochasticEffectPredictor::to_binary(BinaryWriter& out, const std::vector<std::uint64_t>& file_ids) const
+	{
+		//what prediction needs first: effects, baseline, hypotheses (condition id + table)
+		out.writeVarint(effects.size());
+		for (const Effect& e : effects) write_value(out, e);
+		baseline.to_binary(out);
+		for (const std::vector<Candidate>* list : { &hypotheses, &working }) {
+			out.writeVarint(list->size());
+			for (const Candidate& pc : *list) {
+				out.writeVarint(file_ids[pc.id]);
+				pc.table.to_binary(out);
+			}
+		}
+		//observed: the file ids in increasing order, each as the difference from the one before
+		std::vector<std::uint64_t> observed_ids;
+		observed_ids.reserve(observed_count);
+		for (std::size_t id = 0; id < observed.size(); id++) {
+			if (observed[id]) observed_ids.push_back(file_ids[id]);
+		}
+		std::sort(observed_ids.begin(), observed_ids.end());
+		out.writeVarint(observed_ids.size());
+		std::uint64_t last = 0;
+		for (std::uint64_t id : observed_ids) {
+			out.writeVarint(id - last);
+			last = id;
+		}
+		out.writeVarint(evicted);
+	}
+
+	void StochasticEffectPredictor::from_binary(BinaryReader& in, const std::function<bool(std::uint64_t, ConditionRegistry::Id&)>& condition_id, bool predict_only)
+	{
+		cache = PredicateCache();
+		working_changed = true;
+		singletons.clear();
+		observed.clear();
+		observed_count = 0;
+		working.clear();
+		hypotheses.clear();
+		effects.clear();
+		std::uint64_t n_effects = in.readVarint();
+		for (std::uint64_t i = 0; i < n_effects && in.ok(); i++) {
+			effects.push_back(read_value(in));
+		}
+		observation_count = 0;
+		effect_count = int(effects.size());
+		effect_indices.clear();
+		for (int i = 0; i < effect_count; i++) {
+			effect_indices[effects[i]] = i;
+		}
+		baseline.from_binary(in);
+		baseline.recalculate(alpha);
+		for (std::vector<Candidate>* list : { &hypotheses, &working }) {
+			std::uint64_t n = in.readVarint();
+			//predict only looks at the top hypothesis
+			if (predict_only) n = std::min<std::uint64_t>(n, 1);
+			for (std::uint64_t i = 0; i < n && in.ok(); i++) {
+				ConditionRegistry::Id id;
+				if (!condition_id(in.readVarint(), id)) in.fail();
+				if (!in.ok()) break;
+				const Condition& condition = conditions->get(id);
+				Candidate cp{ id, &condition, std::make_shared<const CompiledCondition>(condition, &cache), FrequencyTable(1) };
+				cp.table.from_binary(in);
+				cp.table.recalculate(alpha);
+				list->push_back(cp);
+			}
+			if (predict_only) break;
+		}
+		evicted = 0;
+		added_count = 0;
+		promoted_count = 0;
+		if (predict_only) return;
+		std::uint64_t n_observed = in.readVarint();
+		std::uint64_t file_id = 0;
+		for (std::uint64_t i = 0; i < n_observed && in.ok(); i++) {
+			file_id += in.readVarint();
+			ConditionRegistry::Id id;
+			if (!condition_id(file_id, id)) {
+				in.fail();
+				break;
+			}
+			if (id >= observed.size()) observed.resize(id + 1, false);
+			if (!observed[id]) {
+				observed[id] = true;
+				observed_count++;
+			}
+		}
+		evicted = std::size_t(in.readVarint());
+	}
+
+	ModelSnapshot::ModelSnapshot(std::shared_ptr<const Types> types, int index_attribute, std::uint64_t epoch, std::map<std::pair<EffectType, ActionId>, std::set<Effect>> effects_observed, std::map<std::pair<EffectType, ActionId>, std::shared_ptr<const PredictorSnapshot>> predictors,
+		double alpha, std::shared_ptr<const LazyModel> lazy) :
+		types(types), index_attribute(index_attribute), epoch(epoch), effects_observed(std::move(effects_observed)), predictors(std::move(predictors)), alpha(alpha), lazy(lazy)
+	{
+		if (!lazy) return;
+		//the learner's partially loaded predictors are already in 'predictors'
+		for (const auto& pair : lazy->pending) {
+			if (this->predictors.find(pair.first) != this->predictors.end()) continue;
+			PendingPredictor& p = pending[pair.first];
+			p.offset = pair.second.offset;
+			p.size = pair.second.size;
+		}
+	}
+
+	const PredictorSnapshot& ModelSnapshot::getPredictor(const std::pair<EffectType, ActionId>& key) const
+	{
+		auto it = predictors.find(key);
+		if (it != predictors.end()) return *it->second;
+		//read what prediction needs, in the layout written by StochasticEffectPredictor::to_binary: the effects, the baseline, then the best hypothesis (if any)
+		PendingPredictor& p = pending.at(key);
+		std::call_once(p.once, [&] {
+			const LazyModel& model = *lazy;
+			BinaryReader in(model.data.data() + p.offset, p.size);
+			PredictorSnapshot predictor{ nullptr, FrequencyTable(1), {} };
+			std::uint64_t n_effects = in.readVarint();
+			for (std::uint64_t i = 0; i < n_effects && in.ok(); i++) {
+				predictor.effects.push_back(read_value(in));
+			}
+			predictor.table.from_binary(in);
+			if (in.readVarint() > 0 && in.ok()) {
+				std::uint64_t file_id = in.readVarint();
+				if (file_id + 1 < model.condition_offsets.size()) {
+					std::size_t offset = model.condition_offsets[std::size_t(file_id)];
+					BinaryReader condition_in(model.data.data() + offset, model.condition_offsets[std::size_t(file_id) + 1] - offset);
+					Condition condition = read_condition(condition_in, model.ids);
+					if (!condition_in.ok()) in.fail();
+					predictor.condition = std::make_shared<const CompiledCondition>(condition);
+					predictor.table.from_binary(in);
+				}
+				else {
+					in.fail();
+				}
+			}
+			predictor.table.recalculate(alpha);
+			if (!in.ok()) {
+				Logger::log("Model data is truncated or invalid", true);
+			}
+			p.predictor = std::make_shared<const PredictorSnapshot>(std::move(predictor));
+		});
+		return *p.predictor;
+	}
+
+	std::uint64_t ModelSnapshot::getEpoch() const
+	{
+		return epoch;
+	}
+
+	StateDistribution ModelSnapshot::predictTransition(const State& state, ActionId action, Random&) const
 	{
+		const ObjectsByType& objects_by_type = state.getObjectsByType();
+		SpatialIndex index; //only built once a complex predictor needs it
+		ProbabilityDistribution<Effect> predicted; //the complex predictor's prediction for the current attribute
+
+		StateDistribution newState; //this stores all the objects with a future distribution
+		predict_objects(state, *types, newState, nullptr, [&](const Object& obj, int attribute) {
+			std::pair<EffectType, ActionId> key{ EffectType{ obj.getTypeId(), attribute }, action };
+			auto it = effects_observed.find(key);
+			if (it == effects_observed.end()) return AttributeEffects{ nullptr, nullptr }; //never seen this combination of [obj type, attribute id, action]
+			if (it->second.size() == 1) return AttributeEffects{ &*it->second.begin(), nullptr }; //singleton predictor
+			//complex predictor
+			if (index_attribute >= 0 && index.getAttributeType() == -1) index.build(index_attribute, objects_by_type);
+			predicted = getPredictor(key).predict(obj, objects_by_type, (index_attribute >= 0) ? &index : nullptr);
+			return AttributeEffects{ nullptr, &predicted };
+		});
+		return newState;
+	}
+
+	constexpr std::size_t LearnerQORA::PREDICT_WINDOW;
+
+	LearnerQORA::LearnerQORA(const Types& types, double alpha, int threads, std::shared_ptr<const EvictionPolicy> eviction, std::size_t memory_budget, std::size_t predictor_memory_budget, int index_attribute) :
+		Learner("qora", types), alpha(alpha), conditions(std::make_shared<ConditionRegistry>()), eviction(eviction), memory_budget(memory_budget), predictor_memory_budget(predictor_memory_budget), index_attribute(index_attribute)
+	{
+		if (threads > 1) {
+			pool.reset(new ThreadPool(threads));
+		}
+		snapshot_types = std::make_shared<const Types>(types);
+		publishSnapshot();
 	}
 
 	double LearnerQORA::getAlpha() const
@@ -738,8 +2002,19 @@ namespace l_qora {
 		return alpha;
 	}
 
+	int LearnerQORA::getThreads() const
+	{
+		return pool ? pool->size() : 1;
+	}
+
+	int LearnerQORA::getIndexAttribute() const
+	{
+		return index_attribute;
+	}
+
 	size_t LearnerQORA::countTotalPredicatesObserved() const
 	{
+		loadPredictors(true);
 		size_t total_predicates = 0;
 		for (auto& it : predictors) {
 			total_predicates += it.second.getCountPredicatesObserved();
@@ -749,12 +2024,8 @@ namespace l_qora {
 
 	std::size_t LearnerQORA::countUniquePredicatesObserved() const
 	{
-		std::set<Condition> observed;
-		for (auto& it : predictors) {
-			auto& ps = it.second.getPredicatesObserved();
-			observed.insert(ps.begin(), ps.end());
-		}
-		return observed.size();
+		//a condition only gets registered when a predictor observes it
+		return conditions->size();
 	}
 
 	std::size_t LearnerQORA::countLastPredicatesObserved() const
@@ -762,10 +2033,86 @@ namespace l_qora {
 		return last_predicates_observed;
 	}
 
+	std::size_t LearnerQORA::countEvicted() const
+	{
+		loadPredictors(true);
+		std::size_t total = 0;
+		for (auto& it : predictors) {
+			total += it.second.getCountEvicted();
+		}
+		return total;
+	}
+
+	std::size_t LearnerQORA::getMemoryUsage() const
+	{
+		std::size_t total = 0;
+		for (auto& it : predictors) {
+			total += it.second.getMemoryUsage();
+		}
+		//predictors that haven't been loaded yet are still in the model data
+		if (lazy) total += lazy->data.capacity();
+		return total;
+	}
+
+	std::size_t LearnerQORA::getRegistryMemoryUsage() const
+	{
+		return conditions->getMemoryUsage();
+	}
+
+	std::map<std::pair<EffectType, ActionId>, PredictorStats> LearnerQORA::getPredictorStats() const
+	{
+		loadPredictors(!predict_only);
+		std::map<std::pair<EffectType, ActionId>, PredictorStats> stats;
+		for (const auto& pair : predictors) {
+			stats[pair.first] = pair.second.getStats();
+		}
+		return stats;
+	}
+
+	std::unique_ptr<LearnerQORAFrozen> LearnerQORA::freeze() const
+	{
+		loadPredictors(false);
+		std::unique_ptr<LearnerQORAFrozen> frozen(new LearnerQORAFrozen(types, index_attribute));
+		for (const auto& pair : effects_observed) {
+			if (pair.second.size() == 1) {
+				frozen->addSingleton(pair.first, *pair.second.begin());
+			}
+			else {
+				frozen->addPredictor(pair.first, findPredictor(pair.first, false)->freeze());
+			}
+		}
+		return frozen;
+	}
+
+	void LearnerQORA::publishSnapshot()
+	{
+		//the predictors that haven't been read from a binary model yet are left to the snapshot
+		std::map<std::pair<EffectType, ActionId>, std::shared_ptr<const PredictorSnapshot>> predictor_snapshots;
+		for (const auto& pair : predictors) {
+			predictor_snapshots[pair.first] = pair.second.snapshot();
+		}
+		std::uint64_t epoch = snapshot_epoch.load() + 1;
+		std::atomic_store(&snapshot, std::shared_ptr<const ModelSnapshot>(std::make_shared<const ModelSnapshot>(snapshot_types, index_attribute, epoch, effects_observed, std::move(predictor_snapshots), alpha, lazy)));
+		snapshot_epoch.store(epoch, std::memory_order_release);
+	}
+
+	std::shared_ptr<const ModelSnapshot> LearnerQORA::getSnapshot() const
+	{
+		return std::atomic_load(&snapshot);
+	}
+
+	std::uint64_t LearnerQORA::getSnapshotEpoch() const
+	{
+		return snapshot_epoch.load(std::memory_order_acquire);
+	}
+
 	void LearnerQORA::reset()
 	{
 		effects_observed.clear();
 		predictors.clear();
+		lazy.reset();
+		conditions = std::make_shared<ConditionRegistry>();
+		publishSnapshot();
 	}
 
 	void LearnerQORA::restart()
@@ -775,88 +2122,295 @@ namespace l_qora {
 
 	StateDistribution LearnerQORA::predictTransition(const State& state, ActionId action, Random& random) const
 	{
-		std::map<int, std::set<const Object*>> objects_by_type = state.getObjectsByType();
-		//add blank set for each type
-		for (auto& type : types.getObjectTypes()) {
-			objects_by_type[type.id];
+		return std::move(predictTransitions({ Transition{ &state, action, nullptr } }, random)[0]); //moved, so it stays in the arena (if any)
+	}
+
+	std::vector<StateDistribution> LearnerQORA::predictTransitions(const std::vector<Transition>& transitions, Random&) const
+	{
+		constexpr std::size_t NO_PREDICTOR = std::size_t(-1);
+		//what is known about a single <object type, attribute, action>, looked up once per batch
+		struct Resolved {
+			const std::set<Effect>* effects; //null if this combination has never been seen
+			std::size_t predictor; //index into 'predictor_jobs' if there is a complex predictor, otherwise NO_PREDICTOR
+		};
+		//all the targets a complex predictor has to make a prediction for
+		struct Job {
+			const Object* target;
+			std::size_t objects; //index into 'objects_by_types'
+			ProbabilityDistribution<Effect> prediction;
+		};
+		struct PredictorJobs {
+			StochasticEffectPredictor* predictor; //not const, only so it can record its time
+			ArenaVector<Job> jobs;
+		};
+		//one per attribute of each object, in the order they will be added to the output
+		struct Slot {
+			const Resolved* resolved;
+			std::size_t job; //index into the predictor's jobs, if it has one
+		};
+
+		//with an arena, the predictions are made in it and so is everything else here (which is just left there until the caller rewinds it);
+		//only this thread allocates from it, the workers just fill in jobs that were already made
+		ArenaAllocator<char> allocator(arena);
+		ArenaMap<std::pair<EffectType, ActionId>, Resolved> resolved(allocator);
+		ArenaVector<PredictorJobs> predictor_jobs(allocator);
+		ArenaVector<const ObjectsByType*> objects_by_types(allocator);
+		ArenaVector<SpatialIndex> indices(allocator); //same order as 'objects_by_types', only built for the ones a predictor needs
+		ArenaVector<Slot> slots(allocator); //for every transition in the window, in order
+		std::vector<StateDistribution> predictions;
+		predictions.reserve(transitions.size());
+		for (std::size_t t = 0; t < transitions.size(); t++) {
+			predictions.emplace_back(arena);
 		}
 
-		StateDistribution newState; //this stores all the objects with a future distribution
+		//the transitions are handled a window at a time, so the sorted objects and queued work stay small
+		for (std::size_t window = 0; window < transitions.size(); window += PREDICT_WINDOW) {
+			std::size_t window_end = std::min(transitions.size(), window + PREDICT_WINDOW);
+			objects_by_types.clear();
+			slots.clear();
+			for (PredictorJobs& pj : predictor_jobs) {
+				pj.jobs.clear();
+			}
 
-		for (auto& pair : state.getObjects()) {
-			const Object& obj = pair.second;
-			int obj_id = obj.getObjectId();
-			int type_id = obj.getTypeId();
-			const ObjectType& type = types.getObjectType(obj.getTypeId());
-			//
-			newState.addObject(type_id, obj_id);
-			for (int attribute : type.attribute_types) {
-				//
-				EffectType e_type{ obj.getTypeId(), attribute };
-				std::pair<EffectType, ActionId> key{ e_type, action };
-				auto it = effects_observed.find(key);
-				if (it == effects_observed.end()) {
-					//no idea what will happen, never seen this combination of [obj type, attribute id, action]
-					//assume nothing will happen
-					newState.addObjectAttribute(obj_id, attribute, obj.getAttribute(attribute));
+			//find out what each attribute needs, and queue up the work for the complex predictors
+			const State* last_state = nullptr;
+			for (std::size_t t = window; t < window_end; t++) {
+				const State& state = *transitions[t].prevState;
+				ActionId action = transitions[t].action;
+				//consecutive predictions from the same state (e.g. trying every action while planning) share their objects
+				if (&state != last_state) {
+					objects_by_types.push_back(&state.getObjectsByType());
+					last_state = &state;
 				}
-				else {
-					auto& effects = it->second;
-					if (effects.size() > 1) {
-						//complex predictor
-
-						ProbabilityDistribution<Effect> es = predictors.at(key).predict(obj, objects_by_type);
-						ProbabilityDistribution<AttributeValue> newVals;
-						for (const auto& e_pair : es.getProbabilities()) {
-							newVals.addProbability(obj.getAttribute(attribute) + e_pair.first, e_pair.second);
+				for (auto& pair : state.getObjects()) {
+					const Object& obj = pair.second;
+					const ObjectType& type = types.getObjectType(obj.getTypeId());
+					for (int attribute : type.attribute_types) {
+						std::pair<EffectType, ActionId> key{ EffectType{ obj.getTypeId(), attribute }, action };
+						auto it = resolved.find(key);
+						if (it == resolved.end()) {
+							Resolved r{ nullptr, NO_PREDICTOR };
+							auto it_effects = effects_observed.find(key);
+							if (it_effects != effects_observed.end()) {
+								r.effects = &it_effects->second;
+								if (r.effects->size() > 1) {
+									r.predictor = predictor_jobs.size();
+									predictor_jobs.push_back(PredictorJobs{ findPredictor(key, false), ArenaVector<Job>(allocator) });
+								}
+							}
+							it = resolved.insert({ key, r }).first;
+						}
+						Slot slot{ &it->second, 0 };
+						if (it->second.predictor != NO_PREDICTOR) {
+							ArenaVector<Job>& jobs = predictor_jobs[it->second.predictor].jobs;
+							slot.job = jobs.size();
+							jobs.push_back(Job{ &obj, objects_by_types.size() - 1, {} });
 						}
-						newState.addObjectAttribute(obj_id, attribute, newVals);
+						slots.push_back(slot);
+					}
+				}
+			}
+
+			indices.assign(objects_by_types.size(), SpatialIndex());
+			if (index_attribute >= 0) {
+				for (const PredictorJobs& pj : predictor_jobs) {
+					for (const Job& job : pj.jobs) {
+						SpatialIndex& index = indices[job.objects];
+						if (index.getAttributeType() == -1) index.build(index_attribute, *objects_by_types[job.objects]);
 					}
-					else if (effects.size() == 1) {
-						//singleton predictor
-						Effect e = *effects.begin();
-						newState.addObjectAttribute(obj_id, attribute, obj.getAttribute(attribute) + e);
+				}
+			}
+
+			//walk each predictor once
+			//prediction doesn't change the predictors, so they can be spread over the pool just like in observeBatch
+			auto predict_range = [&](std::size_t begin, std::size_t end) {
+				for (std::size_t i = begin; i < end; i++) {
+					if (predictor_jobs[i].jobs.empty()) continue;
+					INT64 begin_time = QPC();
+					for (Job& job : predictor_jobs[i].jobs) {
+						const SpatialIndex* index = (index_attribute >= 0) ? &indices[job.objects] : nullptr;
+						job.prediction = predictor_jobs[i].predictor->predict(*job.target, *objects_by_types[job.objects], index);
 					}
+					predictor_jobs[i].predictor->addPredictTime(predictor_jobs[i].jobs.size(), QPC() - begin_time);
 				}
+			};
+			if (pool) {
+				pool->parallel_for(predictor_jobs.size(), 1, predict_range);
+			}
+			else {
+				predict_range(0, predictor_jobs.size());
+			}
+
+			//put the predicted states together in the same order as the objects
+			auto slot = slots.begin();
+			for (std::size_t t = window; t < window_end; t++) {
+				//the slots were queued in the same order
+				predict_objects(*transitions[t].prevState, types, predictions[t], arena, [&](const Object&, int) {
+					const Slot& s = *slot++;
+					const Resolved& r = *s.resolved;
+					if (r.predictor != NO_PREDICTOR) return AttributeEffects{ nullptr, &predictor_jobs[r.predictor].jobs[s.job].prediction }; //complex predictor
+					if (r.effects != nullptr && r.effects->size() == 1) return AttributeEffects{ &*r.effects->begin(), nullptr }; //singleton predictor
+					return AttributeEffects{ nullptr, nullptr }; //never seen this combination of [obj type, attribute id, action]
+				});
 			}
 		}
-		return newState;
+		return predictions;
 	}
 
 	void LearnerQORA::observeTransition(const State& prevState, ActionId action, const State& nextState)
 	{
+		Transition transition{ &prevState, action, &nextState };
 		last_predicates_observed = 0;
+		observeBatch(&transition, &transition + 1);
+	}
 
-		std::map<int, std::set<const Object*>> objects_by_type = prevState.getObjectsByType();
-		//add blank set for each type
-		for (auto& type : types.getObjectTypes()) {
-			objects_by_type[type.id];
+	void LearnerQORA::observeTransitions(const std::vector<Transition>& transitions)
+	{
+		last_predicates_observed = 0;
+		//the learner-wide budget is applied after every transition, so with a budget the transitions have to go through one at a time
+		if (memory_budget > 0) {
+			for (const Transition& transition : transitions) {
+				observeBatch(&transition, &transition + 1);
+			}
+		}
+		else {
+			observeBatch(transitions.data(), transitions.data() + transitions.size());
 		}
+	}
 
-		//record all effects and let the Predictor class take care of predicates
-		State delta = nextState.diff(prevState);
-		for (auto& pair : delta.getObjects()) {
-			int id = pair.first;
-			Object& obj = pair.second; //object
-			for (const auto& attribs : obj.getAttributes()) {
-				EffectType e_type{ obj.getTypeId(), attribs.first };
-				Effect e = attribs.second;
-				//
-				std::pair<EffectType, ActionId> key{ e_type, action };
-				//add to effects set?
-				auto& effects = effects_observed[key];
-				if (effects.find(e) == effects.end()) {
-					effects.insert(e);
-					if (effects.size() == 2) {
-						//just noticed the second effect
-						predictors[key] = StochasticEffectPredictor(alpha);
+	void LearnerQORA::observeBatch(const Transition* first, const Transition* last)
+	{
+		//none of the bookkeeping below outlives the call, so with an arena it's all released at once at the end
+		//(only this thread allocates from it; the workers just read)
+		Arena::Scope scope(arena);
+		ArenaAllocator<char> allocator(arena);
+
+		//the objects of each previous state, sorted by type
+		ArenaVector<const ObjectsByType*> objects_by_types(allocator);
+
+		//a single observation for one predictor
+		struct Observation {
+			const Object* target;
+			std::size_t objects; //index into 'objects_by_types'
+			Effect effect;
+		};
+		//the observations for a single predictor, in the order they were found
+		struct PredictorUpdate {
+			StochasticEffectPredictor* predictor;
+			ArenaVector<Observation> observations;
+			std::size_t predicates_observed = 0;
+		};
+		ArenaVector<PredictorUpdate> updates(allocator);
+		ArenaMap<std::pair<EffectType, ActionId>, std::size_t> update_indices(allocator);
+
+		//[action][object type]: every attribute of the type has only ever had a zero effect under the action,
+		//so its objects can be skipped unless they changed (there's nothing to record and no predictor to update)
+		ArenaMap<ActionId, ArenaVector<char>> quiet_types(allocator);
+
+		const State* last_state = nullptr;
+		for (const Transition* transition = first; transition != last; transition++) {
+			const State& prevState = *transition->prevState;
+			ActionId action = transition->action;
+			if (&prevState != last_state) {
+				objects_by_types.push_back(&prevState.getObjectsByType());
+				last_state = &prevState;
+			}
+			auto it_quiet = quiet_types.find(action);
+			if (it_quiet == quiet_types.end()) {
+				ArenaVector<char> quiet(types.getObjectTypes().size(), 1, allocator);
+				for (const ObjectType& type : types.getObjectTypes()) {
+					for (int attribute : type.attribute_types) {
+						auto it_effects = effects_observed.find({ EffectType{ type.id, attribute }, action });
+						if (it_effects == effects_observed.end() || it_effects->second.size() != 1 || it_effects->second.begin()->length() != 0) quiet[type.id] = 0;
+					}
+				}
+				it_quiet = quiet_types.emplace(action, std::move(quiet)).first;
+			}
+			ArenaVector<char>& quiet = it_quiet->second;
+
+			//record all effects and let the Predictor class take care of predicates
+			//only the values that changed are in the delta; every other attribute had a zero effect
+			StateDelta delta = transition->nextState->delta(prevState, arena);
+			auto change = delta.getChanges().begin();
+			for (const auto& pair : transition->nextState->getObjects()) {
+				int id = pair.first;
+				const Object& obj = pair.second; //object
+				bool changed = change != delta.getChanges().end() && change->object == id;
+				if (!changed && quiet[obj.getTypeId()]) continue;
+				for (const auto& attribs : obj.getAttributes()) {
+					EffectType e_type{ obj.getTypeId(), attribs.first };
+					Effect e = (change != delta.getChanges().end() && change->object == id && change->attribute == attribs.first) ? (change++)->delta : Effect(attribs.second.size());
+					//
+					std::pair<EffectType, ActionId> key{ e_type, action };
+					//add to effects set?
+					auto& effects = effects_observed[key];
+					if (effects.find(e) == effects.end()) {
+						effects.insert(e);
+						quiet[obj.getTypeId()] = 0;
+						if (effects.size() == 2) {
+							//just noticed the second effect
+							predictors[key] = StochasticEffectPredictor(alpha, conditions);
+							predictors[key].setEviction(eviction, predictor_memory_budget);
+						}
+					}
+					//queue an update for the observer
+					StochasticEffectPredictor* predictor = findPredictor(key, true);
+					if (predictor) {
+						auto it_index = update_indices.find(key);
+						if (it_index == update_indices.end()) {
+							it_index = update_indices.insert({ key, updates.size() }).first;
+							updates.push_back(PredictorUpdate{ predictor, ArenaVector<Observation>(allocator) });
+						}
+						updates[it_index->second].observations.push_back(Observation{ &prevState.getObject(id), objects_by_types.size() - 1, e });
 					}
 				}
-				//update observer
-				auto it = predictors.find(key);
-				if (it != predictors.end()) {
-					it->second.observe(types, prevState.getObject(id), objects_by_type, e);
-					last_predicates_observed += it->second.getCountPredicatesObserved();
+			}
+		}
+
+		//the spatial index of each state that a predictor is going to look at
+		ArenaVector<SpatialIndex> indices(objects_by_types.size(), allocator);
+		if (index_attribute >= 0) {
+			for (const PredictorUpdate& update : updates) {
+				for (const Observation& observation : update.observations) {
+					SpatialIndex& index = indices[observation.objects];
+					if (index.getAttributeType() == -1) index.build(index_attribute, *objects_by_types[observation.objects]);
+				}
+			}
+		}
+
+		//update observers
+		//the predictors don't share any state, so each one can be updated on its own thread, as long as its own observations stay in order
+		auto update_range = [&](std::size_t begin, std::size_t end) {
+			for (std::size_t i = begin; i < end; i++) {
+				PredictorUpdate& update = updates[i];
+				INT64 begin_time = QPC();
+				for (const Observation& observation : update.observations) {
+					const SpatialIndex* index = (index_attribute >= 0) ? &indices[observation.objects] : nullptr;
+					update.predictor->observe(types, *observation.target, *objects_by_types[observation.objects], observation.effect, pool.get(), index);
+					update.predicates_observed += update.predictor->getCountPredicatesObserved();
+				}
+				update.predictor->addObserveTime(update.observations.size(), QPC() - begin_time);
+			}
+		};
+		if (pool) {
+			pool->parallel_for(updates.size(), 1, update_range);
+		}
+		else {
+			update_range(0, updates.size());
+		}
+		for (const PredictorUpdate& update : updates) {
+			last_predicates_observed += update.predicates_observed;
+		}
+
+		//over the learner-wide budget: each predictor gives up the same share of its working set
+		if (memory_budget > 0) {
+			loadPredictors(true); //so every predictor gets its share
+			std::size_t usage = 0;
+			for (const auto& it : predictors) usage += it.second.getWorkingMemoryUsage();
+			if (usage > memory_budget) {
+				for (auto& it : predictors) {
+					std::size_t predictor_usage = it.second.getWorkingMemoryUsage();
+					it.second.shrink(std::size_t(double(predictor_usage) * memory_budget / usage));
 				}
 			}
 		}
@@ -864,6 +2418,8 @@ namespace l_qora {
 
 	void LearnerQORA::print(FILE* f) const
 	{
+		loadPredictors(true);
+		fprintf(f, "Memory: %zu bytes in predictors, %zu bytes in %zu conditions; %zu candidates evicted\n", getMemoryUsage(), getRegistryMemoryUsage(), conditions->size(), countEvicted());
 		fprintf(f, "Observations:\n");
 		if (effects_observed.empty()) {
 			fprintf(f, " none\n");
@@ -907,6 +2463,7 @@ namespace l_qora {
 		//store all predictors
 		//std::map<std::pair<EffectType, ActionId>, StochasticEffectPredictor> predictors
 		//stored as list of tuples: [(EffectType, ActionId, StochasticEffectPredictor)]
+		loadPredictors(true);
 		json& data_predictors = data["predictors"];
 		for (const auto& pair : predictors) {
 			json j{
@@ -918,6 +2475,13 @@ namespace l_qora {
 			data_predictors.push_back(j);
 		}
 
+		//memory/eviction stats (informational; not read back)
+		data["memory"] = json{
+			{"predictors", getMemoryUsage()},
+			{"conditions", getRegistryMemoryUsage()},
+			{"evicted", countEvicted()}
+		};
+
 		//
 		return data;
 	}
@@ -948,6 +2512,8 @@ namespace l_qora {
 		//std::map<std::pair<EffectType, ActionId>, StochasticEffectPredictor> predictors
 		//stored as list of tuples: [(EffectType, ActionId, StochasticEffectPredictor)]
 		predictors.clear();
+		lazy.reset();
+		conditions = std::make_shared<ConditionRegistry>();
 		const json& data_predictors = j["predictors"];
 		for (const json& predictor_tuple : data_predictors) {
 			EffectType e_type;
@@ -956,9 +2522,200 @@ namespace l_qora {
 			//
 			std::pair<EffectType, ActionId> key{ e_type, action };
 			//
-			predictors[key] = StochasticEffectPredictor(alpha);
+			predictors[key] = StochasticEffectPredictor(alpha, conditions);
+			predictors[key].setEviction(eviction, predictor_memory_budget);
 			predictors[key].from_json(types, predictor_tuple.at("predictor"));
 		}
+		publishSnapshot();
+	}
+
+	void LearnerQORA::to_binary(BinaryWriter& out) const
+	{
+		out.writeVarint(BINARY_VERSION);
+		//string table
+		write_binary_types(out, types);
+
+		//all observed effects: object type, attribute type, action, then the effects
+		out.writeVarint(effects_observed.size());
+		for (const auto& pair : effects_observed) {
+			write_key(out, pair.first);
+			out.writeVarint(pair.second.size());
+			for (const Effect& e : pair.second) write_value(out, e);
+		}
+
+		//every condition, once, in sorted order (the predictors refer to them by their position in it), each with its size in bytes
+		//not in registry order, since that depends on how the threads happened to interleave, and the same model should always give the same file
+		loadPredictors(true);
+		std::vector<ConditionRegistry::Id> sorted = conditions->sortedIds();
+		std::vector<std::uint64_t> file_ids(sorted.size());
+		out.writeVarint(sorted.size());
+		for (std::size_t i = 0; i < sorted.size(); i++) {
+			file_ids[sorted[i]] = i;
+			BinaryWriter condition;
+			write_condition(condition, conditions->get(sorted[i]));
+			out.writeString(condition.data());
+		}
+
+		//all predictors: first the index (object type, attribute type, action, then the predictor's size in bytes), then their data in the same order
+		std::vector<BinaryWriter> predictor_data(predictors.size());
+		out.writeVarint(predictors.size());
+		std::size_t i = 0;
+		for (const auto& pair : predictors) {
+			write_key(out, pair.first);
+			pair.second.to_binary(predictor_data[i], file_ids);
+			out.writeVarint(predictor_data[i].size());
+			i++;
+		}
+		for (const BinaryWriter& predictor : predictor_data) {
+			out.writeBytes(predictor.data().data(), predictor.size());
+		}
+	}
+
+	void LearnerQORA::from_binary(BinaryReader& in)
+	{
+		std::uint64_t version = in.readVarint();
+		if (version != BINARY_VERSION) {
+			Logger::log(Logger::formatString("Unsupported qora binary model version: %llu", (unsigned long long)version), true);
+			in.fail();
+			return;
+		}
+		//string table
+		BinaryTypes ids = read_binary_types(in, types);
+
+		//load all observed effects
+		effects_observed.clear();
+		std::uint64_t n = in.readVarint();
+		for (std::uint64_t i = 0; i < n && in.ok(); i++) {
+			std::set<Effect>& effects = effects_observed[read_key(in, ids)];
+			std::uint64_t n_effects = in.readVarint();
+			for (std::uint64_t e = 0; e < n_effects && in.ok(); e++) {
+				effects.insert(read_value(in));
+			}
+		}
+
+		//the conditions and predictors are only indexed here, and kept to be read on first use
+		predictors.clear();
+		conditions = std::make_shared<ConditionRegistry>();
+		lazy = std::make_shared<LazyModel>();
+		lazy->ids = ids;
+		lazy->data.assign(in.position(), in.remaining());
+		in.readBlock(in.remaining());
+		BinaryReader index(lazy->data.data(), lazy->data.size());
+		//conditions: each one's size in bytes, then its data
+		n = index.readVarint();
+		for (std::uint64_t i = 0; i < n && index.ok(); i++) {
+			std::size_t size = std::size_t(index.readVarint());
+			lazy->condition_offsets.push_back(lazy->data.size() - index.remaining());
+			index.readBlock(size);
+		}
+		lazy->condition_offsets.push_back(lazy->data.size() - index.remaining());
+		lazy->condition_ids.assign(lazy->condition_offsets.size() - 1, LazyModel::NOT_LOADED);
+		//predictors: the index, then their data in the same order
+		n = index.readVarint();
+		std::vector<std::pair<std::pair<EffectType, ActionId>, std::size_t>> sizes;
+		for (std::uint64_t i = 0; i < n && index.ok(); i++) {
+			std::pair<EffectType, ActionId> key = read_key(index, ids);
+			sizes.push_back({ key, std::size_t(index.readVarint()) });
+		}
+		for (const auto& pair : sizes) {
+			if (!index.ok()) break;
+			lazy->pending[pair.first] = LazyModel::Pending{ lazy->data.size() - index.remaining(), pair.second, false };
+			index.readBlock(pair.second);
+		}
+		if (!index.ok()) {
+			in.fail();
+			lazy.reset();
+		}
+		else if (lazy->pending.empty()) {
+			lazy.reset();
+		}
+		publishSnapshot();
+	}
+
+	StochasticEffectPredictor* LearnerQORA::findPredictor(const std::pair<EffectType, ActionId>& key, bool for_learning, bool prediction_only) const
+	{
+		if (lazy) {
+			auto it = lazy->pending.find(key);
+			if (it != lazy->pending.end() && (for_learning || !it->second.partial)) {
+				LazyModel::Pending& pending = it->second;
+				bool partial = (predict_only || prediction_only) && !for_learning;
+				//(re)load it in place, so pointers to it stay valid
+				StochasticEffectPredictor& predictor = predictors[key];
+				predictor = StochasticEffectPredictor(alpha, conditions);
+				predictor.setEviction(eviction, predictor_memory_budget);
+				LazyModel& model = *lazy;
+				BinaryReader in(model.data.data() + pending.offset, pending.size);
+				predictor.from_binary(in, [&](std::uint64_t file_id, ConditionRegistry::Id& id) { return lazy_condition(model, *conditions, file_id, id); }, partial);
+				if (!in.ok()) {
+					Logger::log("Model data is truncated or invalid", true);
+				}
+				if (partial) {
+					pending.partial = true;
+				}
+				else {
+					lazy->pending.erase(it);
+					if (lazy->pending.empty()) lazy.reset();
+				}
+			}
+		}
+		auto it = predictors.find(key);
+		return (it == predictors.end()) ? nullptr : &it->second;
+	}
+
+	void LearnerQORA::loadPredictors(bool for_learning, bool prediction_only) const
+	{
+		if (!lazy) return;
+		std::vector<std::pair<EffectType, ActionId>> keys;
+		for (const auto& pair : lazy->pending) {
+			keys.push_back(pair.first);
+		}
+		for (const auto& key : keys) {
+			findPredictor(key, for_learning, prediction_only);
+		}
+	}
+
+	void LearnerQORA::setPredictOnly(bool predict_only)
+	{
+		this->predict_only = predict_only;
+	}
+
+	json LearnerQORA::getStats() const
+	{
+		json data;
+		json& data_predictors = data["predictors"];
+		data_predictors = json::array();
+		for (const auto& pair : getPredictorStats()) {
+			json j{
+				{"action", types.getActions().at(pair.first.second).name},
+				{"stats", pair.second}
+			};
+			l_qora::to_json(j["effect_type"], pair.first.first, types);
+			data_predictors.push_back(j);
+		}
+		data["memory"] = json{
+			{"predictors", getMemoryUsage()},
+			{"conditions", getRegistryMemoryUsage()},
+			{"evicted", countEvicted()}
+		};
+		return data;
+	}
+
+	SnapshotReader::SnapshotReader(const LearnerQORA& learner) : learner(&learner)
+	{
+	}
+
+	const ModelSnapshot& SnapshotReader::get()
+	{
+		//the snapshot's own epoch is kept, so if a newer one was published between the two loads, it just gets fetched again next time
+		if (!current || current->getEpoch() != learner->getSnapshotEpoch()) {
+			current = learner->getSnapshot();
+		}
+		return *current;
+	}
+
+	StateDistribution SnapshotReader::predictTransition(const State& state, ActionId action, Random& random)
+	{
+		return get().predictTransition(state, action, random);
 	}
 
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include "Learner.h"
 #include "FrequencyTable.h"
+#include "ThreadPool.h"
 
 namespace l_qora {
 
@@ -37,6 +38,24 @@ namespace l_qora {
 	void to_json(json& j, const Predicate& p, const Types& types);
 	void from_json(const json& j, Predicate& p, const Types& types);
 
+	//hash grid over the objects of a single observation, keyed on one attribute (normally position),
+	//so predicates on that attribute only have to look at the objects in the cells they name instead of every object of a type
+	class SpatialIndex {
+	public:
+		typedef std::pair<std::size_t, const Object*> Cell; //(hash of object type + attribute value, object)
+	private:
+		int attribute_type = -1;
+		std::vector<Cell> cells; //sorted by hash; different values can share a hash, so callers still have to check each object
+	public:
+		//hash of (object type, base + offset); offset may be null
+		static std::size_t hash(int object_type, const int* base, const int* offset, int size);
+		//
+		void build(int attribute_type, const ObjectsByType& objects_by_type); //index every object that has this attribute
+		int getAttributeType() const; //-1 until built
+		//the objects that might be of the given type and have the attribute value (base + offset), as [first, second)
+		std::pair<const Cell*, const Cell*> find(int object_type, const int* base, const int* offset, int size) const;
+	};
+
 	//a collection of PredicateBases, evaluated over a single target-other pair
 	struct RelationGroup {
 		int other_object_type = -1;
@@ -51,7 +70,8 @@ namespace l_qora {
 		std::size_t evaluate_single(const Object& target, const Object& other) const;
 		//calculate all possible evaluations over all possible target-other assignments
 		//returns a state combo in 0..(2^(2^m))-1
-		std::size_t evaluate_all(const Object& target, const std::map<int, std::set<const Object*>>& objects_by_type) const;
+		//with an index, groups whose "other" predicates are all on the indexed attribute only look at the objects in the cells they name
+		std::size_t evaluate_all(const Object& target, const ObjectsByType& objects_by_type, const SpatialIndex* index = nullptr) const;
 		//
 		void print(FILE* f, const Types& types) const;
 		void printCaseInfo(FILE* f, const Types& types, std::size_t value) const;
@@ -63,6 +83,47 @@ namespace l_qora {
 	void to_json(json& j, const RelationGroup& p, const Types& types);
 	void from_json(const json& j, RelationGroup& p, const Types& types);
 
+	struct CompiledCondition;
+
+	//the results of every predicate used by a predictor's candidates, evaluated once per observation against each possible "other" object and stored as bitsets,
+	//so each candidate can build its evaluation out of the bitsets instead of evaluating the same predicates against the same objects again
+	class PredicateCache {
+		struct Others {
+			ObjectSpan objects; //bit i of a bitset = the predicate's result for objects[i]
+			std::size_t words = 0; //number of 64-bit words in each bitset
+			std::uint64_t last_word_mask = 0; //which bits of the last word are in use
+			bool built = false; //the lists are only filled in once a predicate needs them
+		};
+		//registered predicates, keyed by (other object type, predicate); an id stays the same while anything uses it,
+		//and once nothing does (see release) it's freed, and reused for the next new predicate
+		std::map<std::pair<int, Predicate>, int> ids;
+		std::vector<std::pair<int, Predicate>> entries; //id -> (other object type, predicate)
+		std::vector<std::size_t> refs; //id -> number of uses by compiled conditions; 0 = free
+		std::vector<int> free_ids;
+		//the current observation
+		const Object* target = nullptr;
+		const ObjectsByType* objects_by_type = nullptr;
+		const SpatialIndex* index = nullptr; //optional
+		std::vector<Others> others; //indexed by (other object type + 1), so that -1 is the target on its own
+		constexpr static std::size_t NOT_EVALUATED = ~std::size_t(0);
+		std::vector<std::size_t> offsets; //id -> index of its bitset in 'bits', or NOT_EVALUATED
+		std::vector<std::uint64_t> bits;
+	public:
+		int getId(int other_object_type, const Predicate& predicate); //registers the predicate if it isn't already, and adds a use of it
+		void release(const CompiledCondition& condition); //removes the uses added when the condition was compiled with this cache
+		std::size_t size() const; //number of registered predicates that are in use
+		std::size_t getMemoryUsage() const; //approximate number of bytes used, including heap storage
+		//
+		void begin(const Object& target, const ObjectsByType& objects_by_type, const SpatialIndex* index = nullptr); //start a new observation, discarding the previous results
+		void update(); //evaluate every predicate in use that hasn't been evaluated for this observation yet
+		void update(const CompiledCondition& condition); //only the ones used by this condition
+		//same result as RelationGroup::evaluate_all, for the group made of the given (already evaluated) predicates
+		std::size_t evaluate_all(int other_object_type, const int* predicate_ids, std::size_t count) const;
+	private:
+		const Others& getOthers(int other_object_type);
+		void evaluate(int id);
+	};
+
 	//a set of predicates, without information about how they are used
 	struct Condition {
 		std::set<RelationGroup> groups; //only 1 may have -1 as "other type", for consistency
@@ -70,7 +131,7 @@ namespace l_qora {
 		//std::size_t size() const; //# groups
 		std::size_t stateSize() const; //prod(group sizes)
 		//return a state from 0 to stateSize-1, representing some existential/universal predicate group stufff
-		std::size_t evaluate(const Object& target, const std::map<int, std::set<const Object*>>& objects_by_type) const;
+		std::size_t evaluate(const Object& target, const ObjectsByType& objects_by_type, const SpatialIndex* index = nullptr) const; //interpreted; see CompiledCondition for the fast version
 		//
 		void print(FILE* f, const Types& types, int target_object_type) const;
 		void printCaseInfo(FILE* f, const Types& types, int target_object_type, std::size_t input_case) const;
@@ -84,12 +145,113 @@ namespace l_qora {
 	void to_json(json& j, const Condition& p, const Types& types);
 	void from_json(const json& j, Condition& p, const Types& types);
 
+	//binary model helpers (LearnerQORA, LearnerQORAFrozen)
+	//the type names are written once at the start; everything else refers to object types, attribute types and actions by their index there
+	struct BinaryTypes {
+		std::vector<int> object_types; //index in the file -> id in the loading learner's Types
+		std::vector<int> attribute_types;
+		std::vector<ActionId> actions;
+	};
+
+	void write_binary_types(BinaryWriter& out, const Types& types);
+	BinaryTypes read_binary_types(BinaryReader& in, const Types& types);
+
+	//an index read from the file, checked against the table it refers to
+	template<typename T>
+	T binary_lookup(BinaryReader& in, const std::vector<T>& table)
+	{
+		std::uint64_t index = in.readVarint();
+		if (index >= table.size()) {
+			in.fail();
+			return T();
+		}
+		return table[std::size_t(index)];
+	}
+
+	void write_key(BinaryWriter& out, const std::pair<EffectType, ActionId>& key); //object type, attribute type, action
+	std::pair<EffectType, ActionId> read_key(BinaryReader& in, const BinaryTypes& ids);
+	void write_value(BinaryWriter& out, const AttributeValue& value);
+	AttributeValue read_value(BinaryReader& in);
+	void write_condition(BinaryWriter& out, const Condition& condition);
+	Condition read_condition(BinaryReader& in, const BinaryTypes& ids);
+
+	//learner-wide table of every distinct Condition, so each one is stored once and can be referred to by a 32-bit id
+	//intern can be called from several threads at once (the predictors are updated in parallel), so the ids depend on thread scheduling;
+	//anything that gets saved goes through sortedIds instead. get and size don't lock, so they can only be used while nothing is being interned.
+	//a condition never moves once it has been added, so pointers to it stay valid
+	class ConditionRegistry {
+	public:
+		typedef std::uint32_t Id;
+	private:
+		constexpr static Id SLOT_EMPTY = ~Id(0);
+		mutable std::mutex mutex;
+		std::deque<Condition> conditions; //id -> condition (a deque, so adding one doesn't move the others)
+		std::vector<std::size_t> hashes; //id -> hash of the condition, so probing and rehashing never have to look at the condition itself
+		std::vector<Id> slots; //open addressing with linear probing, load factor <= 1/2
+		std::size_t condition_bytes = 0; //approximate heap usage of the stored conditions
+		//
+		void rehash(std::size_t slot_count);
+	public:
+		static std::size_t hash(const Condition& condition); //structural hash, consistent with Condition::operator==
+		//
+		std::pair<Id, const Condition*> intern(const Condition& condition); //the id of an equal condition, adding a copy of this one if there isn't one yet
+		const Condition& get(Id id) const;
+		std::size_t size() const; //number of distinct conditions
+		std::vector<Id> sortedIds() const; //every id, in the order of their conditions (which, unlike the ids, doesn't depend on the order they were interned in)
+		std::size_t getMemoryUsage() const; //approximate number of bytes used, including the conditions' nodes
+	};
+
+	//a Condition flattened into one list of (attribute, mode, constant) instructions,
+	//so it can be evaluated without walking the predicate sets or allocating temporary AttributeValues
+	struct CompiledCondition {
+		enum Mode : int {
+			TARGET, //target.attribute == constant
+			OTHER, //other.attribute == constant
+			RELATIVE, //other.attribute - target.attribute == constant
+			NEVER //needs an "other" object but the group doesn't have one
+		};
+		struct Instruction {
+			int attribute_type;
+			Mode mode;
+			int size; //number of components in the constant
+			int constant; //index of the constant's first component in 'constants'
+			int predicate; //id of the predicate in a PredicateCache, or -1 if compiled without one
+		};
+		struct Group {
+			int other_object_type;
+			std::size_t first; //index of the group's first instruction (one per predicate, in the same order as the set)
+			std::size_t count; //number of instructions in the group
+			std::size_t multiplier; //product of the complete state sizes of the groups before this one
+			std::size_t all_cases; //the evaluate_all result once every single-pair case has been seen
+			int index_attribute; //the attribute of every OTHER/RELATIVE instruction if they all share one (so the group can use a SpatialIndex on it), otherwise -1
+		};
+		constexpr static std::size_t MAX_GROUP_SIZE = 6; //a group with more predicates has more than 2^64 cases, so it couldn't be evaluated anyway
+		//
+		std::vector<Group> groups;
+		std::vector<Instruction> program;
+		std::vector<int> constants;
+		//
+		CompiledCondition(const Condition& condition, PredicateCache* cache = nullptr);
+		std::size_t evaluate(const Object& target, const ObjectsByType& objects_by_type, const SpatialIndex* index = nullptr) const; //same as Condition::evaluate
+		std::size_t evaluate(const PredicateCache& cache) const; //same result, from the cache's bitsets; needs to have been compiled with that cache
+		std::size_t getMemoryUsage() const; //approximate number of bytes used, including heap storage
+	private:
+		bool matches(const Instruction& instruction, const int* values) const; //values == constant (sizes already checked)
+		std::size_t evaluate_other(const Group& group, std::size_t target_bits, const int* const* target_values, const Object& other) const; //single-pair case for one "other"
+		bool evaluate_indexed(const Group& group, const Object& target, std::size_t target_bits, const int* const* target_values, ObjectSpan others, const SpatialIndex& index, std::size_t& result) const; //only the cells the group names; false if the index can't be used for this target
+	};
+
 	//helper struct to deal with going from Predicates and Effects to (int input, int outcome) for the FrequencyCounter
 	struct Candidate {
-		Condition condition;
+		ConditionRegistry::Id id;
+		const Condition* condition; //owned by the registry
+		std::shared_ptr<const CompiledCondition> compiled; //compiled with the owning predictor's PredicateCache
 		FrequencyTable table;
+		std::size_t since = 0; //predictor observation count when the table was created or last reset (for eviction)
 		//
-		void observe(const Object& target, const std::map<int, std::set<const Object*>>& objects_by_type, int effect);
+		void observe(const Object& target, const ObjectsByType& objects_by_type, int effect, const SpatialIndex* index = nullptr);
+		void reset(std::size_t now); //reset the table, as of observation 'now'
+		std::size_t getMemoryUsage() const; //approximate number of bytes used, not counting the condition itself (which lives in the registry)
 		//
 		void print(FILE* f, const Types& types, EffectType type, const std::vector<Effect>& effects) const;
 		//
@@ -98,60 +260,317 @@ namespace l_qora {
 	};
 
 	void to_json(json& j, const Candidate& p, const Types& types);
-	void from_json(const json& j, Candidate& p, const Types& types);
+	void from_json(const json& j, Candidate& p, const Types& types, ConditionRegistry& conditions, PredicateCache& cache); //interns the condition and compiles it with the cache
+
+	ProbabilityDistribution<Effect> predict_effects(const FrequencyTable& table, std::size_t state_in, const std::vector<Effect>& effects); //turn a table's prediction for one input into a distribution over effects
+
+	//what is known about one attribute of an object when predicting: the only effect it has ever had, a distribution over effects,
+	//or neither (the combination has never been seen, so the value is assumed to stay the same)
+	struct AttributeEffects {
+		const Effect* effect;
+		const ProbabilityDistribution<Effect>* distribution;
+	};
+
+	//the loop every predictTransition shares: adds each object of the state to 'out', with each of its attributes set to its current value plus the effects
+	//lookup(object, attribute) returns for it; lookup is called once per attribute, in the order they're added, and what it returns is only read until the next call
+//distributions are made in the arena, if any
+	//each object is added once with all of its certain attributes (most of them), and only the uncertain ones are multiplied out after that
+	template<typename Lookup>
+	void predict_objects(const State& state, const Types& types, StateDistribution& out, Arena* arena, Lookup lookup)
+	{
+		ArenaVector<std::pair<int, ProbabilityDistribution<AttributeValue>>> uncertain{ ArenaAllocator<std::pair<int, ProbabilityDistribution<AttributeValue>>>(arena) };
+		for (const auto& pair : state.getObjects()) {
+			const Object& obj = pair.second;
+			int obj_id = obj.getObjectId();
+			const std::set<int>& attributes = types.getObjectType(obj.getTypeId()).attribute_types;
+			Object predicted(obj.getTypeId(), obj_id, arena);
+			predicted.getAttributes().reserve(attributes.size());
+			uncertain.clear();
+			for (int attribute : attributes) {
+				AttributeEffects effects = lookup(obj, attribute);
+				if (effects.distribution) {
+					ProbabilityDistribution<AttributeValue> values(arena);
+					for (const auto& e_pair : effects.distribution->getProbabilities()) {
+						values.addProbability(obj.getAttribute(attribute) + e_pair.first, e_pair.second);
+					}
+					uncertain.emplace_back(attribute, std::move(values));
+					//set for now, so the object has the same layout; replaced by each of the values below
+					predicted.setAttribute(attribute, obj.getAttribute(attribute));
+				}
+				else if (effects.effect) {
+					predicted.setAttribute(attribute, obj.getAttribute(attribute) + *effects.effect);
+				}
+				else {
+					predicted.setAttribute(attribute, obj.getAttribute(attribute));
+				}
+			}
+			out.addObject(std::move(predicted));
+			for (const auto& u : uncertain) {
+				out.addObjectAttribute(obj_id, u.first, u.second);
+			}
+		}
+	}
+
+	//the single-predicate conditions a predictor has already generated, keyed on the raw (other object type, attribute, mode, value) tuple,
+	//so candidate generation can skip them without building a Condition first (which costs several set nodes and AttributeValue copies)
+	//values are given as one or two component arrays: value = a, or value = a - b for RELATIVE
+	class SingletonFilter {
+		constexpr static std::uint32_t SLOT_EMPTY = ~std::uint32_t(0);
+		std::vector<int> keys; //every key back to back: other object type, attribute, mode, size, then the value's components
+		std::vector<std::size_t> offsets; //key index -> start of the key in 'keys'
+		std::vector<std::size_t> hashes; //key index -> hash of the key
+		std::vector<std::uint32_t> slots; //open addressing with linear probing, load factor <= 1/2
+		//
+		static std::size_t hash(int other_object_type, int attribute_type, CompiledCondition::Mode mode, const int* a, const int* b, int size);
+		bool equals(std::size_t key, int other_object_type, int attribute_type, CompiledCondition::Mode mode, const int* a, const int* b, int size) const;
+		void rehash(std::size_t slot_count);
+	public:
+		//true (and remembers the key) if it wasn't there yet; only allocates when a new key needs room
+		bool insert(int other_object_type, int attribute_type, CompiledCondition::Mode mode, const int* a, const int* b, int size);
+		void clear();
+		std::size_t size() const; //number of keys
+		std::size_t getMemoryUsage() const; //approximate number of bytes used
+	};
+
+	//decides which working set candidates a predictor drops, either as soon as they qualify or when the predictor is over its memory budget
+	//dropped candidates stay in the 'observed' set, so they won't be generated again
+	class EvictionPolicy {
+	public:
+		static std::shared_ptr<const EvictionPolicy> create(const std::string& name, std::size_t stale_after = 1000); //"none", "hopeless" or "stale"; null if the name isn't known
+		virtual ~EvictionPolicy() {}
+		virtual std::string getName() const = 0;
+		//should the candidate be dropped now? baseline = the predictor's current baseline success interval, now = the predictor's observation count
+		virtual bool shouldEvict(const Candidate& candidate, const ConfidenceInterval& baseline, std::size_t now) const = 0;
+		virtual bool canEvict() const = 0; //false if shouldEvict never returns true, so the working set doesn't have to be checked
+		//when over budget, the candidates with the lowest priority are dropped first
+		virtual double priority(const Candidate& candidate, const ConfidenceInterval& baseline, std::size_t now) const = 0;
+	};
+
+	//never drops anything on its own; over budget, the candidates with the lowest upper bound go first
+	class EvictionNone : public EvictionPolicy {
+	public:
+		virtual std::string getName() const;
+		virtual bool shouldEvict(const Candidate& candidate, const ConfidenceInterval& baseline, std::size_t now) const;
+		virtual bool canEvict() const;
+		virtual double priority(const Candidate& candidate, const ConfidenceInterval& baseline, std::size_t now) const;
+	};
+
+	//drops candidates whose upper bound is below the baseline's lower bound, i.e., that are (at this confidence level) worse than no condition at all
+	class EvictionHopeless : public EvictionNone {
+	public:
+		virtual std::string getName() const;
+		virtual bool shouldEvict(const Candidate& candidate, const ConfidenceInterval& baseline, std::size_t now) const;
+		virtual bool canEvict() const;
+	};
+
+	//drops candidates that have gone 'stale_after' observations (since their table was last reset) without beating the baseline; over budget, the oldest go first
+	class EvictionStale : public EvictionPolicy {
+		std::size_t stale_after;
+	public:
+		EvictionStale(std::size_t stale_after);
+		virtual std::string getName() const;
+		virtual bool shouldEvict(const Candidate& candidate, const ConfidenceInterval& baseline, std::size_t now) const;
+		virtual bool canEvict() const;
+		virtual double priority(const Candidate& candidate, const ConfidenceInterval& baseline, std::size_t now) const;
+	};
+
+	//read-only copy of what a StochasticEffectPredictor needs to make a prediction: its best hypothesis (or its baseline) and the effects it has seen
+	struct PredictorSnapshot {
+		std::shared_ptr<const CompiledCondition> condition; //the best hypothesis; null = use the baseline
+		FrequencyTable table; //the best hypothesis' table, or the baseline
+		std::vector<Effect> effects; //int -> Effect mapping
+		//
+		ProbabilityDistribution<Effect> predict(const Object& target, const ObjectsByType& objects_by_type, const SpatialIndex* index = nullptr) const; //same as StochasticEffectPredictor::predict at the time of the snapshot
+	};
+
+	class FrozenPredictor; //see LearnerQORAFrozen.h
+
+	//accounting for a single predictor, to find the <effect type, action> keys that use the most memory and time (see LearnerQORA::getPredictorStats)
+	struct PredictorStats {
+		//approximate bytes held
+		std::size_t bytes = 0; //everything; same as StochasticEffectPredictor::getMemoryUsage
+		std::size_t bytes_observed = 0; //the observed set and the singleton filter
+		std::size_t bytes_working = 0; //working set candidates, including their tables
+		std::size_t bytes_hypotheses = 0; //hypotheses, including their tables
+		std::size_t bytes_tables = 0; //every frequency table (baseline, working set and hypotheses), so this overlaps the two above
+		//sizes
+		std::size_t observed = 0;
+		std::size_t working = 0;
+		std::size_t hypotheses = 0;
+		//time spent in the predictor, in QPC ticks
+		std::size_t observations = 0;
+		INT64 observe_time = 0;
+		std::size_t predictions = 0;
+		INT64 predict_time = 0;
+		//candidate churn
+		std::size_t added = 0; //to the working set
+		std::size_t promoted = 0; //from the working set to the hypotheses
+		std::size_t evicted = 0; //dropped from the working set
+	};
+
+	void to_json(json& j, const PredictorStats& p); //times in ms
 
 	//
 	class StochasticEffectPredictor {
+		constexpr static std::size_t OBSERVE_GRAIN = 64; //number of working set candidates per chunk when observing in parallel
 		//
 		double alpha; //confidence level for counters
 		//
-		std::set<Condition> observed; //all CompoundPredicates ever used, so they don't get repeated
-		std::list<Candidate> working; //current list of predicates that are being tested (some will eventually go to hypotheses)
+		std::shared_ptr<ConditionRegistry> conditions; //shared with the other predictors of the same learner
+		std::vector<bool> observed; //all CompoundPredicates ever used, so they don't get repeated, as a bitmap over the registry's ids
+		std::size_t observed_count = 0; //number of set bits in 'observed'
+		std::vector<Candidate> working; //current list of predicates that are being tested (some will eventually go to hypotheses)
 		std::vector<Candidate> hypotheses; //list of predicates that given more information than baseline/random guess, kept in approximately sorted order (s.t. the first element is always the "best")
 		FrequencyTable baseline; //a counter that keeps track of baseline performance, and is used as the predictor until a PredicateCounter gets into the hypotheses set
+		PredicateCache cache; //every predicate used by 'working' and 'hypotheses', evaluated once per observation
+		SingletonFilter singletons; //the single-predicate conditions already passed to test_add (a subset of 'observed'; empty after loading)
 		//
 		int effect_count = 0; //number of observed effects, each of which is given a unique index starting at 0
 		std::map<Effect, size_t> effect_indices; //Effect -> int mapping
 		std::vector<Effect> effects; //int -> Effect mapping
 		//
+		std::shared_ptr<const EvictionPolicy> eviction; //never null
+		std::size_t memory_budget = 0; //bytes, for the working set (the only part eviction can free); 0 = unlimited
+		mutable std::size_t working_bytes = 0; //the working set's memory usage, as of the last time it was counted
+		mutable bool working_changed = true; //the working set has changed (candidates added, observed, reset or dropped) since then
+		std::size_t observation_count = 0; //number of observations that reached the working set, used as the clock for eviction
+		std::size_t evicted = 0; //number of working set candidates dropped so far
+		//accounting (see getStats); unlike 'evicted', none of this is saved with the model, so it counts from when the predictor was created or loaded
+		std::size_t added_count = 0; //number of candidates added to the working set
+		std::size_t promoted_count = 0; //number of candidates moved to the hypotheses
+		std::size_t observe_count = 0;
+		INT64 observe_time = 0;
+		std::size_t predict_count = 0;
+		INT64 predict_time = 0;
+		//
 		void test_add_pairs(const Types& types, int target_object_type, const Condition& a, const Condition& b);
 		void test_add(const Types& types, int target_object_type, const Condition& cp); //if not in observed, add to observed + current
+		void evict(); //apply the eviction policy and the memory budget to the working set, after it has been observed
 		//
 	public:
-		StochasticEffectPredictor(double alpha = 0.01); //default = 99% confidence interval
+		StochasticEffectPredictor(double alpha = 0.01, std::shared_ptr<ConditionRegistry> conditions = nullptr); //default = 99% confidence interval; without a registry, the predictor makes its own
 		//
-		void observe(const Types& types, const Object& target, const std::map<int, std::set<const Object*>>& objects_by_type, const Effect& effect);
-		ProbabilityDistribution<Effect> predict(const Object& target, const std::map<int, std::set<const Object*>>& objects_by_type) const;
+		//if a pool is given, the working set is observed in parallel; if an index (of objects_by_type) is given, positional predicates use it
+		void observe(const Types& types, const Object& target, const ObjectsByType& objects_by_type, const Effect& effect, ThreadPool* pool = nullptr, const SpatialIndex* index = nullptr);
+		ProbabilityDistribution<Effect> predict(const Object& target, const ObjectsByType& objects_by_type, const SpatialIndex* index = nullptr) const;
+		std::shared_ptr<const PredictorSnapshot> snapshot() const; //copy of the current prediction state; shares the (immutable) compiled hypothesis
+		FrozenPredictor freeze() const; //the current prediction state, with every observed input case's distribution worked out
 		//
-		const std::set<Condition>& getPredicatesObserved() const;
 		size_t getCountPredicatesObserved() const;
 		size_t getCountPredicatesTracked() const;
 		size_t getCountHypothesesTracked() const;
 		//
+		void setEviction(std::shared_ptr<const EvictionPolicy> policy, std::size_t memory_budget); //null policy = "none"; budget in bytes for the working set, 0 = unlimited
+		std::size_t getCountEvicted() const;
+		std::size_t getMemoryUsage() const; //approximate number of bytes used by this predictor, not counting the shared registry
+		std::size_t getWorkingMemoryUsage() const; //the part of getMemoryUsage that's in the working set, which is all eviction can free; only recounted after the working set changes
+		std::size_t shrink(std::size_t budget); //drop working set candidates (lowest priority first) until the working set fits in the budget; returns the number dropped
+		//
+		//the learner times its calls to observe/predict and records them here
+		void addObserveTime(std::size_t observations, INT64 time);
+		void addPredictTime(std::size_t predictions, INT64 time);
+		PredictorStats getStats() const;
+		//
 		void print(FILE* f, const Types& types, EffectType type) const;
 		//
 		json to_json(const Types& types) const;
 		void from_json(const Types& types, const json& j);
+		//conditions are written as their registry ids; condition_id maps an id in the file to the id in this predictor's registry (false if it's invalid)
+		//everything prediction needs comes first, so with predict_only the rest (working set, observed, all but the top hypothesis) is never read
+		void to_binary(BinaryWriter& out, const std::vector<std::uint64_t>& file_ids) const; //file_ids: registry id -> id in the file
+		void from_binary(BinaryReader& in, const std::function<bool(std::uint64_t, ConditionRegistry::Id&)>& condition_id, bool predict_only = false);
+	};
+
+	struct LazyModel; //the unread part of a binary model, for loading predictors on first use (see LearnerQORA::findPredictor)
+
+	//an immutable copy of everything LearnerQORA::predictTransition reads, so any number of threads can predict from it while the learner keeps learning
+	//predictors the learner hadn't read from its binary model yet are read by the snapshot itself, from the same data, the first time they're needed
+	class ModelSnapshot {
+		//a predictor that was still unread when the snapshot was published
+		struct PendingPredictor {
+			std::size_t offset; //of its data in the model
+			std::size_t size;
+			std::once_flag once;
+			std::shared_ptr<const PredictorSnapshot> predictor; //set by the first reader that needs it
+		};
+		//
+		std::shared_ptr<const Types> types;
+		int index_attribute;
+		std::uint64_t epoch; //the learner's snapshot count when this one was published
+		std::map<std::pair<EffectType, ActionId>, std::set<Effect>> effects_observed;
+		std::map<std::pair<EffectType, ActionId>, std::shared_ptr<const PredictorSnapshot>> predictors;
+		double alpha;
+		std::shared_ptr<const LazyModel> lazy; //the model the pending predictors are read from; only its data, type ids and condition offsets, which never change
+		mutable std::map<std::pair<EffectType, ActionId>, PendingPredictor> pending;
+		//
+		const PredictorSnapshot& getPredictor(const std::pair<EffectType, ActionId>& key) const; //reads it first if it's pending
+	public:
+		ModelSnapshot(std::shared_ptr<const Types> types, int index_attribute, std::uint64_t epoch, std::map<std::pair<EffectType, ActionId>, std::set<Effect>> effects_observed, std::map<std::pair<EffectType, ActionId>, std::shared_ptr<const PredictorSnapshot>> predictors,
+			double alpha = 0.0, std::shared_ptr<const LazyModel> lazy = nullptr);
+		//
+		std::uint64_t getEpoch() const;
+		StateDistribution predictTransition(const State& state, ActionId action, Random& random) const; //same as LearnerQORA::predictTransition at the time of the snapshot
 	};
 
+	class LearnerQORAFrozen;
+
 	class LearnerQORA : public Learner
 	{
+		constexpr static std::size_t PREDICT_WINDOW = 32; //number of transitions predicted together by predictTransitions
+		constexpr static std::uint64_t BINARY_VERSION = 2; //written at the start of the binary model, bumped whenever its layout changes
+		//
 		double alpha; //confidence level
+		std::unique_ptr<ThreadPool> pool; //used to observe the working sets in parallel; null if running single-threaded
+		std::shared_ptr<ConditionRegistry> conditions; //every condition observed by any of the predictors
+		std::shared_ptr<const EvictionPolicy> eviction; //given to each predictor
+		std::size_t memory_budget = 0; //bytes, over the working sets of all predictors; 0 = unlimited
+		std::size_t predictor_memory_budget = 0; //bytes, for each predictor's working set; 0 = unlimited
+		int index_attribute = -1; //attribute to build a SpatialIndex on for each observation (normally position); -1 = no index
 
 		std::map<std::pair<EffectType, ActionId>, std::set<Effect>> effects_observed; //the possible effects observed for each <object type, action> pair; once the set increases to >1 element, it gets an entry in the below map
-		std::map<std::pair<EffectType, ActionId>, StochasticEffectPredictor> predictors;
+		mutable std::map<std::pair<EffectType, ActionId>, StochasticEffectPredictor> predictors; //mutable, since a prediction may be the first use of a lazily loaded predictor
+
+		//lazy loading: after from_binary, the predictors are only read from the model's data when first used
+		mutable std::shared_ptr<LazyModel> lazy; //null once every predictor has been fully loaded
+		bool predict_only = false; //load predictors without the state that only learning needs
 
 		std::size_t last_predicates_observed = 0;
 
+		//published snapshots (RCU style): a new one replaces the old, which is freed once its last reader lets go
+		std::shared_ptr<const Types> snapshot_types; //shared by all snapshots, so they don't depend on the learner's lifetime
+		std::shared_ptr<const ModelSnapshot> snapshot; //only accessed through std::atomic_load / std::atomic_store
+		std::atomic<std::uint64_t> snapshot_epoch{ 0 }; //epoch of the latest snapshot, so readers can check theirs without touching the pointer
+
+		void observeBatch(const Transition* first, const Transition* last); //observe a run of transitions, walking each predictor once
+		//null if there is none; loads it first if it hasn't been: fully if for learning, otherwise only what prediction needs if prediction_only (or predict_only) is set
+		StochasticEffectPredictor* findPredictor(const std::pair<EffectType, ActionId>& key, bool for_learning, bool prediction_only = false) const;
+		void loadPredictors(bool for_learning, bool prediction_only = false) const; //load every predictor that hasn't been yet
+
 	public:
 
-		LearnerQORA(const Types& types, double alpha);
+		LearnerQORA(const Types& types, double alpha, int threads = 1, std::shared_ptr<const EvictionPolicy> eviction = nullptr, std::size_t memory_budget = 0, std::size_t predictor_memory_budget = 0, int index_attribute = -1);
 
 		//learner-specific functions
 		double getAlpha() const;
+		int getThreads() const;
+		int getIndexAttribute() const;
 		std::size_t countTotalPredicatesObserved() const; //sum the number of predicates observed by each predictor (this will double-count many of them)
-		std::size_t countUniquePredicatesObserved() const; //sum the number of predicates observed by each predictor (will not double-count)
+		std::size_t countUniquePredicatesObserved() const; //sum the number of predicates observed by each predictor (will not double-count; this is just the size of the registry)
 		std::size_t countLastPredicatesObserved() const; //sum the number of predicates observed by each predictor, only if it was used in the last call to observe()
+		std::size_t countEvicted() const; //sum the number of working set candidates dropped by each predictor
+		std::size_t getMemoryUsage() const; //approximate number of bytes used by the predictors (not counting the registry)
+		std::size_t getRegistryMemoryUsage() const;
+		std::map<std::pair<EffectType, ActionId>, PredictorStats> getPredictorStats() const; //memory, time and churn of each complex predictor
+
+		//snapshots, for predicting on other threads while this one keeps learning
+		//nothing is published automatically (except after reset, from_json and from_binary); the learning thread decides how stale the readers may get
+		//publishing doesn't load anything from a binary model: the snapshot reads the predictors that are still unread itself, when a reader first needs them
+		void publishSnapshot(); //copy the current hypotheses into a new snapshot; only from the thread that does the learning
+		std::shared_ptr<const ModelSnapshot> getSnapshot() const; //the latest published snapshot; safe from any thread
+		std::uint64_t getSnapshotEpoch() const; //epoch of the latest published snapshot; safe from any thread
+
+		//export the current hypotheses as an inference-only model
+		std::unique_ptr<LearnerQORAFrozen> freeze() const;
 
 		//just in case I need this
 		//clear all learned parameters
@@ -165,12 +584,40 @@ namespace l_qora {
 		//observe (s, a, s')
 		virtual void observeTransition(const State& prevState, ActionId action, const State& nextState);
 
+		//batch versions: the objects of each state are only sorted once, and each predictor is walked once per batch
+		virtual std::vector<StateDistribution> predictTransitions(const std::vector<Transition>& transitions, Random& random) const;
+		virtual void observeTransitions(const std::vector<Transition>& transitions);
+
 		//print some info about current observations and rules
 		virtual void print(FILE* f) const;
 
 		//save/load model (json)
 		virtual json to_json() const;
 		virtual void from_json(const json& j);
+
+		//save/load model (binary): type names are written once in a table at the start, every condition is written once (in registry order)
+		//and referred to by id, and all counts are varints
+		//the conditions and predictors are indexed by size up front, so from_binary only reads each one when it's first needed
+		virtual void to_binary(BinaryWriter& out) const;
+		virtual void from_binary(BinaryReader& in);
+
+		//binary models are then loaded with only what predictTransition needs; a predictor is loaded again in full if it's needed for learning after all
+		virtual void setPredictOnly(bool predict_only);
+
+		//the learner-wide memory numbers, then getPredictorStats as a list with each predictor's effect type and action
+		virtual json getStats() const;
+	};
+
+	//one reader thread's handle on a learner's snapshots
+	//in the common case the read path is a single atomic load of the epoch; the snapshot pointer is only re-fetched after the learner publishes a new one
+	class SnapshotReader {
+		const LearnerQORA* learner;
+		std::shared_ptr<const ModelSnapshot> current;
+	public:
+		SnapshotReader(const LearnerQORA& learner);
+		//
+		const ModelSnapshot& get(); //the latest published snapshot (stays valid until the next call)
+		StateDistribution predictTransition(const State& state, ActionId action, Random& random); //predict with the latest published snapshot
 	};
 
 
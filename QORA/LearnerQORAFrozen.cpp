@@ -0,0 +1,476 @@
+#include "pch.h"
+#include "LearnerQORAFrozen.h"
+
+namespace l_qora {
+
+	constexpr std::size_t FrozenPredictor::DENSE_MAX_INPUTS;
+	constexpr std::uint32_t FrozenPredictor::SLOT_EMPTY;
+
+	//fibonacci hashing, spreads out the (usually small, sequential) input cases
+	static inline std::size_t slot_hash(std::size_t key, std::size_t mask)
+	{
+		return std::size_t((std::uint64_t(key) * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+	}
+
+	//distributions are stored as a list of [effect, probability] pairs
+	static json distribution_to_json(const ProbabilityDistribution<Effect>& distribution)
+	{
+		json j = json::array();
+		for (const auto& pair : distribution.getProbabilities()) {
+			j.push_back(json::array({ json(pair.first), pair.second }));
+		}
+		return j;
+	}
+
+	static ProbabilityDistribution<Effect> distribution_from_json(const json& j)
+	{
+		ProbabilityDistribution<Effect> distribution;
+		for (const json& pair : j) {
+			distribution.setProbability(pair.at(0).get<Effect>(), pair.at(1).get<double>());
+		}
+		return distribution;
+	}
+
+	static void write_distribution(BinaryWriter& out, const ProbabilityDistribution<Effect>& distribution)
+	{
+		out.writeVarint(distribution.size());
+		for (const auto& pair : distribution.getProbabilities()) {
+			write_value(out, pair.first);
+			out.writeDouble(pair.second);
+		}
+	}
+
+	static ProbabilityDistribution<Effect> read_distribution(BinaryReader& in)
+	{
+		ProbabilityDistribution<Effect> distribution;
+		std::uint64_t n = in.readVarint();
+		for (std::uint64_t i = 0; i < n && in.ok(); i++) {
+			Effect e = read_value(in);
+			distribution.setProbability(e, in.readDouble());
+		}
+		return distribution;
+	}
+
+	static void print_distribution(FILE* f, const ProbabilityDistribution<Effect>& distribution)
+	{
+		bool needs_comma = false;
+		for (const auto& pair : distribution.getProbabilities()) {
+			if (needs_comma) fprintf(f, "; ");
+			fprintf(f, "%s %.2f%%", pair.first.to_string().c_str(), pair.second * 100);
+			needs_comma = true;
+		}
+	}
+
+	FrozenPredictor::FrozenPredictor() : distributions(1)
+	{
+		buildIndex();
+	}
+
+	FrozenPredictor::FrozenPredictor(const Condition* condition, const FrequencyTable& table, const std::vector<Effect>& effects) :
+		has_condition(condition != nullptr), input_states(table.getInputStates())
+	{
+		if (has_condition) {
+			this->condition = *condition;
+			compiled = std::make_shared<const CompiledCondition>(this->condition);
+		}
+		//an input the table has never seen gets the same guess as in StochasticEffectPredictor::predict
+		distributions.push_back(effects.empty() ? ProbabilityDistribution<Effect>() : predict_effects(table, table.getInputStates(), effects));
+		for (std::size_t input : table.getObservedInputStates()) {
+			inputs.push_back(input);
+			distributions.push_back(predict_effects(table, input, effects));
+		}
+		buildIndex();
+	}
+
+	void FrozenPredictor::buildIndex()
+	{
+		dense = input_states <= DENSE_MAX_INPUTS;
+		for (std::size_t input : inputs) {
+			if (input >= input_states) dense = false; //the table went sparse to fit it
+		}
+		if (dense) {
+			slots.assign(input_states, 0);
+			for (std::size_t i = 0; i < inputs.size(); i++) {
+				slots[inputs[i]] = std::uint32_t(i + 1);
+			}
+			return;
+		}
+		//load factor <= 1/2
+		std::size_t slot_count = 2;
+		while (slot_count < inputs.size() * 2) slot_count *= 2;
+		slots.assign(slot_count, SLOT_EMPTY);
+		std::size_t mask = slot_count - 1;
+		for (std::size_t r = 0; r < inputs.size(); r++) {
+			std::size_t i = slot_hash(inputs[r], mask);
+			while (slots[i] != SLOT_EMPTY) i = (i + 1) & mask;
+			slots[i] = std::uint32_t(r);
+		}
+	}
+
+	const ProbabilityDistribution<Effect>& FrozenPredictor::predict(const Object& target, const ObjectsByType& objects_by_type, const SpatialIndex* index) const
+	{
+		std::size_t input = compiled ? compiled->evaluate(target, objects_by_type, index) : 0;
+		if (dense) {
+			return distributions[(input < slots.size()) ? slots[input] : 0];
+		}
+		std::size_t mask = slots.size() - 1;
+		for (std::size_t i = slot_hash(input, mask); ; i = (i + 1) & mask) {
+			std::uint32_t r = slots[i];
+			if (r == SLOT_EMPTY) return distributions[0];
+			if (inputs[r] == input) return distributions[r + 1];
+		}
+	}
+
+	std::size_t FrozenPredictor::countCases() const
+	{
+		return inputs.size();
+	}
+
+	std::size_t FrozenPredictor::getMemoryUsage() const
+	{
+		std::size_t total = sizeof(*this);
+		if (compiled) total += compiled->getMemoryUsage();
+		total += distributions.capacity() * sizeof(ProbabilityDistribution<Effect>);
+		for (const ProbabilityDistribution<Effect>& distribution : distributions) {
+			for (const auto& pair : distribution.getProbabilities()) {
+				//one map node each, plus the effect's components
+				total += 4 * sizeof(void*) + sizeof(pair) + pair.first.getHeapUsage();
+			}
+		}
+		total += inputs.capacity() * sizeof(std::size_t);
+		total += slots.capacity() * sizeof(std::uint32_t);
+		return total;
+	}
+
+	void FrozenPredictor::print(FILE* f, const Types& types, EffectType type) const
+	{
+		fprintf(f, "     ");
+		if (has_condition) {
+			condition.print(f, types, type.object_type);
+		}
+		else {
+			fprintf(f, "(baseline)");
+		}
+		fprintf(f, "\n");
+		for (std::size_t i = 0; i < inputs.size(); i++) {
+			fprintf(f, "      ");
+			if (has_condition) {
+				condition.printCaseInfo(f, types, type.object_type, inputs[i]);
+			}
+			else {
+				fprintf(f, "always");
+			}
+			fprintf(f, "\n       ");
+			print_distribution(f, distributions[i + 1]);
+			fprintf(f, "\n");
+		}
+		fprintf(f, "      otherwise\n       ");
+		print_distribution(f, distributions[0]);
+		fprintf(f, "\n");
+	}
+
+	json FrozenPredictor::to_json(const Types& types) const
+	{
+		json j;
+		if (has_condition) {
+			l_qora::to_json(j["condition"], condition, types);
+		}
+		else {
+			j["condition"] = nullptr;
+		}
+		j["inputs"] = input_states;
+		j["default"] = distribution_to_json(distributions[0]);
+		json& j_cases = j["cases"];
+		j_cases = json::array();
+		for (std::size_t i = 0; i < inputs.size(); i++) {
+			j_cases.push_back(json{
+				{"input", inputs[i]},
+				{"effects", distribution_to_json(distributions[i + 1])}
+			});
+		}
+		return j;
+	}
+
+	void FrozenPredictor::from_json(const Types& types, const json& j)
+	{
+		const json& j_condition = j.at("condition");
+		has_condition = !j_condition.is_null();
+		condition = Condition();
+		compiled.reset();
+		if (has_condition) {
+			l_qora::from_json(j_condition, condition, types);
+			compiled = std::make_shared<const CompiledCondition>(condition);
+		}
+		input_states = j.at("inputs").get<std::size_t>();
+		distributions.clear();
+		inputs.clear();
+		distributions.push_back(distribution_from_json(j.at("default")));
+		for (const json& j_case : j.at("cases")) {
+			inputs.push_back(j_case.at("input").get<std::size_t>());
+			distributions.push_back(distribution_from_json(j_case.at("effects")));
+		}
+		buildIndex();
+	}
+
+	void FrozenPredictor::to_binary(BinaryWriter& out) const
+	{
+		out.writeVarint(has_condition ? 1 : 0);
+		if (has_condition) write_condition(out, condition);
+		out.writeVarint(input_states);
+		write_distribution(out, distributions[0]);
+		out.writeVarint(inputs.size());
+		for (std::size_t i = 0; i < inputs.size(); i++) {
+			out.writeVarint(inputs[i]);
+			write_distribution(out, distributions[i + 1]);
+		}
+	}
+
+	void FrozenPredictor::from_binary(BinaryReader& in, const BinaryTypes& ids)
+	{
+		has_condition = in.readVarint() != 0;
+		condition = Condition();
+		compiled.reset();
+		if (has_condition) {
+			condition = read_condition(in, ids);
+			compiled = std::make_shared<const CompiledCondition>(condition);
+		}
+		input_states = std::size_t(in.readVarint());
+		distributions.clear();
+		inputs.clear();
+		distributions.push_back(read_distribution(in));
+		std::uint64_t n = in.readVarint();
+		for (std::uint64_t i = 0; i < n && in.ok(); i++) {
+			inputs.push_back(std::size_t(in.readVarint()));
+			distributions.push_back(read_distribution(in));
+		}
+		//a corrupt size can't be allowed to allocate a huge dense index
+		if (!in.ok()) {
+			input_states = 1;
+			inputs.clear();
+			distributions.resize(1);
+		}
+		buildIndex();
+	}
+
+	constexpr std::uint64_t LearnerQORAFrozen::BINARY_VERSION;
+
+	LearnerQORAFrozen::LearnerQORAFrozen(const Types& types, int index_attribute) : Learner("qora_frozen", types), index_attribute(index_attribute)
+	{
+		reset();
+	}
+
+	LearnerQORAFrozen::Entry* LearnerQORAFrozen::findEntry(const std::pair<EffectType, ActionId>& key)
+	{
+		return const_cast<Entry*>(static_cast<const LearnerQORAFrozen*>(this)->findEntry(key.first.object_type, key.first.attribute_type, key.second));
+	}
+
+	const LearnerQORAFrozen::Entry* LearnerQORAFrozen::findEntry(int object_type, int attribute, ActionId action) const
+	{
+		std::size_t n_object_types = types.getObjectTypes().size();
+		std::size_t n_attributes = types.getAttributeTypes().size();
+		if (object_type < 0 || std::size_t(object_type) >= n_object_types || attribute < 0 || std::size_t(attribute) >= n_attributes) return nullptr;
+		std::size_t i = (std::size_t(action) * n_object_types + std::size_t(object_type)) * n_attributes + std::size_t(attribute);
+		return (i < entries.size()) ? &entries[i] : nullptr;
+	}
+
+	void LearnerQORAFrozen::fillEntries()
+	{
+		for (auto& pair : singletons) {
+			Entry* entry = findEntry(pair.first);
+			if (entry) entry->singleton = &pair.second;
+		}
+		for (auto& pair : predictors) {
+			Entry* entry = findEntry(pair.first);
+			if (entry) entry->predictor = &pair.second;
+		}
+	}
+
+	void LearnerQORAFrozen::addSingleton(const std::pair<EffectType, ActionId>& key, const Effect& effect)
+	{
+		Effect& singleton = singletons[key];
+		singleton = effect;
+		Entry* entry = findEntry(key);
+		if (entry) entry->singleton = &singleton;
+	}
+
+	void LearnerQORAFrozen::addPredictor(const std::pair<EffectType, ActionId>& key, const FrozenPredictor& predictor)
+	{
+		FrozenPredictor& added = predictors[key];
+		added = predictor;
+		Entry* entry = findEntry(key);
+		if (entry) entry->predictor = &added;
+	}
+
+	const FrozenPredictor* LearnerQORAFrozen::getPredictor(const std::pair<EffectType, ActionId>& key) const
+	{
+		const Entry* entry = findEntry(key.first.object_type, key.first.attribute_type, key.second);
+		return entry ? entry->predictor : nullptr;
+	}
+
+	std::size_t LearnerQORAFrozen::countCases() const
+	{
+		std::size_t total = 0;
+		for (const auto& pair : predictors) {
+			total += pair.second.countCases();
+		}
+		return total;
+	}
+
+	std::size_t LearnerQORAFrozen::getMemoryUsage() const
+	{
+		std::size_t total = 0;
+		for (const auto& pair : predictors) {
+			total += pair.second.getMemoryUsage();
+		}
+		return total;
+	}
+
+	void LearnerQORAFrozen::reset()
+	{
+		singletons.clear();
+		predictors.clear();
+		entries.assign(types.getActions().size() * types.getObjectTypes().size() * types.getAttributeTypes().size(), Entry{ nullptr, nullptr });
+	}
+
+	void LearnerQORAFrozen::restart()
+	{
+		//no history is kept for this learner, so this is blank
+	}
+
+	StateDistribution LearnerQORAFrozen::predictTransition(const State& state, ActionId action, Random&) const
+	{
+		const ObjectsByType& objects_by_type = state.getObjectsByType();
+		SpatialIndex index; //only built once a predictor needs it
+
+		StateDistribution newState(arena); //this stores all the objects with a future distribution
+		predict_objects(state, types, newState, arena, [&](const Object& obj, int attribute) {
+			const Entry* entry = findEntry(obj.getTypeId(), attribute, action);
+			if (entry == nullptr) return AttributeEffects{ nullptr, nullptr };
+			if (entry->predictor) {
+				//complex predictor
+				if (index_attribute >= 0 && index.getAttributeType() == -1) index.build(index_attribute, objects_by_type);
+				return AttributeEffects{ nullptr, &entry->predictor->predict(obj, objects_by_type, (index_attribute >= 0) ? &index : nullptr) };
+			}
+			//singleton predictor, or (if null) never seen this combination of [obj type, attribute id, action], so assume nothing will happen
+			return AttributeEffects{ entry->singleton, nullptr };
+		});
+		return newState;
+	}
+
+	void LearnerQORAFrozen::observeTransition(const State&, ActionId, const State&)
+	{
+		//frozen: nothing to learn
+	}
+
+	void LearnerQORAFrozen::print(FILE* f) const
+	{
+		fprintf(f, "Frozen: %zu predictors with %zu input cases, %zu singletons; %zu bytes\n", predictors.size(), countCases(), singletons.size(), getMemoryUsage());
+		fprintf(f, "Observations:\n");
+		if (predictors.empty() && singletons.empty()) {
+			fprintf(f, " none\n");
+		}
+		for (const auto& pair : predictors) {
+			EffectType type = pair.first.first;
+			ActionId action = pair.first.second;
+			fprintf(f, " %s %s.%s:\n", types.getActions().at(action).name.c_str(), types.getObjectType(type.object_type).name.c_str(), types.getAttributeType(type.attribute_type).name.c_str());
+			pair.second.print(f, types, type);
+		}
+		for (const auto& pair : singletons) {
+			EffectType type = pair.first.first;
+			ActionId action = pair.first.second;
+			fprintf(f, " %s %s.%s += %s\n", types.getActions().at(action).name.c_str(), types.getObjectType(type.object_type).name.c_str(), types.getAttributeType(type.attribute_type).name.c_str(), pair.second.to_string().c_str());
+		}
+	}
+
+	json LearnerQORAFrozen::to_json() const
+	{
+		json data;
+		//stored as lists of tuples: [(EffectType, ActionId, Effect)] and [(EffectType, ActionId, FrozenPredictor)]
+		json& data_singletons = data["singletons"];
+		data_singletons = json::array();
+		for (const auto& pair : singletons) {
+			json j{
+				{"action", types.getActions().at(pair.first.second).name},
+				{"effect", pair.second}
+			};
+			l_qora::to_json(j["effect_type"], pair.first.first, types);
+			data_singletons.push_back(j);
+		}
+		json& data_predictors = data["predictors"];
+		data_predictors = json::array();
+		for (const auto& pair : predictors) {
+			json j{
+				{"action", types.getActions().at(pair.first.second).name},
+				{"predictor", pair.second.to_json(types)}
+			};
+			l_qora::to_json(j["effect_type"], pair.first.first, types);
+			data_predictors.push_back(j);
+		}
+		//memory stats (informational; not read back)
+		data["memory"] = json{
+			{"predictors", getMemoryUsage()}
+		};
+		return data;
+	}
+
+	void LearnerQORAFrozen::from_json(const json& j)
+	{
+		reset();
+		for (const json& tuple : j.at("singletons")) {
+			EffectType e_type;
+			l_qora::from_json(tuple.at("effect_type"), e_type, types);
+			int action = types.getActionByName(tuple.at("action").get<std::string>());
+			singletons[{ e_type, action }] = tuple.at("effect").get<Effect>();
+		}
+		for (const json& tuple : j.at("predictors")) {
+			EffectType e_type;
+			l_qora::from_json(tuple.at("effect_type"), e_type, types);
+			int action = types.getActionByName(tuple.at("action").get<std::string>());
+			predictors[{ e_type, action }].from_json(types, tuple.at("predictor"));
+		}
+		fillEntries();
+	}
+
+	void LearnerQORAFrozen::to_binary(BinaryWriter& out) const
+	{
+		out.writeVarint(BINARY_VERSION);
+		//string table
+		write_binary_types(out, types);
+		//singletons: key, effect
+		out.writeVarint(singletons.size());
+		for (const auto& pair : singletons) {
+			write_key(out, pair.first);
+			write_value(out, pair.second);
+		}
+		//predictors: key, predictor
+		out.writeVarint(predictors.size());
+		for (const auto& pair : predictors) {
+			write_key(out, pair.first);
+			pair.second.to_binary(out);
+		}
+	}
+
+	void LearnerQORAFrozen::from_binary(BinaryReader& in)
+	{
+		reset();
+		std::uint64_t version = in.readVarint();
+		if (version != BINARY_VERSION) {
+			Logger::log(Logger::formatString("Unsupported qora_frozen binary model version: %llu", (unsigned long long)version), true);
+			in.fail();
+			return;
+		}
+		BinaryTypes ids = read_binary_types(in, types);
+		std::uint64_t n = in.readVarint();
+		for (std::uint64_t i = 0; i < n && in.ok(); i++) {
+			std::pair<EffectType, ActionId> key = read_key(in, ids);
+			singletons[key] = read_value(in);
+		}
+		n = in.readVarint();
+		for (std::uint64_t i = 0; i < n && in.ok(); i++) {
+			std::pair<EffectType, ActionId> key = read_key(in, ids);
+			predictors[key].from_binary(in, ids);
+		}
+		fillEntries();
+	}
+
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "LearnerQORA.h"
+
+namespace l_qora {
+
+	//the top hypothesis of a StochasticEffectPredictor (or its baseline, if it has none), compiled for prediction only:
+	//the distribution over effects of every input case the table has seen is worked out ahead of time, so predict() is one table lookup
+	class FrozenPredictor {
+		constexpr static std::size_t DENSE_MAX_INPUTS = 4096; //tables with at most this many input cases get one slot per case; bigger ones are hashed
+		constexpr static std::uint32_t SLOT_EMPTY = 0xFFFFFFFF;
+		//
+		bool has_condition = false; //false: baseline, every input is case 0
+		Condition condition;
+		std::shared_ptr<const CompiledCondition> compiled; //null without a condition
+		std::size_t input_states = 1; //number of input cases of the table
+		std::vector<ProbabilityDistribution<Effect>> distributions; //distributions[0] is used for every input case that was never observed
+		std::vector<std::size_t> inputs; //the input case of each other distribution (inputs[i] goes with distributions[i + 1])
+		bool dense = true;
+		std::vector<std::uint32_t> slots; //dense: input case -> index in distributions; sparse: open addressing over 'inputs', size is a power of 2
+		//
+		void buildIndex(); //fill 'slots' from 'inputs'
+	public:
+		FrozenPredictor();
+		FrozenPredictor(const Condition* condition, const FrequencyTable& table, const std::vector<Effect>& effects); //condition = the top hypothesis, or null for the baseline
+		//
+		const ProbabilityDistribution<Effect>& predict(const Object& target, const ObjectsByType& objects_by_type, const SpatialIndex* index = nullptr) const; //same as StochasticEffectPredictor::predict, without allocating
+		std::size_t countCases() const; //number of observed input cases
+		std::size_t getMemoryUsage() const; //approximate number of bytes used, including heap storage
+		//
+		void print(FILE* f, const Types& types, EffectType type) const;
+		//
+		json to_json(const Types& types) const;
+		void from_json(const Types& types, const json& j);
+		void to_binary(BinaryWriter& out) const;
+		void from_binary(BinaryReader& in, const BinaryTypes& ids);
+	};
+
+	//an inference-only QORA model, exported from a trained LearnerQORA by LearnerQORA::freeze (or the "freeze" mode)
+	//it keeps nothing but the top hypothesis of each predictor, so it can't learn: observations are ignored
+	class LearnerQORAFrozen : public Learner
+	{
+		constexpr static std::uint64_t BINARY_VERSION = 1; //written at the start of the binary model, bumped whenever its layout changes
+		//
+		//what is known about each <object type, attribute, action>, in one flat table, so a prediction doesn't have to search the maps for every attribute of every object
+		struct Entry {
+			const Effect* singleton; //in 'singletons', or null
+			const FrozenPredictor* predictor; //in 'predictors', or null
+		};
+		//
+		int index_attribute = -1; //attribute to build a SpatialIndex on for each prediction (normally position); -1 = no index
+		std::map<std::pair<EffectType, ActionId>, Effect> singletons; //<object type, action> pairs that have only ever had one effect
+		std::map<std::pair<EffectType, ActionId>, FrozenPredictor> predictors; //the ones that have had more
+		std::vector<Entry> entries; //[(action * object types + object type) * attribute types + attribute]; map nodes don't move, so the pointers stay valid
+		//
+		Entry* findEntry(const std::pair<EffectType, ActionId>& key); //null if the key is outside the types
+		const Entry* findEntry(int object_type, int attribute, ActionId action) const;
+		void fillEntries(); //points the table at everything in the maps (after loading them)
+
+	public:
+
+		LearnerQORAFrozen(const Types& types, int index_attribute = -1);
+
+		//learner-specific functions
+		void addSingleton(const std::pair<EffectType, ActionId>& key, const Effect& effect);
+		void addPredictor(const std::pair<EffectType, ActionId>& key, const FrozenPredictor& predictor);
+		const FrozenPredictor* getPredictor(const std::pair<EffectType, ActionId>& key) const; //null if there is none
+		std::size_t countCases() const; //sum of the observed input cases of each predictor
+		std::size_t getMemoryUsage() const; //approximate number of bytes used by the predictors
+
+		//clear the model
+		virtual void reset();
+
+		virtual void restart(); //erase any stored history, if necessary; this is called before a new episode is started
+
+		//return a probability distribution over future states P(s, a, s')
+		virtual StateDistribution predictTransition(const State& state, ActionId action, Random& random) const;
+
+		//frozen: does nothing
+		virtual void observeTransition(const State& prevState, ActionId action, const State& nextState);
+
+		//print some info about the model
+		virtual void print(FILE* f) const;
+
+		//save/load model (json)
+		virtual json to_json() const;
+		virtual void from_json(const json& j);
+
+		//save/load model (binary): the same string table as LearnerQORA, then the singletons and predictors, with the distributions' probabilities as doubles
+		virtual void to_binary(BinaryWriter& out) const;
+		virtual void from_binary(BinaryReader& in);
+	};
+
+}
@@ -249,9 +249,7 @@ const Parameter& Parameters::getParameter(int index) const
 bool Parameters::parse(const std::string& args, std::map<std::string, std::string>& values)
 {
     //pre-populate with any default values
-    for (const Parameter& param : parameters) {
-        if (param.has_default) values[param.name] = param.default_value;
-    }
+    addDefaults(values);
     //parse given args
     if(args.size() > 0) {
         std::vector<std::string> argpairs = str_split(args, ",");
@@ -291,3 +289,10 @@ bool Parameters::parse(const std::string& args, std::map<std::string, std::strin
     //
     return true;
 }
+
+void Parameters::addDefaults(std::map<std::string, std::string>& values) const
+{
+    for (const Parameter& param : parameters) {
+        if (param.has_default) values.insert({ param.name, param.default_value });
+    }
+}
@@ -67,5 +67,6 @@ public:
     Parameter& getParameter(int index);
     const Parameter& getParameter(int index) const;
     bool parse(const std::string& args, std::map<std::string, std::string>& values); //parses comma-separated param:value pairs, stores them in a map, and returns true if parsing encountered no errors
+    void addDefaults(std::map<std::string, std::string>& values) const; //adds the default value of any parameter missing from the map (e.g. values saved before the parameter existed)
 };
 
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "Arena.h"
 #include "Random.h"
 
 template<typename T>
@@ -13,16 +14,19 @@ public:
 	static ProbabilityDistribution<T> add(const std::set<ProbabilityDistribution<T>>& distributions);
 	static ProbabilityDistribution<T> add(const ProbabilityDistribution<ProbabilityDistribution<T>>& distributions); //allows weighted combination
 
+	typedef ArenaMap<T, double> Map;
 private:
-	std::map<T, double> probabilities;
+	Map probabilities;
 public:
 	ProbabilityDistribution();
 	ProbabilityDistribution(const T& singleton); //create a singleton distribution with P[t]=1
+	explicit ProbabilityDistribution(Arena* arena); //empty, keeping its entries in the arena (copies of it go on the heap)
 	//raw access to inner data
 	void clear();
 	size_t size() const;
-	std::map<T, double>& getProbabilities();
-	const std::map<T, double>& getProbabilities() const;
+	Map& getProbabilities();
+	const Map& getProbabilities() const;
+	Arena* getArena() const; //null if it's on the heap
 	//sample a random value from the distribution
 	const T& sample(Random& random) const;
 	const T& max() const;
@@ -31,6 +35,7 @@ public:
 	void normalize(); //treat all current "probabilities" as weights and normalize the sum to 1 [unless it is currently 0]
 	//
 	void setProbability(const T& item, double probability); //probabilities[item] = probability
+	void setProbability(T&& item, double probability); //same, moving the item in (so an item made in this distribution's arena stays there)
 	void addProbability(const T& item, double probability); //probabilities[item] += probability
 	double getProbability(const T& item) const; //probabilities[item]
 	void add(const T& item); //adds item with probability 1 so the distribution can later be normalized
@@ -78,6 +83,11 @@ inline ProbabilityDistribution<T>::ProbabilityDistribution(const T& singleton)
 	probabilities[singleton] = 1;
 }
 
+template<typename T>
+inline ProbabilityDistribution<T>::ProbabilityDistribution(Arena* arena) : probabilities(ArenaAllocator<std::pair<const T, double>>(arena))
+{
+}
+
 template<typename T>
 inline void ProbabilityDistribution<T>::clear()
 {
@@ -91,17 +101,23 @@ inline size_t ProbabilityDistribution<T>::size() const
 }
 
 template<typename T>
-inline std::map<T, double>& ProbabilityDistribution<T>::getProbabilities()
+inline typename ProbabilityDistribution<T>::Map& ProbabilityDistribution<T>::getProbabilities()
 {
 	return probabilities;
 }
 
 template<typename T>
-inline const std::map<T, double>& ProbabilityDistribution<T>::getProbabilities() const
+inline const typename ProbabilityDistribution<T>::Map& ProbabilityDistribution<T>::getProbabilities() const
 {
 	return probabilities;
 }
 
+template<typename T>
+inline Arena* ProbabilityDistribution<T>::getArena() const
+{
+	return probabilities.get_allocator().getArena();
+}
+
 template<typename T>
 inline const T& ProbabilityDistribution<T>::sample(Random& random) const
 {
@@ -159,6 +175,17 @@ inline void ProbabilityDistribution<T>::setProbability(const T& item, double pro
 	}
 }
 
+template<typename T>
+inline void ProbabilityDistribution<T>::setProbability(T&& item, double probability)
+{
+	if (probability == 0) {
+		probabilities.erase(item);
+	}
+	else {
+		probabilities[std::move(item)] = probability;
+	}
+}
+
 template<typename T>
 inline void ProbabilityDistribution<T>::addProbability(const T& item, double probability)
 {
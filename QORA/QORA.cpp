@@ -3,10 +3,13 @@
 #include "Environment.h"
 #include "Domains.h"
 #include "LearnerQORA.h"
+#include "LearnerQORAFrozen.h"
 
 #include "util.h"
 #include "Parameters.h"
 #include "Serialization.h"
+#include "StatePool.h"
+#include "Benchmarks.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 //benchmarking options
@@ -24,6 +27,12 @@ struct LearnerConstructor {
     //
     Parameters params;
     Constructor constructor; //construct a learner on the heap and return it, using the given cmdline parameters
+    //parameters saved with a model, plus the defaults of any parameters added since it was saved
+    std::map<std::string, std::string> savedParams(const json& saved) const {
+        std::map<std::string, std::string> values = saved.get<std::map<std::string, std::string>>();
+        params.addDefaults(values);
+        return values;
+    }
 };
 
 struct Contents {
@@ -94,7 +103,8 @@ void print_usage(const char* exe) {
   * view <file>: Takes a pre-generated observations file (from gen/verbose) \n\
      and allows the user to step through (s, a, s') observation triplets one-at-a-time\n\
 \n\
-  * predict <learner(s)> <model file name stem> <data output file> <input file> [k=1]:\n\
+  * predict <learner(s)> <model file name stem> <data output file> <input file> [k=1] [model format: json|binary, default=json]\
+     [stats: true|false, default=false] [arena: true|false, default=false]:\n\
      Feeds the observations from a pre-generated list of states\n\
      (concise or verbose) to a set of learners and evaluates their prediction accuracies\n\
      (prints the prediction error of each observation)\n\
@@ -103,15 +113,23 @@ void print_usage(const char* exe) {
     - The final learned models are saved to disk for later use\n\
        with filenames <model file name>_<learner index>.json if k=1\n\
        or <model file name>_<learner index>_<training index>.json if k>1\n\
+       (.qmb instead of .json for the compact binary format)\n\
+    - If stats is true, each learner's instrumentation (for qora: memory, time and candidate churn of each predictor)\n\
+       is saved next to its model, as <model file name>_stats.json\n\
+    - If arena is true, the learners make their predictions (and for qora, their other temporaries)\n\
+       in an arena that is released all at once after each observation, instead of on the heap\n\
     - If k>1, the above routine is run k times and the given input/output file names are treated as stems\n\
        so the actual filenames will be <file>_i.txt\n\
 \n\
   * predict_pt <learner file(s)> <model file name stem> <data output file> <observations file>\
-     [learning enabled, true|false, default=false] [k=1]:\n\
+     [learning enabled, true|false, default=false] [k=1] [model format: json|binary, default=json]:\n\
      Load pre-trained models from the disk and evaluate them on observations loaded from a pre-generated file\n\
+    - Models can be loaded from either format; the format argument picks the extension of the input models if k>1\n\
+       and the format of the updated models\n\
     - If learning is enabled, the updated models are saved to disk for later use\n\
        with filenames <model file name>_<learner index>.json if k=1\n\
        or <model file name>_<learner index>_<training index>.json if k>1\n\
+       (.qmb instead of .json for the compact binary format)\n\
     - Multiple learner filename stems can be given, separated by semicolons\n\
     - If k>1, the above routine is run k times and the given learner/input/output file names are treated as stems\n\
        so the actual filenames will be <file>_i.txt\n\
@@ -120,11 +138,19 @@ void print_usage(const char* exe) {
      so that all of the data collected for a given learner over each run is combined\n\
      and groups of n consecutive observations are also combined to condense the data\n\
 \n\
-  * print <learner file>: Print a learned model's parameters\n\
+  * print <learner file> [stats output file]: Print a learned model's parameters (either format)\n\
+    - If a stats file is given, the learner's instrumentation (for qora: memory, time and candidate churn\n\
+       of each predictor) is also written to it as json\n\
+\n\
+  * freeze <learner file> <output file> [model format: json|binary, default=json]:\n\
+     Export a trained qora model (either format) as an inference-only qora_frozen model\n\
+    - Only the top hypothesis of each predictor is kept, with the distribution of every input case precomputed\n\
+    - The frozen model can be used anywhere a model file is (predict_pt, print), but it ignores new observations\n\
 \n\
-  * test <learner> <domain> <m>: Tests a learning algorithm on a domain,\n\
+  * test <learner> <domain> <m> [m2=1] [stats output file]: Tests a learning algorithm on a domain,\n\
      keeping track of prediction error over time to get an estimate\n\
      of how many observations that algorithm needs to learn that domain\n\
+    - If a stats file is given, the learner's instrumentation is written to it (as json) whenever the test is stopped\n\
 \n\
   * plan <learner> <domain> <n> <m>: Use a learner to generate plans via BFS state-space search\n\
 \n\
@@ -140,8 +166,17 @@ void print_usage(const char* exe) {
      gen n2 m2 domain2 levels/stem2 k\n\
      predict_pt models/stem_0... models/stem2_t(l) data/stem2_t(l) levels/stem2 <learning?> k\n\
      avg data/avg_stem2_t(l).txt data/stem2_t(l) k n_avg\n\
+\n\
+  * bench <benchmark> [args]: Run one of the microbenchmarks listed below\n\
+    - Heap allocations are only counted in builds with QORA_COUNT_ALLOCATIONS defined; otherwise they show as 0\n\
 ");
 
+    //list available benchmarks
+    fprintf(stderr, "\nBenchmarks:\n");
+    for (const Benchmark& b : getBenchmarks()) {
+        fprintf(stderr, "\n  %s %s\n", b.name.c_str(), b.usage.c_str());
+    }
+
     //list available domains
     fprintf(stderr, "\nDomains:\n");
     for (const std::string name : CONTENTS.domain_names) {
@@ -654,7 +689,24 @@ int run_view(int argc, char** argv) {
     return EXIT_SUCCESS;
 }
 
-int run_predict(const std::string& learner_list, const std::string& file_models, const std::string& file_out, const std::string& file_in, int k) {
+//write a learner's instrumentation (Learner::getStats) to a json file
+//false (and logged) if the file can't be written; learners without stats just get a note in the log
+bool write_stats(const std::string& filename, const Learner& learner) {
+    json stats = learner.getStats();
+    if (stats.is_null()) {
+        Logger::log(Logger::formatString("Learner \"%s\" keeps no stats; not writing \"%s\"", learner.getName().c_str(), filename.c_str()));
+        return true;
+    }
+    std::ofstream output(filename);
+    if (!output.good()) {
+        Logger::log(Logger::formatString("Failed to open stats file \"%s\"", filename.c_str()), true);
+        return false;
+    }
+    output << std::setw(2) << stats << std::endl;
+    return true;
+}
+
+int run_predict(const std::string& learner_list, const std::string& file_models, const std::string& file_out, const std::string& file_in, int k, ModelFormat format, bool stats, bool use_arena) {
     //preemptively do some parsing of the learners
     std::vector<LearnerConstructor*> learner_constructors;
     std::vector<std::string> learner_names;
@@ -683,6 +735,10 @@ int run_predict(const std::string& learner_list, const std::string& file_models,
     Random random;
     random.seed_time();
     //
+    //with use_arena, everything the learners make for a single observation (the predictions, and their own temporaries) goes in here,
+    //and is released all at once when the observation is done
+    Arena arena;
+    //
     Progress progress_k("Predict", k);
     Logger::indent_push();
     for (int index = 0; index < k; index++) {
@@ -719,6 +775,7 @@ int run_predict(const std::string& learner_list, const std::string& file_models,
         std::vector<Learner*> learners;
         for (int i = 0; i < learner_constructors.size(); i++) {
             Learner* learner = learner_constructors[i]->constructor(env, learner_params[i]);
+            if (use_arena) learner->setArena(&arena);
             learners.push_back(learner);
         }
 
@@ -728,6 +785,7 @@ int run_predict(const std::string& learner_list, const std::string& file_models,
         Progress progress(Logger::formatString("Sequence %d/%d", index + 1, k), observations.count());
         Logger::indent_push();
         while (observations.next()) {
+            Arena::Scope scope(use_arena ? &arena : nullptr);
             const State& s = observations.getStartState();
             State sHidden = env->hideInformation(s);
             const ActionName& aname = observations.getAction();
@@ -773,19 +831,17 @@ int run_predict(const std::string& learner_list, const std::string& file_models,
                     {"name", domain_name},
                     {"parameters", domain_parameters}
                 }},
-                {"observations", observation_count - 1},
-                {"model", learner->to_json()}
+                {"observations", observation_count - 1}
             };
             //
             std::string str_id = std::to_string(i);
-            std::string model_filename = (k == 1) ? (file_models + "_" + str_id + ".json") : (file_models + "_" + str_id + "_" + std::to_string(index) + ".json");
-            std::ofstream output_learner(model_filename);
-            if (!output_learner.good()) {
-                Logger::log(Logger::formatString("Failed to open model output file \"%s\"", model_filename.c_str()), true);
+            std::string model_filename = (k == 1) ? (file_models + "_" + str_id) : (file_models + "_" + str_id + "_" + std::to_string(index));
+            if (!ModelFile::write(model_filename + model_file_extension(format), learner_data, *learner, format)) {
+                return EXIT_FAILURE;
+            }
+            if (stats && !write_stats(model_filename + "_stats.json", *learner)) {
                 return EXIT_FAILURE;
             }
-            output_learner << std::setw(2) << learner_data << std::endl;
-            output_learner.close();
             //
             delete learner;
         }
@@ -803,11 +859,11 @@ int run_predict(const std::string& learner_list, const std::string& file_models,
     Logger::indent_pop();
 }
 
-//predict <learner(s)> <model file name stem> <data output file> <input file> [k=1]
+//predict <learner(s)> <model file name stem> <data output file> <input file> [k=1] [model format=json] [stats=false] [arena=false]
 int run_predict(int argc, char** argv) {
     //check args
     if (argc < 4) {
-        Logger::log("predict needs 4-5 arguments: <learner(s)> <model file> <data output file> <input file> [k=1]", true);
+        Logger::log("predict needs 4-8 arguments: <learner(s)> <model file> <data output file> <input file> [k=1] [model format: json|binary, default=json] [stats: true|false, default=false] [arena: true|false, default=false]", true);
         return EXIT_FAILURE;
     }
     //get args
@@ -817,11 +873,20 @@ int run_predict(int argc, char** argv) {
     std::string file_input = argv[3];
     int k = 1;
     if (argc > 4) k = atoi(argv[4]);
+    ModelFormat format = ModelFormat::JSON;
+    if (argc > 5 && !parse_model_format(argv[5], format)) {
+        Logger::log(Logger::formatString("Unknown model format: \"%s\"", argv[5]), true);
+        return EXIT_FAILURE;
+    }
+    bool stats = false;
+    if (argc > 6) stats = (std::string(argv[6]) == "true");
+    bool use_arena = false;
+    if (argc > 7) use_arena = (std::string(argv[7]) == "true");
     //
-    return run_predict(learner_list, file_models, file_output, file_input, k);
+    return run_predict(learner_list, file_models, file_output, file_input, k, format, stats, use_arena);
 }
 
-int run_predict_pt(const std::string& learner_list, const std::string& file_models, const std::string& file_out, const std::string& file_in, bool learning_enabled, int k) {
+int run_predict_pt(const std::string& learner_list, const std::string& file_models, const std::string& file_out, const std::string& file_in, bool learning_enabled, int k, ModelFormat format) {
     //load the learners
     std::vector<std::string> learner_files = str_split(learner_list, ";");
 
@@ -867,31 +932,33 @@ int run_predict_pt(const std::string& learner_list, const std::string& file_mode
         std::vector<json> learner_datas; //json files loaded from each learned model input
         for (int i = 0; i < learner_files.size(); i++) {
             const std::string& learner_file_stem = learner_files[i];
-            std::string filename = (k == 1) ? learner_file_stem : (learner_file_stem + "_" + std::to_string(index) + ".json");
-            //attempt to open the file
-            std::ifstream input_learner(filename);
-            if (!input_learner.good()) {
-                Logger::log(Logger::formatString("Failed to open model input file \"%s\"", filename.c_str()), true);
+            std::string filename = (k == 1) ? learner_file_stem : (learner_file_stem + "_" + std::to_string(index) + model_file_extension(format));
+            //read the learner data (either format)
+            ModelFile model_file;
+            if (!model_file.read(filename)) {
                 return EXIT_FAILURE;
             }
-            //read the learner data
-            json learner_data;
-            input_learner >> learner_data;
-            learner_datas.push_back(learner_data);
+            const json& learner_data = model_file.getMetadata();
+            learner_datas.push_back(json{
+                {"name", learner_data.at("name")},
+                {"parameters", learner_data.at("parameters")},
+                {"observations", learner_data.at("observations")}
+            });
             //
-            std::string learner_name = learner_data["name"].get<std::string>();
+            std::string learner_name = learner_data.at("name").get<std::string>();
             auto it = CONTENTS.learners.find(learner_name);
             if (it == CONTENTS.learners.end()) {
                 Logger::log(Logger::formatString("Learner not found: \"%s\"", learner_name.c_str()), true);
                 return EXIT_FAILURE;
             }
             LearnerConstructor& constructor = it->second;
-            const json& learner_parameters = learner_data["parameters"];
-            Learner* learner = constructor.constructor(env, learner_parameters.get<std::map<std::string, std::string>>());
-            learner->from_json(learner_data["model"]);
+            Learner* learner = constructor.constructor(env, constructor.savedParams(learner_data.at("parameters")));
+            learner->setPredictOnly(!learning_enabled);
+            if (!model_file.load(*learner)) {
+                return EXIT_FAILURE;
+            }
             //
             learners.push_back(learner);
-            input_learner.close();
         }
 
         //run through the observations
@@ -899,36 +966,56 @@ int run_predict_pt(const std::string& learner_list, const std::string& file_mode
         int observation_count = 1;
         Progress progress(Logger::formatString("Sequence %d/%d", index + 1, k), observations.count());
         Logger::indent_push();
-        while (observations.next()) {
-            const State& s = observations.getStartState();
-            State sHidden = env->hideInformation(s);
-            const ActionName& aname = observations.getAction();
-            ActionId a = types.getActionByName(aname);
-            const StateDistribution& s_primes = observations.getNextStates();
-            State sHidden_prime = env->hideInformation(observations.getNextState());
-            //print out current observation number
-            //printf("%d\t", observation_count);
-            output << observation_count;
-            //run prediction of each learner, evaluate and output error
+        //observations are handed to the learners in batches
+        //with learning enabled, each prediction has to see the model after all of the earlier observations, so every batch is a single observation
+        const std::size_t batch_size = learning_enabled ? 1 : 256;
+        std::deque<State> batch_states; //hidden start and next states (a deque, so the transitions can point into it)
+        std::vector<StateDistribution> batch_s_primes;
+        std::vector<Transition> batch;
+        auto run_batch = [&]() {
+            //run prediction of each learner
+            std::vector<std::vector<StateDistribution>> predicted;
             for (Learner* learner : learners) {
-                StateDistribution predicted = learner->predictTransition(sHidden, a, random);
-                double error = s_primes.error(predicted);
-                //printf("%d\t", error);
-                output << '\t' << error;
+                predicted.push_back(learner->predictTransitions(batch, random));
+            }
+            //evaluate and output error
+            for (std::size_t t = 0; t < batch.size(); t++) {
+                //print out current observation number
+                output << observation_count;
+                for (std::size_t i = 0; i < learners.size(); i++) {
+                    double error = batch_s_primes[t].error(predicted[i][t]);
+                    output << '\t' << error;
+                }
+                output << '\n';
+                //
+                observation_count++;
             }
-            //printf("\n");
-            output << '\n';
             //update each learner
             if (learning_enabled) {
                 for (Learner* learner : learners) {
-                    learner->observeTransition(sHidden, a, sHidden_prime);
+                    learner->observeTransitions(batch);
                 }
             }
             //
-            observation_count++;
+            batch_states.clear();
+            batch_s_primes.clear();
+            batch.clear();
             //
             if (observations.count() > 1) progress.update(observations.index() + 1);
-        }
+        };
+        while (observations.next()) {
+            const State& s = observations.getStartState();
+            const ActionName& aname = observations.getAction();
+            ActionId a = types.getActionByName(aname);
+            batch_states.push_back(env->hideInformation(s));
+            const State& sHidden = batch_states.back();
+            batch_states.push_back(env->hideInformation(observations.getNextState()));
+            const State& sHidden_prime = batch_states.back();
+            batch_s_primes.push_back(observations.getNextStates());
+            batch.push_back(Transition{ &sHidden, a, &sHidden_prime });
+            if (batch.size() == batch_size) run_batch();
+        }
+        if (batch.size()) run_batch();
         if (observations.count() > 1) progress.end();
         Logger::indent_pop();
         for (int i = 0; i < learners.size(); i++) {
@@ -949,19 +1036,14 @@ int run_predict_pt(const std::string& learner_list, const std::string& file_mode
                         {"name", domain_name},
                         {"parameters", domain_parameters}
                     }},
-                    {"observations", (observation_count - 1) + learner_data_prev.at("observations").get<int>()},
-                    {"model", learner->to_json()}
+                    {"observations", (observation_count - 1) + learner_data_prev.at("observations").get<int>()}
                 };
                 //
                 std::string str_id = std::to_string(i);
-                std::string model_filename = (k == 1) ? (file_models + "_" + str_id + ".json") : (file_models + "_" + str_id + "_" + std::to_string(index) + ".json");
-                std::ofstream output_learner(model_filename);
-                if (!output_learner.good()) {
-                    Logger::log(Logger::formatString("Failed to open model output file \"%s\"", model_filename.c_str()), true);
+                std::string model_filename = (k == 1) ? (file_models + "_" + str_id) : (file_models + "_" + str_id + "_" + std::to_string(index));
+                if (!ModelFile::write(model_filename + model_file_extension(format), learner_data, *learner, format)) {
                     return EXIT_FAILURE;
                 }
-                output_learner << std::setw(2) << learner_data << std::endl;
-                output_learner.close();
             }
             delete learner;
         }
@@ -979,13 +1061,13 @@ int run_predict_pt(const std::string& learner_list, const std::string& file_mode
     Logger::indent_pop();
 }
 
-//<learner file(s)> <model file name stem> <data output file> <observations file> [learning enabled, true|false, default=false] [k=1]
+//<learner file(s)> <model file name stem> <data output file> <observations file> [learning enabled, true|false, default=false] [k=1] [model format=json]
 int run_predict_pt(int argc, char** argv) {
-    //<learner file(s)> <model file name stem> <data output file> <observations file> [learning enabled, true|false, default=false] [k=1]
+    //<learner file(s)> <model file name stem> <data output file> <observations file> [learning enabled, true|false, default=false] [k=1] [model format=json]
 
     //check args
     if (argc < 4) {
-        Logger::log("predict_pt needs 4-6 arguments: <learner file(s)> <model file name stem> <data output file> <observations file> [learning enabled, true|false, default=false] [k=1]", true);
+        Logger::log("predict_pt needs 4-7 arguments: <learner file(s)> <model file name stem> <data output file> <observations file> [learning enabled, true|false, default=false] [k=1] [model format: json|binary, default=json]", true);
         return EXIT_FAILURE;
     }
     //get args
@@ -997,8 +1079,13 @@ int run_predict_pt(int argc, char** argv) {
     if (argc > 4) learning_enabled = (std::string(argv[4]) == "true");
     int k = 1;
     if (argc > 5) k = atoi(argv[5]);
+    ModelFormat format = ModelFormat::JSON;
+    if (argc > 6 && !parse_model_format(argv[6], format)) {
+        Logger::log(Logger::formatString("Unknown model format: \"%s\"", argv[6]), true);
+        return EXIT_FAILURE;
+    }
     //
-    return run_predict_pt(learner_list, file_models, file_output, file_input, learning_enabled, k);
+    return run_predict_pt(learner_list, file_models, file_output, file_input, learning_enabled, k, format);
 }
 
 int run_avg(const std::string& file_out, const std::string& file_in, int k, int n) {
@@ -1116,33 +1203,31 @@ int run_print(int argc, char** argv) {
 
     //check arg
     if (argc < 1) {
-        Logger::log("print needs 1 argument: learner file", true);
+        Logger::log("print needs 1-2 arguments: learner file, [stats output file]", true);
         return EXIT_FAILURE;
     }
     //get arg
     std::string filename = argv[0];
-    //attempt to open the file
-    std::ifstream input(filename);
-    if (!input.good()) {
-        Logger::log(Logger::formatString("Failed to open input file \"%s\"", filename.c_str()), true);
+    std::string file_stats = (argc > 1) ? argv[1] : "";
+    //read the learner data (either format)
+    ModelFile model_file;
+    if (!model_file.read(filename)) {
         return EXIT_FAILURE;
     }
-    //read the learner data
-    json learner_data;
-    input >> learner_data;
+    const json& learner_data = model_file.getMetadata();
 
     //re-construct the domain
     Environment* env = nullptr;
     {
-        json& domain_data = learner_data["domain"];
-        const std::string& domain_name = domain_data["name"].get<std::string>();
+        const json& domain_data = learner_data.at("domain");
+        const std::string& domain_name = domain_data.at("name").get<std::string>();
         auto it = CONTENTS.domains.find(domain_name);
         if (it == CONTENTS.domains.end()) {
             Logger::log(Logger::formatString("Domain not found: \"%s\"", domain_name.c_str()), true);
             return EXIT_FAILURE;
         }
         DomainConstructor& constructor = it->second;
-        const json& domain_parameters = domain_data["parameters"];
+        const json& domain_parameters = domain_data.at("parameters");
         env = constructor.constructor(domain_parameters.get<std::map<std::string, std::string>>());
 
         //print some info for the user
@@ -1157,24 +1242,26 @@ int run_print(int argc, char** argv) {
     //construct the learner
     Learner* learner = nullptr;
     {
-        std::string learner_name = learner_data["name"].get<std::string>();
+        std::string learner_name = learner_data.at("name").get<std::string>();
         auto it = CONTENTS.learners.find(learner_name);
         if (it == CONTENTS.learners.end()) {
             Logger::log(Logger::formatString("Learner not found: \"%s\"", learner_name.c_str()), true);
             return EXIT_FAILURE;
         }
         LearnerConstructor& constructor = it->second;
-        const json& learner_parameters = learner_data["parameters"];
-        learner = constructor.constructor(env, learner_parameters.get<std::map<std::string, std::string>>());
-        learner->from_json(learner_data["model"]);
+        std::map<std::string, std::string> learner_parameters = constructor.savedParams(learner_data.at("parameters"));
+        learner = constructor.constructor(env, learner_parameters);
+        if (!model_file.load(*learner)) {
+            return EXIT_FAILURE;
+        }
 
         //print some info for the user
         //learner + params
         printf("Learner: %s\n", learner_name.c_str());
-        for (const auto& el : learner_parameters.items()) {
-            printf(" %s: %s\n", el.key().c_str(), el.value().get<std::string>().c_str());
+        for (const auto& el : learner_parameters) {
+            printf(" %s: %s\n", el.first.c_str(), el.second.c_str());
         }
-        printf("Observations: %d\n", learner_data["observations"].get<int>());
+        printf("Observations: %d\n", learner_data.at("observations").get<int>());
     }
 
     printf("\n");
@@ -1182,11 +1269,85 @@ int run_print(int argc, char** argv) {
     //print
     learner->print(stdout);
 
+    //stats, if asked for
+    bool ok = file_stats.empty() || write_stats(file_stats, *learner);
+
     //
     delete learner;
     delete env;
     //
-    return EXIT_SUCCESS;
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int run_freeze(int argc, char** argv) {
+    //load a qora model, freeze it, and save the result
+
+    //check args
+    if (argc < 2) {
+        Logger::log("freeze needs 2 arguments: learner file, output file, [model format = json]", true);
+        return EXIT_FAILURE;
+    }
+    //get args
+    std::string file_in = argv[0];
+    std::string file_out = argv[1];
+    ModelFormat format = ModelFormat::JSON;
+    if (argc > 2 && !parse_model_format(argv[2], format)) {
+        Logger::log(Logger::formatString("Unknown model format: \"%s\"", argv[2]), true);
+        return EXIT_FAILURE;
+    }
+    //read the learner data (either format)
+    ModelFile model_file;
+    if (!model_file.read(file_in)) {
+        return EXIT_FAILURE;
+    }
+    const json& learner_data = model_file.getMetadata();
+    std::string learner_name = learner_data.at("name").get<std::string>();
+    if (learner_name != "qora") {
+        Logger::log(Logger::formatString("Only qora models can be frozen, not \"%s\"", learner_name.c_str()), true);
+        return EXIT_FAILURE;
+    }
+
+    //re-construct the domain
+    const json& domain_data = learner_data.at("domain");
+    const std::string& domain_name = domain_data.at("name").get<std::string>();
+    auto it_domain = CONTENTS.domains.find(domain_name);
+    if (it_domain == CONTENTS.domains.end()) {
+        Logger::log(Logger::formatString("Domain not found: \"%s\"", domain_name.c_str()), true);
+        return EXIT_FAILURE;
+    }
+    Environment* env = it_domain->second.constructor(domain_data.at("parameters").get<std::map<std::string, std::string>>());
+
+    //load the learner; only what prediction needs
+    const LearnerConstructor& constructor = CONTENTS.learners.at(learner_name);
+    std::map<std::string, std::string> learner_parameters = constructor.savedParams(learner_data.at("parameters"));
+    Learner* learner = constructor.constructor(env, learner_parameters);
+    learner->setPredictOnly(true);
+    if (!model_file.load(*learner)) {
+        delete learner;
+        delete env;
+        return EXIT_FAILURE;
+    }
+
+    //freeze + save, with the same domain and observation count
+    std::unique_ptr<l_qora::LearnerQORAFrozen> frozen = dynamic_cast<l_qora::LearnerQORA*>(learner)->freeze();
+    json frozen_data{
+        {"name", "qora_frozen"},
+        {"parameters", {
+            {"index", learner_parameters.at("index")}
+        }},
+        {"domain", domain_data},
+        {"observations", learner_data.at("observations")}
+    };
+    bool ok = ModelFile::write(file_out, frozen_data, *frozen, format);
+    if (ok) {
+        printf("Frozen model: %zu input cases, %zu bytes; saved to %s\n", frozen->countCases(), frozen->getMemoryUsage(), file_out.c_str());
+    }
+
+    //
+    delete learner;
+    delete env;
+    //
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 //handle ctrl-c to stop running test mode
@@ -1196,12 +1357,12 @@ BOOL WINAPI test_ctrlc_handler(DWORD dwCtrlType)
     running_test_loop = false;
     return TRUE;
 }
-//test <learner> <domain> <m>
+//test <learner> <domain> <m> [m2] [stats file]
 int run_test(int argc, char** argv) {
 
     //check args
     if (argc < 3) {
-        Logger::log("test needs 3 arguments: learner, domain, m, [m2 = 2]", true);
+        Logger::log("test needs 3 arguments: learner, domain, m, [m2 = 2], [stats output file]", true);
         return EXIT_FAILURE;
     }
 
@@ -1211,6 +1372,7 @@ int run_test(int argc, char** argv) {
     int m = atoi(argv[2]); //number of actions to generate per start state
     int m2 = 1; //environments per print cycle
     if (argc >= 4) m2 = atoi(argv[3]);
+    std::string file_stats = (argc >= 5) ? argv[4] : ""; //written each time the loop is stopped
 
     //create domain
     auto domain_nameargs = str_args(domain_str);
@@ -1301,6 +1463,7 @@ int run_test(int argc, char** argv) {
         //user hit ctrl-c, print model and ask if they want to exit
 
         learner->print(stdout);
+        if (!file_stats.empty()) write_stats(file_stats, *learner);
 
         printf("\n\nContinue? y/n\n");
         std::string line;
@@ -1359,7 +1522,7 @@ int run_exec(int argc, char** argv) {
         return status;
     }
     //predict learners models/stem data/stem levels/stem k
-    if ((status = run_predict(learner_list, file_models, file_data, file_levels, k)) != EXIT_SUCCESS) {
+    if ((status = run_predict(learner_list, file_models, file_data, file_levels, k, ModelFormat::JSON, false, false)) != EXIT_SUCCESS) {
         return status;
     }
     //avg data/avg_stem.txt data/stem k
@@ -1423,7 +1586,7 @@ int run_exec_t(int argc, char** argv) {
         return status;
     }
     //predict learners models/stem data/stem levels/stem k
-    if ((status = run_predict(learner_list, file_models, file_data, file_levels, k)) != EXIT_SUCCESS) {
+    if ((status = run_predict(learner_list, file_models, file_data, file_levels, k, ModelFormat::JSON, false, false)) != EXIT_SUCCESS) {
         return status;
     }
     //avg data/avg_stem.txt data/stem k n_avg
@@ -1435,7 +1598,7 @@ int run_exec_t(int argc, char** argv) {
         return status;
     }
     //predict_pt models/stem_0... models/stem2_t(l) data/stem2_t(l) levels/stem2 <learning?> k
-    if ((status = run_predict_pt(learner_list2, file_models2, file_data2, file_levels2, learning_enabled, k)) != EXIT_SUCCESS) {
+    if ((status = run_predict_pt(learner_list2, file_models2, file_data2, file_levels2, learning_enabled, k, ModelFormat::JSON)) != EXIT_SUCCESS) {
         return status;
     }
     //avg data/avg_stem2_t(l).txt data/stem2_t(l) k
@@ -1459,22 +1622,26 @@ int run_bfs_to(const State& state_start, const State& state_end, Learner* learne
     while (!(state_current == state_end)) {
         printf(" Running planning iteration...\n");
         //
-        typedef std::pair<int, State> P;
+        //every state is stored once, in the pool; the search itself only keeps their ids
+        StatePool pool;
+        typedef std::pair<int, StatePool::Id> P;
         std::priority_queue<P, std::vector<P>, std::greater<P>> frontier;
-        std::set<State> visited;
-        std::map<State, std::pair<State, Action>> sources; //[state] -> [source state], for backtracking path creation
-        std::map<State, int> depths; //[state] -> distance from state_current at beginning of the loop
-        frontier.push({ state_current.diff(state_end).length() , state_current});
-        visited.insert(state_current);
-        depths[state_current] = 0;
+        std::vector<std::pair<StatePool::Id, ActionId>> sources; //[state id] -> [source state id, action], for backtracking path creation
+        std::vector<int> depths; //[state id] -> distance from state_current at beginning of the loop
+        StatePool::Id id_current = pool.intern(state_current).first;
+        frontier.push({ state_current.error(state_end) , id_current});
+        sources.push_back({ StatePool::NONE, -1 });
+        depths.push_back(0);
         //run BFS
         printf("  Starting A*...\n");
         bool solution_found = false;
         bool hit_limit = false;
+        StatePool::Id id_last = id_current;
         State state_last;
         while (frontier.size()) {
             P p = frontier.top();
-            state_last = p.second;
+            id_last = p.second;
+            state_last = pool.get(id_last);
             nodes_evaluated++;
             //check if reached goal
             if (state_last == state_end) {
@@ -1485,7 +1652,7 @@ int run_bfs_to(const State& state_start, const State& state_end, Learner* learne
             //
             frontier.pop();
             //check if reached depth limit
-            if (depths.at(state_last) >= plan_length_limit) {
+            if (depths[id_last] >= plan_length_limit) {
                 //printf("  Reached planning depth limit\n");
                 hit_limit = true;
                 break;
@@ -1493,16 +1660,22 @@ int run_bfs_to(const State& state_start, const State& state_end, Learner* learne
             //get neighbors for each possible action
             //shuffle order of actions so naive agent tends to take random paths
             random.shuffle(actions);
+            std::vector<Transition> transitions;
             for (const Action& action : actions) {
-                StateDistribution predict = learner->predictTransition(state_last, action.id, random);
-                State next = predict.sample(random);
+                transitions.push_back(Transition{ &state_last, action.id, nullptr });
+            }
+            std::vector<StateDistribution> predictions = learner->predictTransitions(transitions, random);
+            for (std::size_t i = 0; i < actions.size(); i++) {
+                const Action& action = actions[i];
+                State next = predictions[i].sample(random);
                 //
-                if (visited.insert(next).second) {
-                    //new state
-                    int depth = depths[state_last] + 1;
-                    frontier.push({ depth + next.diff(state_end).length(), next });
-                    sources[next] = { state_last, action };
-                    depths[next] = depth;
+                std::pair<StatePool::Id, bool> interned = pool.intern(next, id_last, state_last);
+                if (interned.second) {
+                    //new state (ids are handed out in order, so it goes on the end)
+                    int depth = depths[id_last] + 1;
+                    frontier.push({ depth + next.error(state_end), interned.first });
+                    sources.push_back({ id_last, action.id });
+                    depths.push_back(depth);
                 }
             }
         }
@@ -1518,21 +1691,17 @@ int run_bfs_to(const State& state_start, const State& state_end, Learner* learne
                 //model couldn't find path to goal
                 //which means it hasn't learned enough yet
 
-                //clear the path that was found
+                //forget the path that was found
                 //so a random action will be taken to gain training data
-                sources.clear();
+                id_last = id_current;
             }
         }
         //printf(" Constructing plan...\n");
         //execute search to whatever "state_current" is, then possibly try again
         std::vector<Action> plan;
         //construct plan in reverse order
-        State state_next = state_last;
-        while (true) {
-            if (sources.find(state_next) == sources.end()) break; //reached beginning
-            auto& pair = sources.at(state_next);
-            state_next = pair.first;
-            plan.push_back(pair.second);
+        for (StatePool::Id id = id_last; sources[id].first != StatePool::NONE; id = sources[id].first) {
+            plan.push_back(types.getActions()[sources[id].second]);
         }
         //reverse the plan
         std::reverse(plan.begin(), plan.end());
@@ -1640,20 +1809,21 @@ int run_plan(const std::string& learner_str, const std::string& domain_str, int
     int training_step = 0;
     for (int i = 0; i < n_train; i++) {
         //generate a level
-        State state = env->createRandomState(random);
+        std::vector<State> states;
+        states.reserve(m_train + 1);
+        states.push_back(env->createRandomState(random));
         //generate m observations
+        std::vector<Transition> transitions;
         for (int j = 0; j < m_train; j++) {
             //generate an action
             const Action& a = random.sample(types.getActions());
-            State next = env->act(state, a.id, random).sample(random);
-            //
-            learner->observeTransition(state, a.id, next);
-            //
-            state = next;
-            //
-            training_step++;
-            progress.update(training_step);
+            states.push_back(env->act(states.back(), a.id, random).sample(random));
+            transitions.push_back(Transition{ &states[j], a.id, &states[j + 1] });
         }
+        //and observe them all at once
+        learner->observeTransitions(transitions);
+        training_step += m_train;
+        progress.update(training_step);
     }
     progress.end();
 
@@ -1702,6 +1872,17 @@ int run_plan(int argc, char** argv) {
     return run_plan(learner, domain, n, m);
 }
 
+//bench <benchmark> [args]
+int run_bench(int argc, char** argv) {
+    //check args
+    if (argc < 1) {
+        Logger::log("bench needs at least 1 argument: <benchmark> [args]", true);
+        return EXIT_FAILURE;
+    }
+    //
+    return run_benchmark(argv[0], argc - 1, argv + 1);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 //main entrypoint
 ////////////////////////////////////////////////////////////////////////////////
@@ -1815,9 +1996,28 @@ void init_contents() {
     CONTENTS.addLearner("qora",
         Parameters()
         .addParameter(Parameter::createFloatParamDefault("alpha", 0.05, 0, 1))
+        .addParameter(Parameter::createIntParamDefault("threads", 1, 1, 256)) //threads used to observe each predictor's working set; results are the same for any number
+        .addParameter(Parameter::createEnumParam("eviction", {"none", "hopeless", "stale"}, 0)) //which working set candidates to drop (see EvictionPolicy)
+        .addParameter(Parameter::createIntParamDefault("stale", 1000, 1)) //for eviction:stale, observations without progress before a candidate is dropped
+        .addParameter(Parameter::createIntParamDefault("memory", 0, 0)) //memory budget over the working sets of all predictors, in KB; 0 = unlimited
+        .addParameter(Parameter::createIntParamDefault("predictor_memory", 0, 0)) //memory budget for each predictor's working set, in KB; 0 = unlimited
+        .addParameter(Parameter::createBoolParam("index", false)) //index each observation's objects by position, so positional predicates only look at nearby objects; results are the same either way
+        ,
+        [](const Environment* env, const std::map<std::string, std::string>& params) {
+            auto eviction = l_qora::EvictionPolicy::create(params.at("eviction"), std::stoi(params.at("stale")));
+            std::size_t memory = std::size_t(std::stoi(params.at("memory"))) * 1024;
+            std::size_t predictor_memory = std::size_t(std::stoi(params.at("predictor_memory"))) * 1024;
+            int index_attribute = (params.at("index") == "true") ? env->getPositionAttribute() : -1;
+            return new l_qora::LearnerQORA(env->getTypes(), std::stod(params.at("alpha")), std::stoi(params.at("threads")), eviction, memory, predictor_memory, index_attribute);
+        }
+    );
+    CONTENTS.addLearner("qora_frozen", //inference-only; made from a trained qora model by the freeze mode
+        Parameters()
+        .addParameter(Parameter::createBoolParam("index", false)) //same as qora's
         ,
         [](const Environment* env, const std::map<std::string, std::string>& params) {
-            return new l_qora::LearnerQORA(env->getTypes(), std::stod(params.at("alpha")));
+            int index_attribute = (params.at("index") == "true") ? env->getPositionAttribute() : -1;
+            return new l_qora::LearnerQORAFrozen(env->getTypes(), index_attribute);
         }
     );
 }
@@ -1869,10 +2069,12 @@ int main(int argc, char** argv)
         {"predict_pt", run_predict_pt},
         {"avg", run_avg},
         {"print", run_print},
+        {"freeze", run_freeze},
         {"test", run_test},
         {"exec", run_exec},
         {"exec_t", run_exec_t},
-        {"plan", run_plan}
+        {"plan", run_plan},
+        {"bench", run_bench}
     };
     auto it = modes.find(mode);
     if (it == modes.end()) {
@@ -1,6 +1,8 @@
 #include "pch.h"
 #include "Serialization.h"
 
+#include "Learner.h"
+
 ObservationIterator::ObservationIterator(std::istream& input, const Environment* env, const json& file_info) :
 	input(input), env(env), types(env->getTypes()),
 	is_verbose(file_info["identifier"] == "states_verbose"),
@@ -97,3 +99,101 @@ const State& ObservationIterator::getNextState() const
 {
 	return s_prime;
 }
+
+bool parse_model_format(const std::string& name, ModelFormat& format)
+{
+	if (name == "json") {
+		format = ModelFormat::JSON;
+		return true;
+	}
+	if (name == "binary") {
+		format = ModelFormat::BINARY;
+		return true;
+	}
+	return false;
+}
+
+std::string model_file_extension(ModelFormat format)
+{
+	return (format == ModelFormat::BINARY) ? ".qmb" : ".json";
+}
+
+const char ModelFile::MAGIC[8] = { 'Q', 'O', 'R', 'A', 'M', 'D', 'L', '\0' };
+constexpr std::uint64_t ModelFile::VERSION;
+
+bool ModelFile::write(const std::string& filename, const json& metadata, const Learner& learner, ModelFormat format)
+{
+	std::ofstream output(filename, std::ios::binary);
+	if (!output.good()) {
+		Logger::log(Logger::formatString("Failed to open model output file \"%s\"", filename.c_str()), true);
+		return false;
+	}
+	if (format == ModelFormat::JSON) {
+		json file = metadata;
+		file["model"] = learner.to_json();
+		output << std::setw(2) << file << std::endl;
+	}
+	else {
+		BinaryWriter out;
+		out.writeBytes(MAGIC, sizeof(MAGIC));
+		out.writeVarint(VERSION);
+		std::vector<std::uint8_t> packed = json::to_msgpack(metadata);
+		out.writeVarint(packed.size());
+		out.writeBytes(reinterpret_cast<const char*>(packed.data()), packed.size());
+		learner.to_binary(out);
+		output.write(out.data().data(), out.size());
+	}
+	return output.good();
+}
+
+bool ModelFile::read(const std::string& filename)
+{
+	std::ifstream input(filename, std::ios::binary);
+	if (!input.good()) {
+		Logger::log(Logger::formatString("Failed to open model input file \"%s\"", filename.c_str()), true);
+		return false;
+	}
+	data.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+	if (data.size() < sizeof(MAGIC) || data.compare(0, sizeof(MAGIC), MAGIC, sizeof(MAGIC)) != 0) {
+		format = ModelFormat::JSON;
+		metadata = json::parse(data);
+		data.clear();
+		return true;
+	}
+	format = ModelFormat::BINARY;
+	BinaryReader in(data.data() + sizeof(MAGIC), data.size() - sizeof(MAGIC));
+	std::uint64_t version = in.readVarint();
+	std::string packed = in.readString();
+	if (!in.ok() || version != VERSION) {
+		Logger::log(Logger::formatString("Unsupported or truncated model file \"%s\"", filename.c_str()), true);
+		return false;
+	}
+	metadata = json::from_msgpack(packed);
+	model_offset = data.size() - in.remaining();
+	return true;
+}
+
+ModelFormat ModelFile::getFormat() const
+{
+	return format;
+}
+
+const json& ModelFile::getMetadata() const
+{
+	return metadata;
+}
+
+bool ModelFile::load(Learner& learner) const
+{
+	if (format == ModelFormat::JSON) {
+		learner.from_json(metadata.at("model"));
+		return true;
+	}
+	BinaryReader in(data.data() + model_offset, data.size() - model_offset);
+	learner.from_binary(in);
+	if (!in.ok()) {
+		Logger::log("Model data is truncated or invalid", true);
+		return false;
+	}
+	return true;
+}
@@ -2,6 +2,8 @@
 
 #include "Environment.h"
 
+class Learner;
+
 //helper to iterate over concise or verbose pre-generated files
 //produces (s, a, s') triplets
 class ObservationIterator {
@@ -36,4 +38,30 @@ public:
 	const ActionName& getAction() const;
 	const StateDistribution& getNextStates() const;
 	const State& getNextState() const;
-};
\ No newline at end of file
+};
+
+//the formats predict/predict_pt can save learned models in
+//json: one object with the metadata (learner name, parameters, domain, ...) and the model under "model", pretty-printed
+//binary: MAGIC, a container version, the metadata as MessagePack, then the learner's own binary model (Learner::to_binary)
+enum class ModelFormat { JSON, BINARY };
+
+bool parse_model_format(const std::string& name, ModelFormat& format); //"json" or "binary"; false if neither
+std::string model_file_extension(ModelFormat format); //".json" or ".qmb"
+
+//a model file of either format; the format is detected when reading
+class ModelFile {
+	static const char MAGIC[8];
+	constexpr static std::uint64_t VERSION = 1; //container version; the learner's model has its own
+	//
+	ModelFormat format = ModelFormat::JSON;
+	json metadata; //json files: the whole file, including "model"
+	std::string data; //binary files: the whole file
+	std::size_t model_offset = 0; //binary files: where the learner's model starts in 'data'
+public:
+	static bool write(const std::string& filename, const json& metadata, const Learner& learner, ModelFormat format); //false (and logged) if the file can't be written
+	bool read(const std::string& filename); //false (and logged) if the file can't be opened or isn't a model file
+	//
+	ModelFormat getFormat() const;
+	const json& getMetadata() const;
+	bool load(Learner& learner) const; //false (and logged) if the model data is truncated or invalid
+};
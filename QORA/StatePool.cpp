@@ -0,0 +1,211 @@
+#include "pch.h"
+#include "StatePool.h"
+
+constexpr StatePool::Id StatePool::NONE;
+constexpr int StatePool::CHANGE_REMOVED;
+constexpr int StatePool::CHANGE_ADDED;
+
+static inline std::size_t slot_hash(std::uint64_t hash, std::size_t mask)
+{
+	return std::size_t((hash * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+}
+
+//true if two objects have the same attributes (ids and sizes), so one can be turned into the other value by value
+static bool same_shape(const Object& a, const Object& b)
+{
+	if (a.getTypeId() != b.getTypeId()) return false;
+	const auto& attributes_a = a.getAttributes();
+	const auto& attributes_b = b.getAttributes();
+	if (attributes_a.size() != attributes_b.size()) return false;
+	for (std::size_t i = 0; i < attributes_a.size(); i++) {
+		if (attributes_a[i].first != attributes_b[i].first || attributes_a[i].second.size() != attributes_b[i].second.size()) return false;
+	}
+	return true;
+}
+
+StatePool::StatePool() : slots(16, NONE)
+{
+}
+
+std::size_t StatePool::countChanges(Id id) const
+{
+	std::size_t end = (id + 1 < entries.size()) ? entries[id + 1].changes : changes.size();
+	return end - entries[id].changes;
+}
+
+void StatePool::rehash(std::size_t slot_count)
+{
+	slots.assign(slot_count, NONE);
+	std::size_t mask = slot_count - 1;
+	for (Id id = 0; id < entries.size(); id++) {
+		std::size_t i = slot_hash(entries[id].hash, mask);
+		while (slots[i] != NONE) i = (i + 1) & mask;
+		slots[i] = id;
+	}
+}
+
+StatePool::Id StatePool::find(const State& state, std::uint64_t hash) const
+{
+	std::size_t mask = slots.size() - 1;
+	for (std::size_t i = slot_hash(hash, mask); slots[i] != NONE; i = (i + 1) & mask) {
+		Id id = slots[i];
+		//only rebuild the stored state if the hashes collide
+		if (entries[id].hash == hash && get(id) == state) return id;
+	}
+	return NONE;
+}
+
+StatePool::Id StatePool::insert(std::uint64_t hash, Id parent)
+{
+	Id id = Id(entries.size());
+	entries.push_back(Entry{ hash, parent, std::uint32_t(changes.size()) });
+	if (entries.size() * 2 > slots.size()) {
+		rehash(slots.size() * 2);
+	}
+	else {
+		std::size_t mask = slots.size() - 1;
+		std::size_t i = slot_hash(hash, mask);
+		while (slots[i] != NONE) i = (i + 1) & mask;
+		slots[i] = id;
+	}
+	return id;
+}
+
+std::pair<StatePool::Id, bool> StatePool::intern(const State& state)
+{
+	std::uint64_t hash = state.hash();
+	Id id = find(state, hash);
+	if (id != NONE) return { id, false };
+	id = insert(hash, NONE);
+	roots.emplace(id, state);
+	return { id, true };
+}
+
+std::pair<StatePool::Id, bool> StatePool::intern(const State& state, Id parent, const State& parent_state)
+{
+	std::uint64_t hash = state.hash();
+	Id id = find(state, hash);
+	if (id != NONE) return { id, false };
+	//walk both states in order of object id and record what's different
+	std::vector<Change> delta;
+	auto it = state.getObjects().begin();
+	auto end = state.getObjects().end();
+	auto parent_it = parent_state.getObjects().begin();
+	auto parent_end = parent_state.getObjects().end();
+	while (it != end || parent_it != parent_end) {
+		if (it == end || (parent_it != parent_end && parent_it->first < it->first)) {
+			delta.push_back(Change{ parent_it->first, CHANGE_REMOVED, 0, 0 });
+			++parent_it;
+		}
+		else if (parent_it == parent_end || it->first < parent_it->first) {
+			delta.push_back(Change{ it->first, CHANGE_ADDED, 0, int(added.size()) });
+			added.push_back(it->second);
+			++it;
+		}
+		else {
+			const Object& obj = it->second;
+			const Object& parent_obj = parent_it->second;
+			if (same_shape(obj, parent_obj)) {
+				const auto& attributes = obj.getAttributes();
+				const auto& parent_attributes = parent_obj.getAttributes();
+				for (std::size_t a = 0; a < attributes.size(); a++) {
+					const AttributeValue& value = attributes[a].second;
+					const AttributeValue& parent_value = parent_attributes[a].second;
+					for (int i = 0; i < value.size(); i++) {
+						if (value[i] != parent_value[i]) delta.push_back(Change{ it->first, attributes[a].first, i, value[i] });
+					}
+				}
+			}
+			else {
+				delta.push_back(Change{ it->first, CHANGE_ADDED, 0, int(added.size()) });
+				added.push_back(obj);
+			}
+			++it;
+			++parent_it;
+		}
+	}
+	//
+	id = insert(hash, parent);
+	changes.insert(changes.end(), delta.begin(), delta.end());
+	return { id, true };
+}
+
+State StatePool::get(Id id) const
+{
+	//find the root, then apply the changes on the way back down
+	std::vector<Id> chain;
+	while (entries[id].parent != NONE) {
+		chain.push_back(id);
+		id = entries[id].parent;
+	}
+	State state = roots.at(id); //shares all of the root's objects until they're changed
+	for (auto c = chain.rbegin(); c != chain.rend(); c++) {
+		std::size_t begin = entries[*c].changes;
+		std::size_t end = begin + countChanges(*c);
+		for (std::size_t i = begin; i < end; i++) {
+			const Change& change = changes[i];
+			if (change.attribute == CHANGE_REMOVED) {
+				state.remove(change.object);
+			}
+			else if (change.attribute == CHANGE_ADDED) {
+				state.add(added[change.value]);
+			}
+			else {
+				state.getObject(change.object).getAttribute(change.attribute)[change.index] = change.value;
+			}
+		}
+	}
+	return state;
+}
+
+StatePool::Id StatePool::getParent(Id id) const
+{
+	return entries.at(id).parent;
+}
+
+std::size_t StatePool::size() const
+{
+	return entries.size();
+}
+
+void StatePool::clear()
+{
+	entries.clear();
+	changes.clear();
+	added.clear();
+	roots.clear();
+	slots.assign(16, NONE);
+}
+
+std::size_t StatePool::getMemoryUsage() const
+{
+	std::size_t bytes = sizeof(StatePool);
+	bytes += entries.capacity() * sizeof(Entry);
+	bytes += changes.capacity() * sizeof(Change);
+	bytes += slots.capacity() * sizeof(Id);
+	for (const Object& obj : added) {
+		bytes += sizeof(Object) + obj.getAttributes().capacity() * sizeof(std::pair<int, AttributeValue>);
+	}
+	for (const auto& pair : roots) {
+		bytes += sizeof(pair) + estimateMemoryUsage(pair.second);
+	}
+	return bytes;
+}
+
+std::size_t StatePool::estimateMemoryUsage(const State& state)
+{
+	std::size_t bytes = sizeof(State);
+	//every chunk's worth of objects, plus the attribute storage of each object
+	std::size_t chunks = 0;
+	int last_chunk = -1;
+	for (const auto& pair : state.getObjects()) {
+		if (pair.first / State::CHUNK_SIZE != last_chunk) chunks++;
+		last_chunk = pair.first / State::CHUNK_SIZE;
+		for (const auto& attribute : pair.second.getAttributes()) {
+			bytes += attribute.second.getHeapUsage();
+		}
+		bytes += pair.second.getAttributes().capacity() * sizeof(std::pair<int, AttributeValue>);
+	}
+	bytes += chunks * (sizeof(State::Chunk) + sizeof(std::shared_ptr<State::Chunk>));
+	return bytes;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Environment.h"
+
+//stores each distinct State of a search once and hands out compact ids for them, so a planner's frontier, visited set and back-pointers can be arrays of ids
+//the first state is kept whole; every other state is stored as its differences from the state it was reached from (usually a handful of values),
+//and is rebuilt by applying those differences to its parent when it's needed
+class StatePool {
+public:
+	typedef std::uint32_t Id;
+	constexpr static Id NONE = 0xFFFFFFFF;
+private:
+	constexpr static int CHANGE_REMOVED = -1; //Change::attribute of an object that was removed
+	constexpr static int CHANGE_ADDED = -2; //Change::attribute of an object that was added (or replaced), Change::value = its index in 'added'
+	//
+	struct Change {
+		int object;
+		int attribute;
+		int index; //component of the attribute
+		int value;
+	};
+	struct Entry {
+		std::uint64_t hash; //State::hash
+		Id parent; //NONE for a root
+		std::uint32_t changes; //first change from the parent; they run up to the next entry's
+	};
+	//
+	std::vector<Entry> entries; //[id]
+	std::vector<Change> changes;
+	std::vector<Object> added; //objects that weren't in the parent (or changed shape)
+	std::map<Id, State> roots; //states that were stored whole
+	std::vector<Id> slots; //open addressing over entries by hash, size is a power of 2
+	//
+	std::size_t countChanges(Id id) const;
+	void rehash(std::size_t slot_count);
+	Id find(const State& state, std::uint64_t hash) const; //NONE if it isn't here
+	Id insert(std::uint64_t hash, Id parent);
+public:
+	StatePool();
+	//
+	std::pair<Id, bool> intern(const State& state); //store a state whole; returns its id, and whether it's new
+	std::pair<Id, bool> intern(const State& state, Id parent, const State& parent_state); //store a state as its differences from parent (parent_state = get(parent))
+	State get(Id id) const;
+	Id getParent(Id id) const;
+	std::size_t size() const;
+	void clear();
+	//
+	std::size_t getMemoryUsage() const; //approximate number of bytes used, including heap storage
+	static std::size_t estimateMemoryUsage(const State& state); //approximate number of bytes a State's objects would use if none were shared with another State
+};
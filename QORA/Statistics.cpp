@@ -99,7 +99,14 @@ double normal_critical_value(double p) {
 ConfidenceInterval Statistics::estimate_binomial_interval(std::size_t n, std::size_t ns, double alpha)
 {
     std::size_t nf = n - ns;
-    double z = normal_critical_value(1 - alpha / 2);
+    //the critical value only depends on alpha, which is fixed for a whole learner, so skip the bisection search when it hasn't changed
+    static thread_local double last_alpha = -1;
+    static thread_local double last_z = 0;
+    if (alpha != last_alpha) {
+        last_alpha = alpha;
+        last_z = normal_critical_value(1 - alpha / 2);
+    }
+    double z = last_z;
     double z2 = z * z;
     double center = (ns + z2 / 2) / (n + z2);
     double root_part = (double(ns) * double(nf) / n) + (z2 / 4);
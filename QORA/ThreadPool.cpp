@@ -0,0 +1,155 @@
+#include "pch.h"
+#include "ThreadPool.h"
+
+////////////////////////////////////////////////////////////////////////////////
+//work-stealing pool of worker threads for data-parallel loops
+////////////////////////////////////////////////////////////////////////////////
+
+//which pool (if any) the current thread is a worker of, and its queue in that pool
+static thread_local const ThreadPool* current_pool = nullptr;
+static thread_local std::size_t current_queue = 0;
+
+ThreadPool::ThreadPool(int threads)
+{
+	int n_workers = std::max(threads - 1, 0);
+	for (int i = 0; i <= n_workers; i++) {
+		queues.emplace_back(new TaskQueue());
+	}
+	for (int i = 0; i < n_workers; i++) {
+		workers.emplace_back(&ThreadPool::worker_loop, this, std::size_t(i));
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+		stopping = true;
+	}
+	cv_sleep.notify_all();
+	for (std::thread& t : workers) {
+		t.join();
+	}
+}
+
+int ThreadPool::size() const
+{
+	return int(workers.size()) + 1;
+}
+
+std::size_t ThreadPool::queueIndex() const
+{
+	return (current_pool == this) ? current_queue : (queues.size() - 1);
+}
+
+void ThreadPool::push(std::size_t queue_index, Task&& task)
+{
+	TaskQueue& q = *queues[queue_index];
+	std::lock_guard<std::mutex> lock(q.mutex);
+	q.tasks.push_back(std::move(task));
+	queued++;
+}
+
+bool ThreadPool::pop(Task& task)
+{
+	if (queued == 0) return false;
+	std::size_t own = queueIndex();
+	{
+		TaskQueue& q = *queues[own];
+		std::lock_guard<std::mutex> lock(q.mutex);
+		if (!q.tasks.empty()) {
+			task = std::move(q.tasks.back());
+			q.tasks.pop_back();
+			queued--;
+			return true;
+		}
+	}
+	for (std::size_t i = 1; i < queues.size(); i++) {
+		TaskQueue& q = *queues[(own + i) % queues.size()];
+		std::lock_guard<std::mutex> lock(q.mutex);
+		if (!q.tasks.empty()) {
+			task = std::move(q.tasks.front());
+			q.tasks.pop_front();
+			queued--;
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThreadPool::worker_loop(std::size_t index)
+{
+	current_pool = this;
+	current_queue = index;
+	Task task;
+	while (true) {
+		if (pop(task)) {
+			task();
+			task = nullptr;
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(sleep_mutex);
+		cv_sleep.wait(lock, [&] { return stopping || queued > 0; });
+		if (stopping && queued == 0) return;
+	}
+}
+
+void ThreadPool::parallel_for(std::size_t n, std::size_t grain, const RangeFunction& f)
+{
+	if (n == 0) return;
+	if (grain == 0) grain = 1;
+	std::size_t chunks = (n + grain - 1) / grain;
+	if (workers.empty() || chunks == 1) {
+		f(0, n);
+		return;
+	}
+	//queue every chunk but the first, which this thread runs itself
+	//an exception from any chunk is kept (the first one) and rethrown here once every chunk is done,
+	//since the queued chunks refer to f and this frame; chunks that haven't started by then are skipped
+	std::atomic<std::size_t> remaining{ chunks };
+	std::atomic<bool> failed{ false };
+	std::exception_ptr error;
+	std::mutex error_mutex;
+	//the last chunk to finish wakes this thread, if it ran out of chunks to help with before then
+	std::mutex done_mutex;
+	std::condition_variable cv_done;
+	auto run = [&f, &remaining, &failed, &error, &error_mutex, &done_mutex, &cv_done](std::size_t begin, std::size_t end) {
+		if (!failed) {
+			try {
+				f(begin, end);
+			}
+			catch (...) {
+				std::lock_guard<std::mutex> lock(error_mutex);
+				if (!error) error = std::current_exception();
+				failed = true;
+			}
+		}
+		//notified under the lock, so this frame can't return (and destroy cv_done) until the notify is over
+		std::lock_guard<std::mutex> lock(done_mutex);
+		if (--remaining == 0) cv_done.notify_all();
+	};
+	std::size_t queue_index = queueIndex();
+	for (std::size_t chunk = chunks - 1; chunk > 0; chunk--) {
+		std::size_t begin = chunk * grain;
+		std::size_t end = std::min(n, begin + grain);
+		push(queue_index, [&run, begin, end] { run(begin, end); });
+	}
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+	}
+	cv_sleep.notify_all();
+	run(0, std::min(n, grain));
+	//keep running tasks (from this loop or any other) until all of this loop's chunks are done
+	Task task;
+	while (remaining > 0) {
+		if (pop(task)) {
+			task();
+			task = nullptr;
+			continue;
+		}
+		//the rest are running on other threads
+		std::unique_lock<std::mutex> lock(done_mutex);
+		cv_done.wait(lock, [&] { return remaining == 0; });
+	}
+	if (error) std::rethrow_exception(error);
+}
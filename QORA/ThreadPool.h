@@ -0,0 +1,42 @@
+#pragma once
+
+////////////////////////////////////////////////////////////////////////////////
+//work-stealing pool of worker threads for data-parallel loops
+////////////////////////////////////////////////////////////////////////////////
+
+//each worker has its own task queue: it takes its newest task first, and when it runs out it steals the oldest task from another queue
+//threads that are waiting on a loop keep running tasks instead of blocking, so loops can be nested (a task may call parallel_for itself)
+class ThreadPool {
+public:
+	typedef std::function<void(std::size_t begin, std::size_t end)> RangeFunction; //process the items in [begin, end)
+private:
+	typedef std::function<void()> Task;
+	struct TaskQueue {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+	//
+	std::vector<std::thread> workers;
+	std::vector<std::unique_ptr<TaskQueue>> queues; //one per worker, plus a shared one (at the end) for threads that aren't in the pool
+	std::atomic<std::size_t> queued{ 0 }; //number of tasks sitting in the queues
+	//idle workers sleep until something is queued
+	std::mutex sleep_mutex;
+	std::condition_variable cv_sleep;
+	bool stopping = false;
+	//
+	std::size_t queueIndex() const; //the queue that belongs to the calling thread
+	void push(std::size_t queue_index, Task&& task);
+	bool pop(Task& task); //own queue first (newest task), then steal from the others (oldest task)
+	void worker_loop(std::size_t index);
+public:
+	ThreadPool(int threads); //total number of threads that work on a loop, including the caller (so threads - 1 workers are started)
+	~ThreadPool();
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+	//
+	int size() const; //number of threads, including the caller
+	//split [0, n) into chunks of (at most) grain items and run f on each of them, using all threads; returns once every chunk is done
+	//the calling thread works on chunks too; if there are no workers or only one chunk, f is just called directly
+	//if f throws, the first exception is rethrown on the calling thread, after every chunk has finished or been skipped
+	void parallel_for(std::size_t n, std::size_t grain, const RangeFunction& f);
+};
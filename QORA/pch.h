@@ -5,16 +5,29 @@
 
 //c headers
 #include <cassert>
+#include <cstdint>
+#include <cstring>
 
 //data structures
+#include <deque>
 #include <map>
 #include <queue>
 #include <set>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+//threading
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
 //misc
 #include <chrono>
+#include <exception>
 #include <functional>
+#include <memory>
 #include <fstream>
 #include <iostream> //for the getline
 #include <random>
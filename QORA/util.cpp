@@ -313,3 +313,137 @@ int* IntTensor::block(int x, int y)
 {
 	return values.data() + (x * (h * d) + y * d);
 }
+
+void BinaryWriter::writeVarint(std::uint64_t value)
+{
+	while (value >= 0x80) {
+		buffer.push_back(char((value & 0x7F) | 0x80));
+		value >>= 7;
+	}
+	buffer.push_back(char(value));
+}
+
+void BinaryWriter::writeSigned(std::int64_t value)
+{
+	writeVarint((std::uint64_t(value) << 1) ^ std::uint64_t(value >> 63));
+}
+
+void BinaryWriter::writeString(const std::string& value)
+{
+	writeVarint(value.size());
+	buffer.append(value);
+}
+
+void BinaryWriter::writeDouble(double value)
+{
+	std::uint64_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+	for (int i = 0; i < 8; i++) {
+		buffer.push_back(char(bits & 0xFF));
+		bits >>= 8;
+	}
+}
+
+void BinaryWriter::writeBytes(const char* data, std::size_t size)
+{
+	buffer.append(data, size);
+}
+
+std::size_t BinaryWriter::size() const
+{
+	return buffer.size();
+}
+
+const std::string& BinaryWriter::data() const
+{
+	return buffer;
+}
+
+BinaryReader::BinaryReader(const char* data, std::size_t size) : pos(data), end(data + size)
+{
+}
+
+std::uint64_t BinaryReader::readVarint()
+{
+	std::uint64_t value = 0;
+	for (int shift = 0; shift < 64; shift += 7) {
+		if (pos == end) {
+			failed = true;
+			return 0;
+		}
+		std::uint8_t byte = std::uint8_t(*pos++);
+		value |= std::uint64_t(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0) return value;
+	}
+	failed = true; //more than 10 bytes
+	return 0;
+}
+
+std::int64_t BinaryReader::readSigned()
+{
+	std::uint64_t value = readVarint();
+	return std::int64_t(value >> 1) ^ -std::int64_t(value & 1);
+}
+
+std::string BinaryReader::readString()
+{
+	std::uint64_t size = readVarint();
+	if (size > remaining()) {
+		failed = true;
+		pos = end;
+		return std::string();
+	}
+	std::string value(pos, std::size_t(size));
+	pos += size;
+	return value;
+}
+
+double BinaryReader::readDouble()
+{
+	if (remaining() < 8) {
+		failed = true;
+		pos = end;
+		return 0;
+	}
+	std::uint64_t bits = 0;
+	for (int i = 0; i < 8; i++) {
+		bits |= std::uint64_t(std::uint8_t(pos[i])) << (8 * i);
+	}
+	pos += 8;
+	double value;
+	std::memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+BinaryReader BinaryReader::readBlock(std::size_t size)
+{
+	if (size > remaining()) {
+		failed = true;
+		size = remaining();
+	}
+	BinaryReader block(pos, size);
+	block.failed = failed;
+	pos += size;
+	return block;
+}
+
+void BinaryReader::fail()
+{
+	failed = true;
+	pos = end;
+}
+
+bool BinaryReader::ok() const
+{
+	return !failed;
+}
+
+std::size_t BinaryReader::remaining() const
+{
+	return std::size_t(end - pos);
+}
+
+const char* BinaryReader::position() const
+{
+	return pos;
+}
@@ -91,4 +91,39 @@ public:
 	int at(int x, int y, int z) const;
 	//get a pointer to a single z block, starting at z=0
 	int* block(int x, int y);
-};
\ No newline at end of file
+};
+//compact binary encoding, for model files
+//integers are LEB128 varints (signed ones are zigzag-encoded first), so small counts, ids and values take a single byte
+class BinaryWriter {
+	std::string buffer;
+public:
+	void writeVarint(std::uint64_t value);
+	void writeSigned(std::int64_t value);
+	void writeString(const std::string& value); //length, then the bytes
+	void writeDouble(double value); //the 8 bytes of the IEEE 754 value, little-endian
+	void writeBytes(const char* data, std::size_t size); //just the bytes
+	//
+	std::size_t size() const;
+	const std::string& data() const;
+};
+
+//reads what a BinaryWriter wrote
+//reading past the end (i.e., a truncated or corrupt file) doesn't crash: every read from then on returns 0/empty, and ok() returns false
+class BinaryReader {
+	const char* pos;
+	const char* end;
+	bool failed = false;
+public:
+	BinaryReader(const char* data, std::size_t size);
+	//
+	std::uint64_t readVarint();
+	std::int64_t readSigned();
+	std::string readString();
+	double readDouble();
+	BinaryReader readBlock(std::size_t size); //a reader over the next 'size' bytes, which this reader then skips
+	//
+	void fail(); //for callers that find the data itself invalid (e.g. an out-of-range id); ok() returns false from then on
+	bool ok() const; //false if any read has gone past the end
+	std::size_t remaining() const;
+	const char* position() const; //the next unread byte
+};